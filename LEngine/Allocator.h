@@ -0,0 +1,60 @@
+#pragma once
+
+#include "GlobalState.h"
+
+#include <string>
+#include <vector>
+#include <iterator>
+#include <concepts>
+
+namespace le
+{
+	/*
+	* Standard allocator for the contents of objects, like the elements of an Array and the characters of a String.
+	* The memory is taken from global::mem so everything a script makes is pooled and accounted for by the MemoryManager.
+	* Freeing only needs the address and size, so contents may outlive the manager that made them.
+	*/
+	template<typename _T>
+	struct Allocator
+	{
+		using value_type = _T;
+
+		Allocator() = default;
+		template<typename _U> Allocator(const Allocator<_U>&) noexcept {}
+
+		auto allocate(size_t count) -> _T*
+		{
+			static_assert(alignof(_T) <= MemoryManager::size_class_step, "Type needs a stronger alignment than blocks have");
+			return static_cast<_T*>(global::mem->allocate(count * sizeof(_T)));
+		}
+
+		auto deallocate(_T* memory, size_t count) -> void
+		{
+			MemoryManager::deallocate(memory, count * sizeof(_T));
+		}
+
+		template<typename _U> auto operator==(const Allocator<_U>&) const -> bool { return true; }
+	};
+
+	using ManagedString = std::basic_string<char, std::char_traits<char>, Allocator<char>>;
+	template<typename _T> using ManagedVector = std::vector<_T, Allocator<_T>>;
+
+	/* Moves contents into a new allocation if they are in a pool MemoryManager::compact is emptying, the new one is taken from another pool */
+	template<typename _Container>
+	auto relocate(_Container& contents) -> void
+	{
+		using Element = typename _Container::value_type;
+		const auto data = reinterpret_cast<const std::byte*>(contents.data());
+		const auto self = reinterpret_cast<const std::byte*>(&contents);
+		if (contents.capacity() == 0 or (data >= self and data < self + sizeof(_Container)))
+			return; /* Nothing allocated, or a short string kept inside the object */
+
+		/* Strings allocate room for their terminator */
+		const auto count = contents.capacity() + (std::same_as<_Container, ManagedString> ? 1ull : 0ull);
+		if (not MemoryManager::evacuating(data, count * sizeof(Element)))
+			return;
+
+		auto moved = _Container(std::make_move_iterator(contents.begin()), std::make_move_iterator(contents.end()));
+		contents.swap(moved);
+	}
+}
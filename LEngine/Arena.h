@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+
+namespace le
+{
+	/*
+	* Bump allocator for objects that all die together, like the nodes of an AST.
+	* Memory is taken in blocks and only given back when the arena is destroyed, which also runs the destructors of the objects that need one.
+	* Destroying an arena of trivial objects is freeing a handful of blocks, no matter how many objects were made.
+	* Arenas don't move as their allocators point at them, see ArenaAllocator.
+	*/
+	class Arena
+	{
+		static constexpr auto block_size = 16384ull;
+
+		struct Destructor
+		{
+			void(*destroy)(void*){};
+			void* object{};
+		};
+
+		std::vector<std::unique_ptr<std::byte[]>> _blocks{};
+		std::byte* _top{};
+		std::byte* _end{};
+		std::vector<Destructor> _destructors{};
+		size_t _bytes{};
+	public:
+		static constexpr auto alignment = alignof(std::max_align_t);
+
+		Arena() = default;
+		Arena(const Arena&) = delete;
+		auto operator=(const Arena&) = delete;
+
+		~Arena()
+		{
+			for (auto itr = _destructors.rbegin(); itr != _destructors.rend(); itr++)
+				itr->destroy(itr->object);
+		}
+
+		/* @return size bytes aligned to alignment */
+		auto allocate(size_t size) -> void*
+		{
+			size = (size + alignment - 1ull) & ~(alignment - 1ull);
+			if (static_cast<size_t>(_end - _top) < size)
+			{
+				const auto bytes = std::max<size_t>(block_size, size);
+				_blocks.emplace_back(new std::byte[bytes]);
+				_top = _blocks.back().get();
+				_end = _top + bytes;
+			}
+
+			auto memory = _top;
+			_top += size;
+			_bytes += size;
+			return memory;
+		}
+
+		/* @return An object living till the arena is destroyed */
+		template<typename _T, typename... _Args>
+		auto make(_Args&&... args) -> _T*
+		{
+			static_assert(alignof(_T) <= alignment, "Type needs a stronger alignment than the arena has");
+			auto object = ::new (allocate(sizeof(_T))) _T(std::forward<_Args>(args)...);
+			if constexpr (not std::is_trivially_destructible_v<_T>)
+				_destructors.push_back(Destructor{ .destroy = [](void* object) { static_cast<_T*>(object)->~_T(); }, .object = object });
+			return object;
+		}
+
+		/* @return Bytes handed out so far */
+		auto bytes() const -> size_t { return _bytes; }
+	};
+
+	/* Standard allocator taking memory from an Arena, nothing is given back before the arena is destroyed */
+	template<typename _T>
+	struct ArenaAllocator
+	{
+		using value_type = _T;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+
+		Arena* arena{};
+
+		ArenaAllocator(Arena& arena_) noexcept : arena(&arena_) {}
+		template<typename _U> ArenaAllocator(const ArenaAllocator<_U>& other) noexcept : arena(other.arena) {}
+
+		auto allocate(size_t count) -> _T*
+		{
+			static_assert(alignof(_T) <= Arena::alignment, "Type needs a stronger alignment than the arena has");
+			return static_cast<_T*>(arena->allocate(count * sizeof(_T)));
+		}
+
+		auto deallocate(_T*, size_t) noexcept -> void {}
+
+		template<typename _U> auto operator==(const ArenaAllocator<_U>& other) const -> bool { return arena == other.arena; }
+	};
+}
@@ -5,6 +5,7 @@
 #include "Number.h"
 #include "MemberFunctions.h"
 #include "Iterator.h"
+#include "Allocator.h"
 
 #include <vector>
 
@@ -14,19 +15,35 @@ namespace le
 	struct Array : RuntimeValue
 	{
 		
-		Array() = default;
+		Array() { type = Type::Array; }
 		explicit Array(u64 size)
+			: Array()
 		{
 			data.reserve(size);
 		}
 
-		std::vector<LeObject> data{};
+		ManagedVector<LeObject> data{};
 
 		auto type_name() -> String override
 		{
 			return "Array";
 		}
 
+		auto trace(Tracer& tracer) -> void override
+		{
+			tracer.mark(data);
+		}
+
+		auto clear_references() -> void override
+		{
+			data.clear();
+		}
+
+		auto relocate() -> void override
+		{
+			le::relocate(data);
+		}
+
 		auto make_string() -> String override
 		{
 			if (data.empty()) return String("[]");
@@ -48,34 +65,52 @@ namespace le
 
 		auto access(LeObject index) -> LeObject override
 		{
-			auto idx = to_numeric_index(*index);
+			auto idx = to_numeric_index(index);
 			return at(idx);
 		}
 
-		auto member_access(LeObject self, const String& member) -> LeObject override
+		static inline const auto layout = next_layout_id();
+
+		static auto methods() -> std::span<const BuiltinMethod<Array>>
 		{
-			if (member == "append")
+			static const BuiltinMethod<Array> table[] =
 			{
-				return global::mem->emplace<MemberFunction<Array>>(self,
-					[](Array& self, std::span<LeObject>& args, struct VirtualMachine&)->LeObject
+				{ "append", [](Array& self, std::span<LeObject>& args, class VirtualMachine&) -> LeObject
 					{
-						self.data.append_range(args);
+						for (const auto& arg : args)
+							self.data.push_back(MemoryManager::promote(arg));
 						return self.data.back();
 					}
-				);
-			}
-			if (member == "size")
-			{
-				return global::mem->emplace<MemberFunction<Array>>(self,
-					[](Array& self, std::span<LeObject>& args, struct VirtualMachine&)->LeObject
+				},
+				{ "size", [](Array& self, std::span<LeObject>& args, class VirtualMachine&) -> LeObject
 					{
-						return global::mem->emplace<NumberValue>(static_cast<double>(self.data.size()));
+						return NumberValue::make_number_val(static_cast<Number>(self.data.size()));
 					}
-				);
-			}
+				},
+			};
+			return table;
+		}
+
+		auto member_access(LeObject self, const String& member) -> LeObject override
+		{
+			if (auto slot = member_slot(member); slot != no_slot)
+				return member_at(self, slot);
 			throw(ferr::invalid_member(String(member)));
 		}
 
+		auto member_layout() const -> u64 override { return layout; }
+		auto member_slot(const String& member) -> u32 override { return find_method(methods(), member); }
+
+		auto member_at(LeObject self, u32 slot) -> LeObject override
+		{
+			return global::mem->emplace_temporary<MemberFunction<Array>>(self, methods()[slot].function);
+		}
+
+		auto call_member(LeObject self, u32 slot, std::span<LeObject>& args, class VirtualMachine& vm) -> LeObject override
+		{
+			return methods()[slot].function(*this, args, vm);
+		}
+
 		auto at(size_t idx) -> LeObject&
 		{
 			if (idx >= data.size())
@@ -86,8 +121,8 @@ namespace le
 
 		auto access_assign(LeObject index, LeObject rhs) -> LeObject override
 		{
-			auto idx = to_numeric_index(*index);
-			return (at(idx) = rhs);
+			auto idx = to_numeric_index(index);
+			return (at(idx) = MemoryManager::promote(rhs));
 		}
 
 		auto iterator(LeObject self) -> LeObject override
@@ -23,9 +23,10 @@ namespace le
 			return "False";
 		}
 
+		/* Booleans are immediates, this never allocates */
 		static auto make_bool(bool val) -> LeObject
 		{
-			return global::mem->emplace<Boolean>(val);
+			return LeObject::from_bool(val);
 		}
 
 		auto to_native_bool() const -> bool override
@@ -40,7 +41,7 @@ namespace le
 		{
 			if (op == Token::Type::OperatorNot)
 			{
-				return global::mem->emplace<Boolean>(not val);
+				return make_bool(not val);
 			}
 			throw(ferr::invalid_operation(op, "boolean"));
 			return LeObject{};
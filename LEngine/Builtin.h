@@ -2,24 +2,49 @@
 
 #include "common.h"
 #include "format_errs.h"
+#include "Value.h"
 
 #include <span>
+#include <limits>
 
 namespace le
 {
+	/* Hands out the ids of member layouts, see RuntimeValue::member_layout. Ids are never reused */
+	inline auto next_layout_id() -> u64
+	{
+		static auto id = u64{};
+		return ++id;
+	}
+
 	struct RuntimeValue
 	{
-		using LeObject = std::shared_ptr<RuntimeValue>;
+		using LeObject = Value;
+		static constexpr auto no_slot = std::numeric_limits<u32>::max();
 
 		/*
 		* An identifier for important builtin types. Custom types can only be interfaced by their virtual functions.
 		*/
-		enum class Type
+		enum class Type : u8
 		{
-			Null, NumericLiteral, Variable, String, Function, Boolean, Module, Iterator, Class, Custom
+			Null, NumericLiteral, Variable, String, Function, Boolean, Module, Iterator, Class, Method, Array, Range, Custom
 		};
 
 		Type type{};
+		/* Collector state, unused unless LE_TRACING_GC is set. Permanent objects are never collected, see Collector */
+		u8 marked : 1 {};
+		u8 permanent : 1 {};
+		u8 tracked : 1 {}; /* The collector holds a reference */
+		/* Cycle collector state, only used with reference counting. See CycleCollector */
+		u8 color : 2 {};
+		u8 buffered : 1 {}; /* A candidate root of a garbage cycle */
+		/* Number of Values and Refs referencing this object, it is destroyed when this drops to zero. Not atomic, see Ref */
+		mutable u32 refs{};
+
+		RuntimeValue() = default;
+		/* Copies are new objects, nothing references them yet */
+		RuntimeValue(const RuntimeValue& other) : type(other.type) {}
+		auto operator=(const RuntimeValue& other) -> RuntimeValue& { type = other.type; return *this; }
+		virtual ~RuntimeValue() = default;
 
 		/* Declared as friend to place it within global namespace and also be able to use the function here */
 		friend inline auto to_string(RuntimeValue::Type type) -> String
@@ -40,6 +65,16 @@ namespace le
 				return "Boolean";
 			case RuntimeValue::Type::Module:
 				return "Module";
+			case RuntimeValue::Type::Iterator:
+				return "Iterator";
+			case RuntimeValue::Type::Class:
+				return "Class";
+			case RuntimeValue::Type::Method:
+				return "Method";
+			case RuntimeValue::Type::Array:
+				return "Array";
+			case RuntimeValue::Type::Range:
+				return "Range";
 			case RuntimeValue::Type::Custom:
 				return "Custom";
 			default:
@@ -113,18 +148,174 @@ namespace le
 			return LeObject{};
 		}
 
+		/*
+		* Inline cache support for expr.identifier, see MemberCache.
+		* Objects keeping their members at fixed slots return the id of their layout, objects sharing an id must resolve a name to the same slot.
+		* 0 means the members can not be cached and every access goes through member_access.
+		*/
+		virtual auto member_layout() const -> u64 { return 0; }
+
+		/* @return Slot of member in the current layout, no_slot if there is none */
+		virtual auto member_slot(const String& member) -> u32 { return no_slot; }
+
+		/* Loads the member at a slot handed out by member_slot */
+		virtual auto member_at(LeObject self, u32 slot) -> LeObject
+		{
+			throw(ferr::make_exception(std::format("{} has no member slots", to_string(type))));
+			return LeObject{};
+		}
+
+		/* Implements self.member(args) for a slot handed out by member_slot, builtin methods are called without binding them to self first */
+		virtual auto call_member(LeObject self, u32 slot, std::span<LeObject>& args, class VirtualMachine& vm) -> LeObject
+		{
+			return member_at(self, slot)->call(args, vm);
+		}
+
 		virtual auto iterator(LeObject self) -> LeObject
 		{
 			throw(ferr::make_exception(std::format("{} does not have an iterator", to_string(type))));
 			return LeObject{};
 		}
+
+		/* Marks the objects referenced by this one, every object holding Values has to override it. See Collector */
+		virtual auto trace(class Tracer& tracer) -> void {}
+
+		/* Lets go of every Value held, the cycle collector breaks garbage cycles with it. Overridden along with trace */
+		virtual auto clear_references() -> void {}
+
+		/* Moves contents allocated through Allocator out of pools being emptied, see MemoryManager::compact and le::relocate */
+		virtual auto relocate() -> void {}
+
+		/* @return A copy made by MemoryManager::emplace, the types made by MemoryManager::emplace_temporary override it. See MemoryManager::promote */
+		virtual auto promote() const -> LeObject
+		{
+			throw(ferr::make_exception(std::format("{} can not be moved out of the nursery", to_string(type))));
+			return LeObject{};
+		}
 	};
 
 	using LeObject = RuntimeValue::LeObject;
+
+	/*
+	* Destroys an object made by a MemoryManager and frees its memory, defined in MemoryManager.cpp.
+	* The memory of an object the cycle collector buffered is freed by the cycle collector instead, see release_memory.
+	*/
+	auto destroy(RuntimeValue* object) -> void;
+	/* Frees the memory an object was destroyed in while the cycle collector buffered it, defined in MemoryManager.cpp */
+	auto release_memory(RuntimeValue* object) -> void;
+	/* Hands object to the cycle collector of global::mem as a candidate root, defined in GlobalState.cpp */
+	auto possible_cycle(RuntimeValue* object) -> void;
+
+	/* @return Whether objects of type can be part of a cycle, the ones holding more than a single Value. See CycleCollector */
+	inline constexpr auto may_cycle(RuntimeValue::Type type) -> bool
+	{
+		using Type = RuntimeValue::Type;
+		return type == Type::Array or type == Type::Class or type == Type::Function;
+	}
+
+	inline auto retain_object(RuntimeValue* object) -> void
+	{
+		object->refs++;
+	}
+
+	/* An object that survives losing a reference may have been kept alive by a cycle only, the cycle collector checks it later */
+	inline auto release_object(RuntimeValue* object) -> void
+	{
+		if (--object->refs == 0)
+			destroy(object);
+		else if constexpr (not LE_TRACING_GC)
+		{
+			if (may_cycle(object->type) and not object->buffered)
+				possible_cycle(object);
+		}
+	}
+
+	/*
+	* Owning pointer to an object made by a MemoryManager, the count is kept in the object itself (see RuntimeValue::refs).
+	* Objects belong to the thread running them so counting is not atomic.
+	*/
+	template<typename _T>
+	class Ref
+	{
+		template<typename> friend class Ref;
+		_T* _ptr{};
+	public:
+		Ref() = default;
+		Ref(std::nullptr_t) {}
+		explicit Ref(_T* ptr) : _ptr(ptr) { if (_ptr) retain_object(_ptr); }
+
+		Ref(const Ref& other) : Ref(other._ptr) {}
+		Ref(Ref&& other) noexcept : _ptr(std::exchange(other._ptr, nullptr)) {}
+
+		template<typename _U>
+			requires std::convertible_to<_U*, _T*>
+		Ref(const Ref<_U>& other) : Ref(static_cast<_T*>(other._ptr)) {}
+
+		template<typename _U>
+			requires std::convertible_to<_U*, _T*>
+		Ref(Ref<_U>&& other) noexcept : _ptr(std::exchange(other._ptr, nullptr)) {}
+
+		auto operator=(Ref other) noexcept -> Ref&
+		{
+			std::swap(_ptr, other._ptr);
+			return *this;
+		}
+
+		~Ref() { if (_ptr) release_object(_ptr); }
+
+		auto get() const -> _T* { return _ptr; }
+		auto operator->() const -> _T* { return _ptr; }
+		auto operator*() const -> _T& { return *_ptr; }
+		explicit operator bool() const { return _ptr != nullptr; }
+
+		auto reset() -> void { Ref().swap(*this); }
+		auto swap(Ref& other) noexcept -> void { std::swap(_ptr, other._ptr); }
+
+		/* Gives up the pointer without letting go of its reference, the caller takes it over */
+		auto detach() -> _T* { return std::exchange(_ptr, nullptr); }
+	};
+
+#if LE_TRACING_GC
+	/* Values don't own anything, the collector does */
+	inline auto Value::retain() const -> void {}
+	inline auto Value::release() const -> void {}
+	/* Value::pin is defined in GlobalState.cpp, it hands the object to the collector of global::mem */
+#else
+	inline auto Value::retain() const -> void
+	{
+		retain_object(object());
+	}
+
+	inline auto Value::release() const -> void
+	{
+		release_object(object());
+	}
+
+	inline auto Value::pin(RuntimeValue* object) -> void
+	{
+		_bits = reinterpret_cast<u64>(object) | tag_object;
+	}
+#endif
+
+	inline auto Value::type() const
+	{
+		if (is_object()) return object()->type;
+		if (is_number()) return RuntimeValue::Type::NumericLiteral;
+		if (is_bool()) return RuntimeValue::Type::Boolean;
+		return RuntimeValue::Type::Null;
+	}
+
+	inline auto Value::to_native_bool() const -> bool
+	{
+		if (is_number()) return as_number() != 0.0;
+		if (is_object()) return object()->to_native_bool();
+		return _bits == tag_true;
+	}
+
 	/*
 	* Any imported function is expected to have the following interface.
 	* The first param is a span of args with the second being a reference to the current memory manager.
-	* Do not use this interface outside of C++ to keep integrity of shared ptr's.
+	* Do not use this interface outside of C++ to keep integrity of the reference counts.
 	*/
 	using FFI_FUNC = LeObject(*)(std::span<LeObject>, class MemoryManager&);
 }
@@ -6,6 +6,7 @@ namespace le
 	auto to_string(const Code& code) -> String
 	{
 		auto string = to_string(code.code, code);
+		string += std::format("Dead code removed {} instructions, peephole removed {} instructions, typed {} operators\n", code.dead_code_removed, code.peephole_removed, code.typed);
 		string += "\nGlobals:\n";
 		for (auto count{ 0ull }; const auto & global : code.globals)
 		{
@@ -15,7 +16,8 @@ namespace le
 			case RuntimeValue::Type::Function:
 			{
 				const auto& function = static_cast<const CompiledFunction*>(global.get())->function_frame;
-				string += std::format("(Function: '{}')\n{}\n", function.name, to_string(function, code));
+				string += std::format("(Function: '{}', dead code removed {} instructions, peephole removed {} instructions, typed {} operators)\n{}\n"
+					, function.name, function.dead_code_removed, function.peephole_removed, function.typed, to_string(function, code));
 				break;
 			}
 			default:
@@ -4,6 +4,9 @@
 #include "VarMap.h"
 #include "Builtin.h"
 
+#include <unordered_map>
+#include <unordered_set>
+
 namespace le
 {
 	enum class OpCode
@@ -24,12 +27,12 @@ namespace le
 
 		MakeArray, /* Operand denotes amount of values */
 		PushNull, /* Push null onto stack */
-		MakeMember, /* Implements tos->make_member(tos, tos2, tos3) where tos->type == Type::Class */
+		MakeMember, /* Implements tos->make_member(tos, member, tos2) where tos->type == Type::Class, operand is the index of the MemberCache holding the member */
 		PushEmptyClass, /* Pushes an empty class object to tos */
 
 		/* For loop and iterators */
-		GetIter, /* calls TOS->iterator(self) */
-		ForLoop, /* increment iterator on TOS and jump delta of operand if TOS->function_next() returns nullptr */
+		GetIter, /* Pops the iterable into the loop state at local operand, see VirtualMachine::for_prepare */
+		ForLoop, /* Pushes the next value of the loop state at local operand.loop.state or jumps operand.loop.delta once exhausted */
 
 		/* Store */
 		Store, /* Will store TOS at index of operand */
@@ -42,11 +45,12 @@ namespace le
 		/* Subscripts */
 		Access, /* Implements 'expr[expr]' Will attempt to access TOS with second to TOS */
 		AccessAssign, /* Implements 'expr[expr] = expr' Target TOS, Query second to TOS, RHS third to TOS */
-		AccessMember, /* Implements 'expr.expr' Will attempt to access TOS with second to TOS */
+		AccessMember, /* Implements 'expr.identifier' on TOS, operand is the index of the MemberCache holding the identifier */
 
 		/* Calling */
 		Call, /* Implements 'expr()' , operand is number of args on stack */
 		CallFunction, /* [DEPRECATED] Implements calling a builtin function, operand is number of args on stack */
+		CallMethod, /* Implements 'expr.identifier()' without making a bound member, the receiver sits below the args. Operand is operand.method */
 
 		/* Controlflow */
 		ReturnExpr, /* Implements 'return expr' Exits current function and pushes result of expr to stack of old scope */
@@ -73,8 +77,99 @@ namespace le
 		LET,
 		EQ,
 		NEQ,
+
+		/* Fused relational operator and JumpIfFalse, pops lhs and rhs and jumps with the operand's delta if the relation does not hold */
+		JumpIfNotGT,
+		JumpIfNotGET,
+		JumpIfNotLT,
+		JumpIfNotLET,
+		JumpIfNotEQ,
+		JumpIfNotNEQ,
+
+		/*
+		* Superinstructions, made by fuse_superinstructions (Superinstructions.h) out of the sequences the OpcodeProfiler finds most.
+		* A superinstruction replaces the first instruction of its sequence, the rest of the sequence is left in place
+		* to hold the operands and is skipped over, so jump deltas stay valid. 'op' is Add, Mul, Div or Sub.
+		*/
+		LoadLoad, /* Load; Load */
+		LoadLoadOp, /* Load; Load; op */
+		LoadRealOp, /* Load; PushReal; op */
+		LoadRealOpStore, /* Load; PushReal; op; Store */
+		LoadRealJumpIfNot, /* Load; PushReal; JumpIfNotGT to JumpIfNotNEQ */
+		OpStore, /* op; Store, operand holds the opcode of op */
+
+		/*
+		* Typed operators, given by specialize_numbers (TypeInference.h) to the operators it proved only ever see two numbers.
+		* They work on the numbers straight away, without the type checks and apply_operation of the operators they replace.
+		* Follow the order of the operators they replace.
+		*/
+		AddNum,
+		MulNum,
+		DivNum,
+		SubNum,
+		GTNum,
+		GETNum,
+		LTNum,
+		LETNum,
+		EQNum,
+		NEQNum,
+		JumpIfNotGTNum,
+		JumpIfNotGETNum,
+		JumpIfNotLTNum,
+		JumpIfNotLETNum,
+		JumpIfNotEQNum,
+		JumpIfNotNEQNum,
+		GuardNumbers, /* Jumps operand.guard.delta unless every local set in operand.guard.mask holds a number */
+
+		/*
+		* Register backend, only executed by the RegisterVirtualMachine.
+		* Operands are frame registers in operand.reg, a is the destination unless stated otherwise.
+		* Besides these, register code uses Halt, Noop, Jump and Return.
+		*/
+		RegMove, /* a = b */
+		RegLoadConst, /* a = globals[c], globals of the Code object */
+		RegLoadNull, /* a = null */
+		RegLoadGlobal, /* a = global variable c */
+		RegStoreGlobal, /* global variable c = a */
+
+		RegAdd, /* a = b + c */
+		RegMul, /* a = b * c */
+		RegDiv, /* a = b / c */
+		RegSub, /* a = b - c */
+		RegGT, /* a = b > c */
+		RegGET, /* a = b >= c */
+		RegLT, /* a = b < c */
+		RegLET, /* a = b <= c */
+		RegEQ, /* a = b == c */
+		RegNEQ, /* a = b != c */
+		RegUnaryOp, /* a = op b, c is the i32 encoded operator type */
+
+		RegJumpIfFalse, /* Jump delta c if a is false */
+		RegJumpIfNotGT, /* Jump delta c if not a > b */
+		RegJumpIfNotGET, /* Jump delta c if not a >= b */
+		RegJumpIfNotLT, /* Jump delta c if not a < b */
+		RegJumpIfNotLET, /* Jump delta c if not a <= b */
+		RegJumpIfNotEQ, /* Jump delta c if not a == b */
+		RegJumpIfNotNEQ, /* Jump delta c if not a != b */
+
+		RegCall, /* a = b(b + 1, ..., b + c) */
+		RegCallMethod, /* a = b.identifier(b + 1, ..., b + argc), c packs the MemberCache index and argc, see method_operand */
+		RegReturn, /* Exits current function returning a */
+
+		RegAccess, /* a = b[c] */
+		RegAccessAssign, /* a[b] = c */
+		RegAccessMember, /* a = b.identifier, c is the index of the MemberCache holding the identifier */
+		RegMakeArray, /* a = [b, ..., b + c - 1] */
+		RegNewClass, /* a = empty class */
+		RegMakeMember, /* Member of class a = b, c is the index of the MemberCache holding the member */
+		RegGetIter, /* Loop state a, a + 1 = iterable b, see VirtualMachine::for_prepare */
+		RegForLoop, /* a = next value of loop state b, clears b and jumps delta c once exhausted */
+		RegImportDll, /* a = dll module at path b */
 	};
 
+	/* Keep in sync with the last opcode */
+	inline constexpr auto opcode_count = static_cast<size_t>(OpCode::RegImportDll) + 1;
+
 #define LE_TO_STR(code) case OpCode::##code: return #code
 	inline auto to_string(OpCode op) -> StringView
 	{
@@ -100,6 +195,39 @@ namespace le
 			LE_TO_STR(GetIter); LE_TO_STR(ForLoop);
 			LE_TO_STR(DupTos); LE_TO_STR(PushNull);
 			LE_TO_STR(MakeMember); LE_TO_STR(PushEmptyClass);
+			LE_TO_STR(JumpIfNotGT); LE_TO_STR(JumpIfNotGET);
+			LE_TO_STR(JumpIfNotLT); LE_TO_STR(JumpIfNotLET);
+			LE_TO_STR(JumpIfNotEQ); LE_TO_STR(JumpIfNotNEQ);
+			LE_TO_STR(LoadLoad); LE_TO_STR(LoadLoadOp);
+			LE_TO_STR(LoadRealOp); LE_TO_STR(LoadRealOpStore);
+			LE_TO_STR(LoadRealJumpIfNot); LE_TO_STR(OpStore);
+			LE_TO_STR(AddNum); LE_TO_STR(MulNum);
+			LE_TO_STR(DivNum); LE_TO_STR(SubNum);
+			LE_TO_STR(GTNum); LE_TO_STR(GETNum);
+			LE_TO_STR(LTNum); LE_TO_STR(LETNum);
+			LE_TO_STR(EQNum); LE_TO_STR(NEQNum);
+			LE_TO_STR(JumpIfNotGTNum); LE_TO_STR(JumpIfNotGETNum);
+			LE_TO_STR(JumpIfNotLTNum); LE_TO_STR(JumpIfNotLETNum);
+			LE_TO_STR(JumpIfNotEQNum); LE_TO_STR(JumpIfNotNEQNum);
+			LE_TO_STR(GuardNumbers);
+			LE_TO_STR(RegMove); LE_TO_STR(RegLoadConst);
+			LE_TO_STR(RegLoadNull); LE_TO_STR(RegLoadGlobal);
+			LE_TO_STR(RegStoreGlobal); LE_TO_STR(RegAdd);
+			LE_TO_STR(RegMul); LE_TO_STR(RegDiv);
+			LE_TO_STR(RegSub); LE_TO_STR(RegGT);
+			LE_TO_STR(RegGET); LE_TO_STR(RegLT);
+			LE_TO_STR(RegLET); LE_TO_STR(RegEQ);
+			LE_TO_STR(RegNEQ); LE_TO_STR(RegUnaryOp);
+			LE_TO_STR(RegJumpIfFalse); LE_TO_STR(RegJumpIfNotGT);
+			LE_TO_STR(RegJumpIfNotGET); LE_TO_STR(RegJumpIfNotLT);
+			LE_TO_STR(RegJumpIfNotLET); LE_TO_STR(RegJumpIfNotEQ);
+			LE_TO_STR(RegJumpIfNotNEQ); LE_TO_STR(RegCall);
+			LE_TO_STR(CallMethod); LE_TO_STR(RegCallMethod);
+			LE_TO_STR(RegReturn); LE_TO_STR(RegAccess);
+			LE_TO_STR(RegAccessAssign); LE_TO_STR(RegAccessMember);
+			LE_TO_STR(RegMakeArray); LE_TO_STR(RegNewClass);
+			LE_TO_STR(RegMakeMember); LE_TO_STR(RegGetIter);
+			LE_TO_STR(RegForLoop); LE_TO_STR(RegImportDll);
 		}
 		return "Unknown opcode";
 	}
@@ -109,16 +237,16 @@ namespace le
 	{
 		switch (op)
 		{
-		case OpCode::Add: return Token::Type::OperatorPlus;
-		case OpCode::Mul: return Token::Type::OperatorMultiply;
-		case OpCode::Div: return Token::Type::OperatorDivide;
-		case OpCode::Sub: return Token::Type::OperatorMinus;
-		case OpCode::GT: return Token::Type::OperatorGT;
-		case OpCode::GET: return Token::Type::OperatorGET;
-		case OpCode::LT: return Token::Type::OperatorLT;
-		case OpCode::LET: return Token::Type::OperatorLET;
-		case OpCode::EQ: return Token::Type::OperatorEq;
-		case OpCode::NEQ: return Token::Type::OperatorNEq;
+		case OpCode::Add: case OpCode::AddNum: case OpCode::RegAdd: return Token::Type::OperatorPlus;
+		case OpCode::Mul: case OpCode::MulNum: case OpCode::RegMul: return Token::Type::OperatorMultiply;
+		case OpCode::Div: case OpCode::DivNum: case OpCode::RegDiv: return Token::Type::OperatorDivide;
+		case OpCode::Sub: case OpCode::SubNum: case OpCode::RegSub: return Token::Type::OperatorMinus;
+		case OpCode::GT: case OpCode::GTNum: case OpCode::JumpIfNotGT: case OpCode::JumpIfNotGTNum: case OpCode::RegGT: case OpCode::RegJumpIfNotGT: return Token::Type::OperatorGT;
+		case OpCode::GET: case OpCode::GETNum: case OpCode::JumpIfNotGET: case OpCode::JumpIfNotGETNum: case OpCode::RegGET: case OpCode::RegJumpIfNotGET: return Token::Type::OperatorGET;
+		case OpCode::LT: case OpCode::LTNum: case OpCode::JumpIfNotLT: case OpCode::JumpIfNotLTNum: case OpCode::RegLT: case OpCode::RegJumpIfNotLT: return Token::Type::OperatorLT;
+		case OpCode::LET: case OpCode::LETNum: case OpCode::JumpIfNotLET: case OpCode::JumpIfNotLETNum: case OpCode::RegLET: case OpCode::RegJumpIfNotLET: return Token::Type::OperatorLET;
+		case OpCode::EQ: case OpCode::EQNum: case OpCode::JumpIfNotEQ: case OpCode::JumpIfNotEQNum: case OpCode::RegEQ: case OpCode::RegJumpIfNotEQ: return Token::Type::OperatorEq;
+		case OpCode::NEQ: case OpCode::NEQNum: case OpCode::JumpIfNotNEQ: case OpCode::JumpIfNotNEQNum: case OpCode::RegNEQ: case OpCode::RegJumpIfNotNEQ: return Token::Type::OperatorNEq;
 		default:
 			throw(ferr::make_exception("Cannot convert opcode to token type"));
 		}
@@ -142,6 +270,12 @@ namespace le
 		{
 			operand.real = real;
 		};
+		/* Register form */
+		Instruction(OpCode op_, u16 a, u16 b, i32 c = 0)
+			: op(op_)
+		{
+			operand.reg = { a, b, c };
+		}
 
 		OpCode op{};
 		/* OpCode will identify what the underlying value is */
@@ -149,8 +283,21 @@ namespace le
 			u64 uinteger;
 			i64 integer;
 			double real;
+			struct { u16 a; u16 b; i32 c; } reg;
+			struct { u32 cache; u32 argc; } method;
+			struct { u32 state; i32 delta; } loop;
+			struct { u32 mask; i32 delta; } guard;
 		} operand{ 0ull };
 	};
+
+	/* Register operands only have room for one of these, RegCallMethod packs the argument count in the low bits of c */
+	inline constexpr auto method_argc_bits = 8;
+	inline constexpr auto method_max_argc = (1u << method_argc_bits) - 1u;
+	inline constexpr auto method_max_cache = (1u << (31 - method_argc_bits)) - 1u;
+
+	inline constexpr auto method_operand(u32 cache, u32 argc) -> i32 { return static_cast<i32>(cache << method_argc_bits | argc); }
+	inline constexpr auto method_cache(i32 operand) -> u32 { return static_cast<u32>(operand) >> method_argc_bits; }
+	inline constexpr auto method_argc(i32 operand) -> u32 { return static_cast<u32>(operand) & method_max_argc; }
 	//constexpr auto instruction__size = sizeof(Instruction);
 
 	/* Sequence of instructions */
@@ -164,8 +311,30 @@ namespace le
 		ByteCode code{};
 		String name{};
 		u64 argc{};
+		u64 registers{}; /* Register count of register bytecode, unused by the stack backend */
+		u64 locals{}; /* Local variable slots including 'this' and the arguments, unused by the register backend */
+		u64 dead_code_removed{}; /* Instructions dropped by eliminate_dead_code */
+		u64 peephole_removed{}; /* Instructions dropped by optimize_peephole */
+		u64 typed{}; /* Operators given a typed opcode by specialize_numbers */
 	};
 	constexpr auto size__frame = sizeof(Frame);
+
+	struct Shape;
+
+	/*
+	* Inline cache of a single 'expr.identifier' site.
+	* Receivers that keep their members at fixed slots (see RuntimeValue::member_layout) are looked up by name once,
+	* while following receivers share that layout the site loads the slot straight away.
+	*/
+	struct MemberCache
+	{
+		String name{};
+		u64 layout{}; /* Layout the slot was resolved for, 0 while the site has not seen a cacheable receiver */
+		u32 slot{};
+		Shape* transition{}; /* MakeMember sites: shape an instance of layout moves to */
+		LeObject method{}; /* MakeMember sites: the Method shared by every instance made here */
+	};
+
 	/*
 	* make a load global type to load from global space,
 	*/
@@ -175,6 +344,38 @@ namespace le
 
 		ByteCode code{};
 		Globals globals{};
+		u64 registers{}; /* Register count of register bytecode, unused by the stack backend */
+		u64 locals{}; /* Local variable slots of the top level code, unused by the register backend */
+		std::vector<MemberCache> member_caches{}; /* One per member access instruction, filled in at runtime */
+		/* Instructions of the top level code dropped by eliminate_dead_code and optimize_peephole, functions count their own in their Frame */
+		u64 dead_code_removed{};
+		u64 peephole_removed{};
+		u64 typed{}; /* Operators of the top level code given a typed opcode by specialize_numbers */
+	};
+
+	/* A function calls to are replaced with its body, see inline_function */
+	struct InlineFunction
+	{
+		ByteCode code{}; /* Made by inlinable_body */
+		u64 argc{};
+		u64 locals{}; /* Local variable slots including the arguments */
+	};
+
+	/* Which passes the compilers run, everything is on by default. The register compiler only uses constant_folding, dead_code and peephole */
+	struct CompilerOptions
+	{
+		/* Fold the AST before compiling it, see ConstantFolder */
+		bool constant_folding{ true };
+		/* Rewrite stack bytecode with superinstructions, off when profiling which sequences to fuse */
+		bool superinstructions{ true };
+		/* Drop the unreachable bytecode of every function with eliminate_dead_code */
+		bool dead_code{ true };
+		/* Clean up the bytecode of every function with optimize_peephole */
+		bool peephole{ true };
+		/* Give the number operators of stack bytecode typed opcodes with specialize_numbers */
+		bool type_inference{ true };
+		/* Replace calls to small top level functions with their body, see inlinable_body */
+		bool inlining{ true };
 	};
 
 	struct CompilerContext
@@ -185,6 +386,14 @@ namespace le
 		VarMap global_strings{};
 		/* Namespace name, currently used for communicating currently compiling class */
 		StringView namespace_name{};
+		/* Passes to run, see CompilerOptions */
+		CompilerOptions options{};
+		/* Most instructions a function may have to be inlined */
+		u64 inline_budget{ 24 };
+		/* Top level functions never assigned to, the ones that may be inlined */
+		std::unordered_set<Symbol> inline_names{};
+		/* Bodies of the functions that are inlined, by the global they are stored in */
+		std::unordered_map<size_t, InlineFunction> inline_functions{};
 	};
 
 	constexpr auto size__code = sizeof(Code);
@@ -197,15 +406,57 @@ namespace le
 			/* Op codes loading an index */
 		case OpCode::Load: case OpCode::Store: case OpCode::MakeArray: 
 		case OpCode::Call: case OpCode::CallFunction: case OpCode::StoreGlobal:
-		case OpCode::LoadGlobal:
+		case OpCode::LoadGlobal: case OpCode::LoadLoad: case OpCode::LoadLoadOp: case OpCode::GetIter:
+		case OpCode::LoadRealOp: case OpCode::LoadRealOpStore: case OpCode::LoadRealJumpIfNot:
 			string += std::to_string(i.operand.uinteger); break;
+		case OpCode::ForLoop:
+			string += std::format("{} {} -> {}", i.operand.loop.state, i.operand.loop.delta, count + i.operand.loop.delta); break;
+		case OpCode::OpStore:
+			string += to_string(static_cast<OpCode>(i.operand.uinteger)); break;
 			/* Jumps */
-		case OpCode::Jump: case OpCode::JumpIfTrue: case OpCode::JumpIfFalse: case OpCode::ForLoop:
+		case OpCode::Jump: case OpCode::JumpIfTrue: case OpCode::JumpIfFalse:
+		case OpCode::JumpIfNotGT: case OpCode::JumpIfNotGET: case OpCode::JumpIfNotLT:
+		case OpCode::JumpIfNotLET: case OpCode::JumpIfNotEQ: case OpCode::JumpIfNotNEQ:
+		case OpCode::JumpIfNotGTNum: case OpCode::JumpIfNotGETNum: case OpCode::JumpIfNotLTNum:
+		case OpCode::JumpIfNotLETNum: case OpCode::JumpIfNotEQNum: case OpCode::JumpIfNotNEQNum:
 			string += std::format("{} -> {}", i.operand.integer, count + i.operand.integer); break;
+		case OpCode::GuardNumbers:
+			string += std::format("{:#b} {} -> {}", i.operand.guard.mask, i.operand.guard.delta, count + i.operand.guard.delta); break;
 			/* Push Builtin types */
 		case OpCode::PushReal: string += std::to_string(i.operand.real); break;
 		case OpCode::PushGlobal: case OpCode::PushString: case OpCode::PushFunction: /* Globals */
 			string += std::format("{} ({})", i.operand.uinteger, code.globals.at(i.operand.uinteger)->make_string()); break;
+			/* Register backend */
+		case OpCode::AccessMember: case OpCode::MakeMember:
+			string += std::format("{} ({})", i.operand.uinteger, code.member_caches.at(i.operand.uinteger).name); break;
+		case OpCode::RegAccessMember:
+			string += std::format("r{} r{} {} ({})", i.operand.reg.a, i.operand.reg.b, i.operand.reg.c, code.member_caches.at(i.operand.reg.c).name); break;
+		case OpCode::CallMethod:
+			string += std::format("{} ({}) {}", i.operand.method.cache, code.member_caches.at(i.operand.method.cache).name, i.operand.method.argc); break;
+		case OpCode::RegCallMethod:
+			string += std::format("r{} r{} {} ({}) {}", i.operand.reg.a, i.operand.reg.b, method_cache(i.operand.reg.c)
+				, code.member_caches.at(method_cache(i.operand.reg.c)).name, method_argc(i.operand.reg.c)); break;
+		case OpCode::RegLoadConst:
+			string += std::format("r{} {} ({})", i.operand.reg.a, i.operand.reg.c, code.globals.at(i.operand.reg.c)->make_string()); break;
+		case OpCode::RegMakeMember:
+			string += std::format("r{} r{} {} ({})", i.operand.reg.a, i.operand.reg.b, i.operand.reg.c, code.member_caches.at(i.operand.reg.c).name); break;
+		case OpCode::RegLoadNull: case OpCode::RegReturn: case OpCode::RegNewClass:
+			string += std::format("r{}", i.operand.reg.a); break;
+		case OpCode::RegLoadGlobal: case OpCode::RegStoreGlobal:
+			string += std::format("r{} {}", i.operand.reg.a, i.operand.reg.c); break;
+		case OpCode::RegMove: case OpCode::RegGetIter: case OpCode::RegImportDll:
+			string += std::format("r{} r{}", i.operand.reg.a, i.operand.reg.b); break;
+		case OpCode::RegUnaryOp: case OpCode::RegCall: case OpCode::RegMakeArray:
+			string += std::format("r{} r{} {}", i.operand.reg.a, i.operand.reg.b, i.operand.reg.c); break;
+		case OpCode::RegJumpIfFalse:
+			string += std::format("r{} {} -> {}", i.operand.reg.a, i.operand.reg.c, count + i.operand.reg.c); break;
+		case OpCode::RegJumpIfNotGT: case OpCode::RegJumpIfNotGET: case OpCode::RegJumpIfNotLT:
+		case OpCode::RegJumpIfNotLET: case OpCode::RegJumpIfNotEQ: case OpCode::RegJumpIfNotNEQ: case OpCode::RegForLoop:
+			string += std::format("r{} r{} {} -> {}", i.operand.reg.a, i.operand.reg.b, i.operand.reg.c, count + i.operand.reg.c); break;
+		case OpCode::RegAdd: case OpCode::RegMul: case OpCode::RegDiv: case OpCode::RegSub:
+		case OpCode::RegGT: case OpCode::RegGET: case OpCode::RegLT: case OpCode::RegLET: case OpCode::RegEQ: case OpCode::RegNEQ:
+		case OpCode::RegAccess: case OpCode::RegAccessAssign:
+			string += std::format("r{} r{} r{}", i.operand.reg.a, i.operand.reg.b, i.operand.reg.c); break;
 		}
 		return string;
 	}
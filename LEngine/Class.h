@@ -4,6 +4,7 @@
 #include "Function.h"
 #include "getters.h"
 #include "MemberFunctions.h"
+#include "Allocator.h"
 
 #include <vector>
 #include <span>
@@ -13,34 +14,152 @@ namespace le
 {
 	// class VirtualMachine;
 
+	/*
+	* Hidden class shared by every Class instance that made the same members in the same order.
+	* A shape maps member names to slots, instances only hold a pointer to their shape and the values in a slot vector.
+	* Making a member moves an instance to the child shape for that member, creating it the first time.
+	* Shapes are never freed, so their ids and addresses can be kept in inline caches.
+	*/
+	struct Shape
+	{
+		Shape() = default;
+		Shape(const Shape&) = delete;
+		auto operator=(const Shape&) = delete;
+
+		u64 id{ next_layout_id() };
+		std::unordered_map<String, u32> slots{};
+		u32 size{}; /* Slots of an instance of this shape */
+		u32 largest_size{}; /* Largest size among this shape and its descendants, instances reserve this many slots up front */
+		Shape* parent{};
+		std::unordered_map<String, std::unique_ptr<Shape>> transitions{};
+
+		/* Shape of an instance without members */
+		static auto root() -> Shape&
+		{
+			static auto shape = Shape{};
+			return shape;
+		}
+
+		/* @return Slot of member, RuntimeValue::no_slot if this shape does not have it */
+		auto slot(const String& member) const -> u32
+		{
+			if (auto res = slots.find(member); res != slots.end())
+				return res->second;
+			return RuntimeValue::no_slot;
+		}
+
+		/* @return The shape of an instance of this shape after making member */
+		auto transition(const String& member) -> Shape*
+		{
+			if (auto res = transitions.find(member); res != transitions.end())
+				return res->second.get();
+
+			auto child = std::make_unique<Shape>();
+			child->slots = slots;
+			child->slots.insert(std::pair{ member, size });
+			child->size = size + 1;
+			child->largest_size = child->size;
+			child->parent = this;
+			for (auto shape{ this }; shape and shape->largest_size < child->size; shape = shape->parent)
+				shape->largest_size = child->size;
+
+			return transitions.insert(std::pair{ member, std::move(child) }).first->second.get();
+		}
+	};
+
+	/*
+	* A function made a member in a class body.
+	* Every instance made by the same MakeMember site shares one Method instead of holding a bound member of its own.
+	* Reading it binds it to the instance, calling it through CallMethod enters it with the instance as 'this' directly.
+	*/
+	struct Method
+		: RuntimeValue
+	{
+		explicit Method(LeObject function_)
+			: function(std::move(function_))
+		{ type = Type::Method; }
+
+		LeObject function{}; /* The CompiledFunction */
+
+		auto frame() const -> const Frame& { return static_cast<CompiledFunction*>(function.get())->function_frame; }
+
+		auto type_name() -> String override
+		{
+			return "Method";
+		}
+
+		auto trace(Tracer& tracer) -> void override
+		{
+			tracer.mark(function);
+		}
+
+		auto clear_references() -> void override
+		{
+			function = LeObject{};
+		}
+
+		/* @return member as read through self, methods are bound to self and anything else is returned as is */
+		static auto bind(const LeObject& self, const LeObject& member) -> LeObject
+		{
+			if (member.type() != Type::Method)
+				return member;
+			return global::mem->emplace_temporary<BuiltinMemberFunction>(self, static_cast<Method*>(member.get())->frame());
+		}
+	};
+
 	struct Class
 		: RuntimeValue
 	{
 		Class() { type = Type::Class; }
 
 		String name{};
-		std::unordered_map<String, LeObject> members{};
+		Shape* shape{ &Shape::root() };
+		ManagedVector<LeObject> slots{};
 		
 		auto type_name() -> String override
 		{
 			return name;
 		}
 
+		auto trace(Tracer& tracer) -> void override
+		{
+			tracer.mark(slots);
+		}
+
+		auto clear_references() -> void override
+		{
+			slots.clear();
+		}
+
+		auto relocate() -> void override
+		{
+			le::relocate(slots);
+		}
+
 		auto member_access(LeObject self, const String& query) -> LeObject override
 		{
 			if (auto member = has_member(query))
 			{
-				return member;
+				return Method::bind(self, member);
 			}
 			throw(ferr::invalid_member(query, query));
 		}
 
-		auto make_member(LeObject self, const String& member, LeObject assign) -> void
+		auto member_layout() const -> u64 override { return shape->id; }
+		auto member_slot(const String& member) -> u32 override { return shape->slot(member); }
+
+		auto member_at(LeObject self, u32 slot) -> LeObject override
 		{
-			if (assign->type == Type::Function)
-				assign = global::mem->emplace<BuiltinMemberFunction>(self, static_cast<CompiledFunction*>(assign.get())->function_frame);
+			return Method::bind(self, slots[slot]);
+		}
 
-			members.insert(std::pair{ member, assign });
+		/* Moves the instance to next, which has to be the transition of its shape for the new member */
+		auto append_member(Shape* next, LeObject assign) -> void
+		{
+			shape = next;
+			if (slots.size() == slots.capacity())
+				slots.reserve(shape->largest_size);
+			slots.push_back(MemoryManager::promote(assign));
 		}
 		
 		auto access_assign(LeObject query, LeObject new_val) -> LeObject override
@@ -48,21 +167,19 @@ namespace le
 			if (query->type != Type::String)
 				throw(ferr::invalid_access(type_name(), query->type_name()));
 			
-			auto& str = getters::get_string_ref(query, "access assign");
-			if (not has_member(str))
+			const auto str = String(getters::get_string_ref(query, "access assign"));
+			const auto slot = member_slot(str);
+			if (slot == no_slot)
 				throw(ferr::invalid_member(str));
 
-			return members.at(str) = new_val;
+			return slots[slot] = MemoryManager::promote(new_val);
 		}
 
-		/* Can be null */
+		/* Can be null, methods are returned unbound */
 		auto has_member(const String& str) -> LeObject
 		{
-			if (auto res = members.find(str);
-				res != members.end())
-			{
-				return res->second;
-			}
+			if (const auto slot = member_slot(str); slot != no_slot)
+				return slots[slot];
 			return nullptr;
 		}
 	};
@@ -0,0 +1,444 @@
+#pragma once
+
+#include "Builtin.h"
+
+#include <vector>
+#include <span>
+#include <chrono>
+#include <concepts>
+#include <unordered_set>
+
+namespace le
+{
+	/*
+	* Gray set of a collection, objects marked through it get their references traced by drain. See RuntimeValue::trace
+	* A tracer made for listing children only gathers the references of the objects traced through it, see children.
+	*/
+	class Tracer
+	{
+		std::vector<RuntimeValue*> _gray{};
+		bool _listing{};
+	public:
+		struct Listing {};
+		static constexpr auto listing = Listing{};
+
+		Tracer() = default;
+		explicit Tracer(Listing) : _listing(true) {}
+
+		auto mark(RuntimeValue* object) -> void
+		{
+			if (_listing)
+			{
+				_gray.push_back(object);
+				return;
+			}
+			if (object->marked)
+				return;
+			object->marked = true;
+			_gray.push_back(object);
+		}
+
+		auto mark(const LeObject& value) -> void
+		{
+			if (value.is_object())
+				mark(value.object());
+		}
+
+		auto mark(std::span<const LeObject> values) -> void
+		{
+			for (const auto& value : values)
+				mark(value);
+		}
+
+		/* @return The objects referenced by object, one entry per reference. Valid till the next call, only for listing tracers */
+		auto children(RuntimeValue* object) -> std::span<RuntimeValue* const>
+		{
+			_gray.clear();
+			object->trace(*this);
+			return _gray;
+		}
+
+		/* Traces the references of the gray objects till every reachable object is marked */
+		auto drain() -> void
+		{
+			while (not _gray.empty())
+			{
+				auto object = _gray.back();
+				_gray.pop_back();
+				object->trace(*this);
+			}
+		}
+	};
+
+	/*
+	* Mark and sweep collector, owns the objects referenced by Values in place of their reference counts when LE_TRACING_GC is set.
+	* The first Value referencing an object hands its reference to the collector (see Value::pin), a collection lets go of whatever
+	* is not reachable from the roots anymore. Copying and dropping Values touches nothing but the Values themselves.
+	*
+	* Roots:
+	*	Whatever the caller of collect marks, the virtual machines mark their stack, registers and global variables
+	*	Permanent objects, these are the globals of compiled code and the Methods cached by MakeMember sites
+	* Values held by native code are no roots, the virtual machines only collect at safepoints where every value lives on their stack.
+	*
+	* Known Issues:
+	* * The tree interpreter never collects, its objects live till the memory manager is destroyed.
+	*/
+	class Collector
+	{
+	public:
+		static constexpr auto enabled = static_cast<bool>(LE_TRACING_GC);
+		/* Objects tracked before the first collection, afterwards a collection starts once the survivors of the last one doubled */
+		static constexpr auto min_threshold = size_t{ 1 } << 14;
+
+		struct Stats
+		{
+			size_t collections{};
+			size_t freed{}; /* Objects let go of by a collection */
+			std::chrono::nanoseconds total_pause{};
+			std::chrono::nanoseconds max_pause{};
+		};
+	private:
+		std::vector<RuntimeValue*> _objects{};
+		size_t _threshold{ min_threshold };
+		Stats _stats{};
+
+		auto sweep() -> void
+		{
+			auto unreachable = std::vector<RuntimeValue*>{};
+			auto kept = _objects.begin();
+			for (auto object : _objects)
+			{
+				if (object->marked)
+				{
+					object->marked = false;
+					*kept++ = object;
+				}
+				else
+					unreachable.push_back(object);
+			}
+			_objects.erase(kept, _objects.end());
+			_stats.freed += unreachable.size();
+
+			/* Let go once the list is in order again, incase a destructor makes a Value */
+			for (auto object : unreachable)
+			{
+				object->tracked = false;
+				release_object(object);
+			}
+		}
+	public:
+		Collector() = default;
+		Collector(const Collector&) = delete;
+		auto operator=(const Collector&) = delete;
+
+		~Collector()
+		{
+			release_all();
+		}
+
+		/* Called by Value::pin, the collector holds a reference to the object from now on */
+		auto track(RuntimeValue* object) -> void
+		{
+			_objects.push_back(object);
+		}
+
+		/* The object is never collected, only released along with the collector */
+		auto make_permanent(const LeObject& value) -> void
+		{
+			if constexpr (enabled)
+				if (value.is_object())
+					value.object()->permanent = true;
+		}
+
+		auto wants_collection() const -> bool
+		{
+			return enabled and _objects.size() >= _threshold;
+		}
+
+		auto tracked() const -> size_t { return _objects.size(); }
+
+		template<typename _Function>
+			requires std::invocable<_Function, RuntimeValue*>
+		auto for_each(_Function&& function) -> void
+		{
+			for (auto object : _objects)
+				function(object);
+		}
+		auto stats() const -> const Stats& { return _stats; }
+		auto reset_stats() -> void { _stats = Stats{}; }
+
+		/*
+		* Lets go of every object not reachable from a permanent object or a root marked by trace_roots.
+		* An object still held by a Ref survives being let go of, a Value made from it later hands it to the collector again.
+		*/
+		template<typename _Roots>
+			requires std::invocable<_Roots, Tracer&>
+		auto collect(_Roots&& trace_roots) -> void
+		{
+			const auto begin = std::chrono::steady_clock::now();
+
+			auto tracer = Tracer{};
+			for (auto object : _objects)
+				if (object->permanent)
+					tracer.mark(object);
+			trace_roots(tracer);
+			tracer.drain();
+			sweep();
+			_threshold = std::max<size_t>(min_threshold, 2 * _objects.size());
+
+			const auto pause = std::chrono::steady_clock::now() - begin;
+			_stats.collections++;
+			_stats.total_pause += pause;
+			_stats.max_pause = std::max<std::chrono::nanoseconds>(_stats.max_pause, pause);
+		}
+
+		/* Lets go of every object, permanent ones included */
+		auto release_all() -> void
+		{
+			auto objects = std::move(_objects);
+			_objects.clear();
+			for (auto object : objects)
+			{
+				object->tracked = false;
+				release_object(object);
+			}
+		}
+	};
+
+	/*
+	* Finds garbage cycles among reference counted objects, which reference counting alone never frees. Unused with LE_TRACING_GC.
+	* Based on the synchronous cycle collection of Bacon and Rajan:
+	*	An object of a type that may cycle (see le::may_cycle) surviving a release is buffered as a candidate root, see release_object
+	*	A collection subtracts the references the objects reachable from the candidates hold to each other (mark_gray)
+	*	Objects left with references are reachable from outside, they and everything they reach get their counts back (scan)
+	*	What is left is only referenced by garbage, it lets go of its references and dies (collect_white)
+	* The virtual machines collect at their safepoints once enough candidates were buffered, so every collection only looks at a few thousand of them.
+	* An object that dies while buffered keeps its memory till the next collection, see le::destroy.
+	*
+	* Known Issues:
+	* * Cycles only made of objects that don't may_cycle are never found, like a function keeping itself in a static variable.
+	* * The tree interpreter has no safepoints, its cycles are only found if something else collects.
+	*/
+	class CycleCollector
+	{
+	public:
+		static constexpr auto enabled = not Collector::enabled;
+		/* Candidates buffered before a collection is wanted */
+		static constexpr auto threshold = size_t{ 1 } << 12;
+
+		enum Color : u8 { Black, Gray, White };
+
+		struct Stats
+		{
+			size_t collections{};
+			size_t freed{}; /* Objects in garbage cycles */
+			std::chrono::nanoseconds total_pause{};
+			std::chrono::nanoseconds max_pause{};
+		};
+	private:
+		std::vector<RuntimeValue*> _candidates{};
+		std::vector<RuntimeValue*> _stack{};
+		std::vector<RuntimeValue*> _black{};
+		Tracer _tracer{ Tracer::listing };
+		Stats _stats{};
+
+		/* Subtracts the references held by every object reachable from root */
+		auto mark_gray(RuntimeValue* root) -> void
+		{
+			if (root->color == Gray)
+				return;
+			root->color = Gray;
+			_stack.push_back(root);
+			while (not _stack.empty())
+			{
+				auto object = _stack.back();
+				_stack.pop_back();
+				for (auto child : _tracer.children(object))
+				{
+					child->refs--;
+					if (child->color != Gray)
+					{
+						child->color = Gray;
+						_stack.push_back(child);
+					}
+				}
+			}
+		}
+
+		/* Gives the references back to object and everything it reaches */
+		auto scan_black(RuntimeValue* object) -> void
+		{
+			object->color = Black;
+			_black.push_back(object);
+			while (not _black.empty())
+			{
+				auto current = _black.back();
+				_black.pop_back();
+				for (auto child : _tracer.children(current))
+				{
+					child->refs++;
+					if (child->color != Black)
+					{
+						child->color = Black;
+						_black.push_back(child);
+					}
+				}
+			}
+		}
+
+		/* Objects referenced from outside turn black again, the others white */
+		auto scan(RuntimeValue* root) -> void
+		{
+			_stack.push_back(root);
+			while (not _stack.empty())
+			{
+				auto object = _stack.back();
+				_stack.pop_back();
+				if (object->color != Gray)
+					continue;
+				if (object->refs > 0)
+				{
+					scan_black(object);
+					continue;
+				}
+				object->color = White;
+				for (auto child : _tracer.children(object))
+					_stack.push_back(child);
+			}
+		}
+
+		/* Adds the white objects reachable from root to garbage, they turn black again */
+		auto collect_white(RuntimeValue* root, std::vector<RuntimeValue*>& garbage) -> void
+		{
+			_stack.push_back(root);
+			while (not _stack.empty())
+			{
+				auto object = _stack.back();
+				_stack.pop_back();
+				if (object->color != White)
+					continue;
+				object->color = Black;
+				garbage.push_back(object);
+				for (auto child : _tracer.children(object))
+					_stack.push_back(child);
+			}
+		}
+	public:
+		CycleCollector() = default;
+		CycleCollector(const CycleCollector&) = delete;
+		auto operator=(const CycleCollector&) = delete;
+
+		~CycleCollector()
+		{
+			forget_all();
+		}
+
+		/* Called by le::possible_cycle */
+		auto buffer(RuntimeValue* object) -> void
+		{
+			object->buffered = true;
+			_candidates.push_back(object);
+		}
+
+		auto wants_collection() const -> bool
+		{
+			return enabled and _candidates.size() >= threshold;
+		}
+
+		auto candidates() const -> size_t { return _candidates.size(); }
+		auto stats() const -> const Stats& { return _stats; }
+		auto reset_stats() -> void { _stats = Stats{}; }
+
+		/* Frees the garbage cycles reachable from the candidates, objects may die along with them so no native code may hold on to one without a reference */
+		auto collect() -> void
+		{
+			const auto begin = std::chrono::steady_clock::now();
+
+			auto roots = std::move(_candidates);
+			_candidates.clear();
+			auto kept = roots.begin();
+			for (auto object : roots)
+			{
+				object->buffered = false;
+				if (object->refs == 0)
+					release_memory(object); /* Died while buffered */
+				else
+					*kept++ = object;
+			}
+			roots.erase(kept, roots.end());
+
+			for (auto root : roots)
+				mark_gray(root);
+			for (auto root : roots)
+				scan(root);
+			auto garbage = std::vector<RuntimeValue*>{};
+			for (auto root : roots)
+				collect_white(root, garbage);
+
+			/*
+			* Give back the references of the garbage so the counts are right again, then have it let go of them while holding it.
+			* It counts as buffered meanwhile so losing those references doesn't buffer it again, it would die buffered and keep its memory.
+			*/
+			for (auto object : garbage)
+				for (auto child : _tracer.children(object))
+					child->refs++;
+			for (auto object : garbage)
+			{
+				retain_object(object);
+				object->buffered = true;
+			}
+			for (auto object : garbage)
+				object->clear_references();
+			for (auto object : garbage)
+				object->buffered = false;
+			for (auto object : garbage)
+				release_object(object);
+			_stats.freed += garbage.size();
+
+			const auto pause = std::chrono::steady_clock::now() - begin;
+			_stats.collections++;
+			_stats.total_pause += pause;
+			_stats.max_pause = std::max<std::chrono::nanoseconds>(_stats.max_pause, pause);
+		}
+
+		/*
+		* Takes the roots and every object they reach out of the candidates, another thread is about to use them.
+		* A collection reads and writes the counts of its candidates, so an object may only be buffered by the thread holding it. See MemoryManager::hand_over
+		*/
+		auto hand_over(std::span<RuntimeValue* const> roots) -> void
+		{
+			if (_candidates.empty())
+				return;
+			auto reached = std::unordered_set<RuntimeValue*>(roots.begin(), roots.end());
+			_stack.assign(roots.begin(), roots.end());
+			while (not _stack.empty())
+			{
+				auto object = _stack.back();
+				_stack.pop_back();
+				for (auto child : _tracer.children(object))
+					if (reached.insert(child).second)
+						_stack.push_back(child);
+			}
+			std::erase_if(_candidates, [&reached](RuntimeValue* object)
+			{
+				if (not reached.contains(object))
+					return false;
+				object->buffered = false;
+				return true;
+			});
+		}
+
+		/* Drops every candidate without collecting, the memory of those that died is freed */
+		auto forget_all() -> void
+		{
+			auto candidates = std::move(_candidates);
+			_candidates.clear();
+			for (auto object : candidates)
+			{
+				object->buffered = false;
+				if (object->refs == 0)
+					release_memory(object);
+			}
+		}
+	};
+}
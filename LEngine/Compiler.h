@@ -7,11 +7,40 @@
 #include "GlobalState.h"
 #include "ReservedFunctions.h"
 #include "Class.h"
+#include "Superinstructions.h"
+#include "ConstantFolding.h"
+#include "Peephole.h"
+#include "DeadCode.h"
+#include "TypeInference.h"
+#include "Inliner.h"
 
 #include <unordered_map>
 
 namespace le
 {
+	/* Runs the bytecode passes context asks for over the code of a function, what they removed is counted in counts (a Frame or Code) */
+	template<typename _Counts>
+	inline auto optimize_bytecode(ByteCode& code, const CompilerContext& context, _Counts& counts) -> void
+	{
+		if (context.options.dead_code)
+			counts.dead_code_removed += eliminate_dead_code(code);
+		if (not context.options.peephole)
+			return;
+
+		/* Threaded jumps leave the code they jumped over behind, which leaves jumps to the next instruction behind */
+		auto removed = optimize_peephole(code);
+		counts.peephole_removed += removed;
+		while (context.options.dead_code and removed > 0ull)
+		{
+			removed = eliminate_dead_code(code);
+			counts.dead_code_removed += removed;
+			if (removed == 0ull)
+				break;
+			removed = optimize_peephole(code);
+			counts.peephole_removed += removed;
+		}
+	}
+
 	/*
 	* The implementation of the compiler.
 	* Use this to compile pieces of code using another function that controls the Code object.
@@ -26,6 +55,9 @@ namespace le
 		Code* _code_obj{};
 		CompilerContext& _context;
 		size_t _depth{}; /* Scope depth */
+		/* Slots the locals of inlined functions share, one body finishes before the next one starts */
+		size_t _inline_slots{};
+		u64 _inline_slot_count{};
 
 		auto in_global_namespace() const -> bool { return _depth == 0; }
 		
@@ -78,6 +110,7 @@ namespace le
 		{
 			auto old_size = _code_obj->globals.size();
 			_code_obj->globals.push_back(global::mem->emplace<_Val>(std::forward<_Args>(args)...));
+			global::mem->collector().make_permanent(_code_obj->globals.back());
 			return old_size;
 		}
 
@@ -85,6 +118,7 @@ namespace le
 		{
 			auto old_size = _code_obj->globals.size();
 			_code_obj->globals.push_back(object);
+			global::mem->collector().make_permanent(object);
 			return old_size;
 		}
 
@@ -98,14 +132,33 @@ namespace le
 			return _context.global_strings.get(string); /* Return the global index */
 		}
 
-		auto store_function(ByteCode code, u64 argc, String name) -> size_t
+		/* @return index of a new inline cache for an access or make of member, every site gets its own */
+		auto store_member_cache(const StringView& member) -> size_t
+		{
+			_code_obj->member_caches.push_back(MemberCache{ .name = String(member) });
+			return _code_obj->member_caches.size() - 1;
+		}
+
+		/* @param inline_global: Global the function is stored in if calls to it may be inlined, see inlinable_body */
+		auto store_function(ByteCode code, u64 argc, String name, u64 locals, std::optional<size_t> inline_global = std::nullopt) -> size_t
 		{
 			auto frame = Frame{};
 
-			if (name.empty())
-				frame = Frame(std::move(code), String("Lambda"), argc);
-			else
-				frame = Frame(std::move(code), std::move(name), argc);
+			optimize_bytecode(code, _context, frame);
+			if (inline_global)
+			{
+				if (auto body = inlinable_body(code, *inline_global, argc, _context.inline_budget))
+					_context.inline_functions[*inline_global] = InlineFunction{ std::move(*body), argc, std::max<u64>(locals, type_inference::local_slots(code)) };
+			}
+			if (_context.options.type_inference) /* Methods get 'this' before their arguments */
+				frame.typed = specialize_numbers(code, is_compiling_class() ? 1ull : 0ull, argc);
+			if (_context.options.superinstructions)
+				fuse_superinstructions(code);
+
+			frame.code = std::move(code);
+			frame.name = name.empty() ? String("Lambda") : std::move(name);
+			frame.argc = argc;
+			frame.locals = locals;
 
 			return store_global<CompiledFunction>(frame);
 		}
@@ -128,6 +181,31 @@ namespace le
 
 		auto is_compiling_class() const -> bool { return not _context.namespace_name.empty(); }
 
+		/* @return The first of the n slots an inlined function keeps its locals in */
+		auto inline_slots(u64 n) -> size_t
+		{
+			if (n > _inline_slot_count)
+			{
+				_inline_slots = _vars.reserve(n);
+				_inline_slot_count = n;
+			}
+			return _inline_slots;
+		}
+
+		/* @return The function a call is replaced with, nullptr if the call has to be made */
+		auto inline_function_of(const CallExpression& call_expr) const -> const InlineFunction*
+		{
+			if (call_expr.target->type != Statement::Type::IdentifierExpression)
+				return nullptr;
+			const auto& name = static_cast<const Identifier*>(call_expr.target.get())->name;
+			if (not is_global(name))
+				return nullptr;
+			const auto function = _context.inline_functions.find(get_global(name));
+			if (function == _context.inline_functions.end() or function->second.argc != call_expr.args.size())
+				return nullptr;
+			return &function->second;
+		}
+
 		std::stack<BlockStatement*> _loop_blocks{};
 		struct EscapeReason
 		{
@@ -137,6 +215,45 @@ namespace le
 		};
 		std::stack<EscapeReason> _escape_calls{};
 
+		/* @return The fused jump for a relational operator, JumpIfFalse when the test is anything else */
+		static auto jump_if_not_for(const Statement* test) -> OpCode
+		{
+			if (test->type != Statement::Type::BinaryExpression)
+				return OpCode::JumpIfFalse;
+
+			switch (static_cast<const BinaryOperation*>(test)->op.type)
+			{
+			case Token::Type::OperatorGT: return OpCode::JumpIfNotGT;
+			case Token::Type::OperatorGET: return OpCode::JumpIfNotGET;
+			case Token::Type::OperatorLT: return OpCode::JumpIfNotLT;
+			case Token::Type::OperatorLET: return OpCode::JumpIfNotLET;
+			case Token::Type::OperatorEq: return OpCode::JumpIfNotEQ;
+			case Token::Type::OperatorNEq: return OpCode::JumpIfNotNEQ;
+			default: return OpCode::JumpIfFalse;
+			}
+		}
+
+		/*
+		* Generates test followed by a jump that is taken when test is false.
+		* A relational test is fused into the jump so its Boolean is never pushed.
+		* @return Index of the jump, its delta still has to be patched
+		*/
+		auto generate_jump_if_not(Statement* test) -> size_t
+		{
+			const auto jump = jump_if_not_for(test);
+			if (jump == OpCode::JumpIfFalse)
+			{
+				generate(test);
+			}
+			else
+			{
+				auto& binop = as<BinaryOperation>(test);
+				generate(binop.left.get());
+				generate(binop.right.get());
+			}
+			return emit_and_get_index(Instruction(jump));
+		}
+
 		auto generate(Statement* statement) -> void
 		{
 			using SType = Statement::Type;
@@ -145,14 +262,6 @@ namespace le
 
 			/* Helpers, handy for instructions that rely on stack order */
 
-			/* 'expr.expr' */
-			auto member_access_expr_order_helper =
-				[this](PExpression& target, PExpression& query)
-			{
-				generate(query.get()); /* Set query at second to TOS */
-				generate(target.get()); /* Set target TOS */
-			};
-
 			/* 'expr[expr]' */
 			auto access_expr_order_helper =
 				[this](PExpression& target, PExpression& query)
@@ -188,7 +297,7 @@ namespace le
 				compiler.add_local("this");
 				auto res = compiler.compile(class_stmt.members, *_code_obj, true /* Push this object to TOS so it will be returned as if a function */);
 				
-				emit(Instruction(OpCode::PushGlobal, store_function(res.first, 0, String(class_stmt.name))));
+				emit(Instruction(OpCode::PushGlobal, store_function(res.first, 0, String(class_stmt.name), res.second.count)));
 				emit(Instruction(OpCode::StoreGlobal, register_global(class_stmt.name)));
 				
 				_context.namespace_name = old_namespace;
@@ -250,6 +359,28 @@ namespace le
 			case SType::CallExpression:
 			{
 				auto& call_expr = as<CallExpression>(statement);
+				if (call_expr.target->type == SType::MemberExpression)
+				{ /* Method call, the receiver takes the place of the callable */
+					auto& member_expr = as<MemberExpression>(call_expr.target.get());
+					generate(member_expr.target.get());
+					for (auto& expr : call_expr.args)
+						generate(expr.get());
+
+					auto call = Instruction(OpCode::CallMethod);
+					call.operand.method.cache = static_cast<u32>(store_member_cache(as<StringLiteral>(member_expr.query.get()).string));
+					call.operand.method.argc = static_cast<u32>(call_expr.args.size());
+					emit(call);
+					break;
+				}
+
+				if (auto function = inline_function_of(call_expr))
+				{ /* The arguments are stored in slots of this function the body uses as its locals */
+					for (auto& expr : call_expr.args)
+						generate(expr.get());
+					inline_function(_code, *function, inline_slots(function->locals));
+					break;
+				}
+
 				generate(call_expr.target.get());
 				for (auto& expr : call_expr.args)
 					generate(expr.get());
@@ -269,18 +400,21 @@ namespace le
 
 				const auto is_lambda = function_decl.name.empty();
 				const auto push_global_index = emit_and_get_index(Instruction(OpCode::PushGlobal));
+				auto inline_global = std::optional<size_t>{};
 
 				if (not is_lambda)
 				{
 					if (is_compiling_class())
 					{
-						emit(Instruction(OpCode::PushGlobal, store_string(function_decl.name)));
 						emit(Instruction(OpCode::Load, get("this")));
-						emit(Instruction(OpCode::MakeMember));
+						emit(Instruction(OpCode::MakeMember, store_member_cache(function_decl.name)));
 					}
 					else if (in_global_namespace())
 					{
-						emit(Instruction(OpCode::StoreGlobal, register_global(function_decl.name)));
+						const auto global = register_global(function_decl.name);
+						emit(Instruction(OpCode::StoreGlobal, global));
+						if (_context.options.inlining and _context.inline_names.contains(function_decl.name))
+							inline_global = global;
 					}
 					else
 					{
@@ -289,7 +423,7 @@ namespace le
 				}
 				/* Have to first declare globals incase the function body refers to itself (maybe we should compile functions last?) */
 				auto res = compiler.compile(function_decl.body->body, *_code_obj);
-				instruction_at(push_global_index).operand.uinteger = store_function(res.first, function_decl.args.size(), String(function_decl.name));
+				instruction_at(push_global_index).operand.uinteger = store_function(res.first, function_decl.args.size(), String(function_decl.name), res.second.count, inline_global);
 
 				break;
 			}
@@ -299,8 +433,7 @@ namespace le
 
 				/* Generate the test */
 				auto instr_count_pre_test = instruction_count();
-				generate(if_statement.test.get());
-				auto jump_to_next_set = emit_and_get_index(Instruction(OpCode::JumpIfFalse));
+				auto jump_to_next_set = generate_jump_if_not(if_statement.test.get());
 				generate(if_statement.consequent.get());
 
 				/* no alternative */
@@ -323,25 +456,25 @@ namespace le
 			case SType::ForLoop:
 			{
 				auto& loop = as<ForLoop>(statement);
+				const auto state = _vars.reserve(3); /* The iterable or its iterator, the index into it and the stack height */
 				generate(loop.target.get());
-				emit(Instruction(OpCode::GetIter));
+				emit(Instruction(OpCode::GetIter, state));
 				auto loop_opcode_index = emit_and_get_index(Instruction(OpCode::ForLoop));
+				instruction_at(loop_opcode_index).operand.loop.state = static_cast<u32>(state);
 				auto loop_var_index = store(loop.var);
 				emit(Instruction(OpCode::Store, loop_var_index));
 				generate(loop.body.get());
 
 				const auto instr_count_post_loop = instruction_count();
 				emit(Instruction(OpCode::Jump, loop_opcode_index - instr_count_post_loop));
-				instruction_at(loop_opcode_index).operand.integer = instr_count_post_loop - loop_opcode_index + 1 /* jump instruction */;
+				instruction_at(loop_opcode_index).operand.loop.delta = static_cast<i32>(instr_count_post_loop - loop_opcode_index + 1 /* jump instruction */);
 				break;
 			}
 			case SType::WhileLoop:
 			{
 				auto& loop_statement = as<WhileLoop>(statement);
 				auto pre_condition_instr_count = instruction_count();
-				generate(loop_statement.expr.get()); /* expr first */
-				auto post_condition_instr_count = instruction_count();
-				auto pre_condition_jump_index = emit_and_get_index(Instruction(OpCode::JumpIfFalse));
+				auto pre_condition_jump_index = generate_jump_if_not(loop_statement.expr.get()); /* expr first */
 				const auto our_loop_block = &as<BlockStatement>(loop_statement.body.get());
 				
 				_loop_blocks.push(our_loop_block);
@@ -351,7 +484,7 @@ namespace le
 				auto post_block_instruction_count = instruction_count();
 
 				/* This is the jump instruction at the start that will exit the loop if expr failed */
-				instruction_at(pre_condition_jump_index).operand.integer = post_block_instruction_count - post_condition_instr_count + 1 /* Jump past the last jump instruction */;
+				instruction_at(pre_condition_jump_index).operand.integer = post_block_instruction_count - pre_condition_jump_index + 1 /* Jump past the last jump instruction */;
 				
 				while (not _escape_calls.empty() and _escape_calls.top().block == our_loop_block)
 				{
@@ -435,8 +568,8 @@ namespace le
 			case SType::MemberExpression:
 			{
 				auto& member_expr = as<MemberExpression>(statement);
-				member_access_expr_order_helper(member_expr.target, member_expr.query);
-				emit(Instruction(OpCode::AccessMember));
+				generate(member_expr.target.get());
+				emit(Instruction(OpCode::AccessMember, store_member_cache(as<StringLiteral>(member_expr.query.get()).string)));
 				break;
 			}
 			case SType::AccessorExpression:
@@ -464,9 +597,8 @@ namespace le
 
 				if (is_compiling_class())
 				{
-					emit(Instruction(OpCode::PushGlobal, store_string(assignment.target)));
 					emit(Instruction(OpCode::Load, get("this")));
-					emit(Instruction(OpCode::MakeMember));
+					emit(Instruction(OpCode::MakeMember, store_member_cache(assignment.target)));
 				}
 				else
 				{
@@ -572,7 +704,7 @@ namespace le
 		* @param code_object: The code object holding instructions and global storage for the virtual machine
 		* @param in_class_namespace: True if and only if compiling in the namespace of the class declaration
 		*/
-		auto compile(std::vector<PStatement>& ast, Code& code_object, bool in_class_namespace = false) 
+		auto compile(NodeList<PStatement>& ast, Code& code_object, bool in_class_namespace = false) 
 			-> Result
 		{
 			_code_obj = &code_object;
@@ -601,17 +733,34 @@ namespace le
 
 	class Compiler
 	{
+		CompilerOptions _options{};
 	public:
 		Compiler() = default;
 
+		/* @param options: The passes to run, e.g. Compiler({ .superinstructions = false }) */
+		explicit Compiler(CompilerOptions options)
+			: _options(options)
+		{}
+
+		/* The AST is folded in place, see ConstantFolder */
 		auto emit_bytecode(AST& ast) -> std::variant<Code, String>
 		try
 		{
+			if (_options.constant_folding)
+				fold_constants(*ast.arena, ast.body);
 			auto code = Code{};
-			auto context = CompilerContext{};
+			auto context = CompilerContext{ .options = _options };
+			if (_options.inlining)
+				context.inline_names = inlinable_names(ast.body);
 			auto compiler = ImplCompiler(context, 0ull);
 			auto result = compiler.compile(ast, code);
 			code.code = result.first;
+			code.locals = result.second.count;
+			optimize_bytecode(code.code, context, code);
+			if (_options.type_inference)
+				code.typed = specialize_numbers(code.code);
+			if (_options.superinstructions)
+				fuse_superinstructions(code.code);
 			return code;
 		}
 		catch (const std::exception& e)
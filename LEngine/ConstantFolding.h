@@ -0,0 +1,526 @@
+#pragma once
+
+#include "Statements.h"
+#include "ReservedFunctions.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <cstring>
+
+namespace le
+{
+	/*
+	* Rewrites an AST before it is compiled so constant expressions are computed once instead of every time they run:
+	*	Arithmetic on number literals and + on string literals are replaced by their result
+	*	Reading a var that is never assigned again after being declared with a literal is replaced by that literal
+	*	An if or while whose test is known is replaced by the branch that is taken
+	* Comparisons are only folded where they decide a branch, the language has no boolean literal to replace them with.
+	* Anything that would throw at runtime, like adding a number to a string, is left for the runtime to throw.
+	* Names the compilers resolve as globals (top level functions, classes, imports and reserved names) are never propagated.
+	*/
+	class ConstantFolder
+	{
+		/* The names of a function body, every function and class body is a scope of its own like in the compilers */
+		struct Scope
+		{
+			std::unordered_set<Symbol> declared{};
+			std::unordered_set<Symbol> reassigned{};
+			std::unordered_set<Symbol> named{}; /* Functions, classes and imports, at the top level these are globals */
+			std::unordered_map<Symbol, PExpression> constants{};
+			bool propagates{ true }; /* Vars of a class body are members, they are never propagated */
+		};
+
+		Arena& _arena;
+		std::unordered_set<Symbol> _globals{};
+		std::vector<Scope> _scopes{};
+		size_t _folded{};
+
+		auto scope() -> Scope& { return _scopes.back(); }
+
+		static auto is_literal(const Statement* expr) -> bool
+		{
+			using SType = Statement::Type;
+			return expr and (expr->type == SType::NumericLiteralExpression or expr->type == SType::StringLiteralExpression or expr->type == SType::NullExpression);
+		}
+
+		static auto number_of(const Statement* expr) -> std::optional<Number>
+		{
+			if (expr and expr->type == Statement::Type::NumericLiteralExpression)
+				return static_cast<const NumericLiteral*>(expr)->value;
+			return std::nullopt;
+		}
+
+		static auto string_of(const Statement* expr) -> std::optional<StringView>
+		{
+			if (expr and expr->type == Statement::Type::StringLiteralExpression)
+				return static_cast<const StringLiteral*>(expr)->string;
+			return std::nullopt;
+		}
+
+		/* Every use of a propagated constant gets a node of its own */
+		auto copy_literal(const Statement* literal) -> PExpression
+		{
+			if (auto number = number_of(literal))
+				return make_node<NumericLiteral>(_arena, *number);
+			if (auto string = string_of(literal))
+				return make_node<StringLiteral>(_arena, *string);
+			return make_node<NullLiteral>(_arena);
+		}
+
+		/* @return A string literal holding lhs followed by rhs, the characters are kept by the arena of the AST */
+		auto concatenate(StringView lhs, StringView rhs) -> PExpression
+		{
+			auto characters = static_cast<char*>(_arena.allocate(lhs.size() + rhs.size() + 1ull));
+			std::memcpy(characters, lhs.data(), lhs.size());
+			std::memcpy(characters + lhs.size(), rhs.data(), rhs.size());
+			return make_node<StringLiteral>(_arena, StringView(characters, lhs.size() + rhs.size()));
+		}
+
+		/* @return Whether the test of a branch is true, nullopt if it is only known at runtime. Follows to_native_bool and the relational opcodes */
+		static auto truth_of(const Statement* test) -> std::optional<bool>
+		{
+			using SType = Statement::Type;
+			using TType = Token::Type;
+
+			if (auto number = number_of(test))
+				return *number != 0.0;
+			if (auto string = string_of(test))
+				return not string->empty();
+			if (test->type == SType::NullExpression)
+				return false;
+			if (test->type != SType::BinaryExpression)
+				return std::nullopt;
+
+			auto& binop = *static_cast<const BinaryOperation*>(test);
+			const auto lhs = number_of(binop.left.get()), rhs = number_of(binop.right.get());
+			if (lhs and rhs)
+			{
+				switch (binop.op.type)
+				{
+				case TType::OperatorGT: return *lhs > *rhs;
+				case TType::OperatorGET: return *lhs >= *rhs;
+				case TType::OperatorLT: return *lhs < *rhs;
+				case TType::OperatorLET: return *lhs <= *rhs;
+				case TType::OperatorEq: return *lhs == *rhs;
+				case TType::OperatorNEq: return *lhs != *rhs;
+				default: return std::nullopt;
+				}
+			}
+
+			const auto lhs_string = string_of(binop.left.get()), rhs_string = string_of(binop.right.get());
+			if (lhs_string and rhs_string)
+			{
+				if (binop.op.type == TType::OperatorEq) return *lhs_string == *rhs_string;
+				if (binop.op.type == TType::OperatorNEq) return *lhs_string != *rhs_string;
+			}
+			return std::nullopt;
+		}
+
+		/* @return Whether statement declares a name in the current scope, a branch that does is kept so the compilers still find the name */
+		static auto declares(const Statement* statement) -> bool
+		{
+			using SType = Statement::Type;
+			if (not statement)
+				return false;
+
+			switch (statement->type)
+			{
+			case SType::VarAssignmentStatement:
+			case SType::FunctionDeclarationExpression:
+			case SType::ClassDeclaration:
+			case SType::ImportStatement:
+			case SType::ForLoop:
+				return true;
+			case SType::BlockStatement:
+				return std::ranges::any_of(static_cast<const BlockStatement*>(statement)->body, [](const PStatement& child) { return declares(child.get()); });
+			case SType::IfStatement:
+			{
+				auto& if_statement = *static_cast<const IfStatement*>(statement);
+				return declares(if_statement.consequent.get()) or declares(if_statement.alternative.get());
+			}
+			case SType::WhileLoop:
+				return declares(static_cast<const WhileLoop*>(statement)->body.get());
+			default:
+				return false;
+			}
+		}
+
+		auto declare_named(Symbol name) -> void
+		{
+			scope().named.insert(name);
+			scope().reassigned.insert(name);
+		}
+
+		/* Finds the names of the current scope that are assigned more than once, nested functions and classes are scopes of their own */
+		auto scan(const Statement* statement) -> void
+		{
+			using SType = Statement::Type;
+			if (not statement)
+				return;
+
+			auto declare = [this](Symbol name)
+			{
+				if (not scope().declared.insert(name).second)
+					scope().reassigned.insert(name);
+			};
+
+			switch (statement->type)
+			{
+			case SType::VarAssignmentStatement:
+			{
+				auto& assignment = *static_cast<const VarAssignment*>(statement);
+				declare(assignment.target);
+				scan(assignment.right.get());
+				break;
+			}
+			case SType::AssignmentStatement:
+			case SType::AssignmentExpression:
+			{
+				auto& assignment = *static_cast<const AssignmentExpression*>(statement);
+				if (assignment.target->type == SType::IdentifierExpression)
+					scope().reassigned.insert(static_cast<const Identifier*>(assignment.target.get())->name);
+				else
+					scan(assignment.target.get());
+				scan(assignment.right.get());
+				break;
+			}
+			case SType::FunctionDeclarationExpression:
+			{
+				auto& function_decl = *static_cast<const FunctionDeclaration*>(statement);
+				if (not function_decl.name.empty())
+					declare_named(function_decl.name);
+				break;
+			}
+			case SType::ClassDeclaration:
+				declare_named(static_cast<const ClassDeclaration*>(statement)->name);
+				break;
+			case SType::ImportStatement:
+			{
+				auto& import_statement = *static_cast<const ImportStatement*>(statement);
+				auto name = import_statement.alias.empty() ? import_statement.target : import_statement.alias;
+				if (import_statement.alias.empty() and name.ends_with(".dll"))
+					name.remove_suffix(sizeof(".dll") - 1);
+				declare_named(name);
+				break;
+			}
+			case SType::ForLoop:
+			{
+				auto& loop = *static_cast<const ForLoop*>(statement);
+				scope().reassigned.insert(loop.var);
+				scan(loop.target.get());
+				scan(loop.body.get());
+				break;
+			}
+			case SType::WhileLoop:
+			{
+				auto& loop = *static_cast<const WhileLoop*>(statement);
+				scan(loop.expr.get());
+				scan(loop.body.get());
+				break;
+			}
+			case SType::IfStatement:
+			{
+				auto& if_statement = *static_cast<const IfStatement*>(statement);
+				scan(if_statement.test.get());
+				scan(if_statement.consequent.get());
+				scan(if_statement.alternative.get());
+				break;
+			}
+			case SType::BlockStatement:
+				for (auto& child : static_cast<const BlockStatement*>(statement)->body)
+					scan(child.get());
+				break;
+			case SType::ReturnExpression:
+				scan(static_cast<const ReturnExpression*>(statement)->expr.get());
+				break;
+			case SType::CallExpression:
+			{
+				auto& call_expr = *static_cast<const CallExpression*>(statement);
+				scan(call_expr.target.get());
+				for (auto& arg : call_expr.args)
+					scan(arg.get());
+				break;
+			}
+			case SType::ArrayExpression:
+				for (auto& element : static_cast<const ArrayExpression*>(statement)->container)
+					scan(element.get());
+				break;
+			case SType::AccessorExpression:
+			case SType::MemberExpression:
+			{
+				auto& access_expr = *static_cast<const AccessorExpression*>(statement);
+				scan(access_expr.target.get());
+				scan(access_expr.query.get());
+				break;
+			}
+			case SType::BinaryExpression:
+			{
+				auto& binop = *static_cast<const BinaryOperation*>(statement);
+				scan(binop.left.get());
+				scan(binop.right.get());
+				break;
+			}
+			case SType::UnaryOperation:
+				scan(static_cast<const UnaryOperation*>(statement)->target.get());
+				break;
+			default:
+				break;
+			}
+		}
+
+		/* Folds a body in a scope of its own, names already declared by the caller (arguments, this) are not propagated */
+		auto fold_scope(NodeList<PStatement>& body, std::initializer_list<Symbol> locals, bool propagates) -> void
+		{
+			_scopes.emplace_back();
+			scope().propagates = propagates;
+			for (auto name : locals)
+				scope().declared.insert(name);
+			for (auto& statement : body)
+				scan(statement.get());
+			for (auto& statement : body)
+				statement = fold_statement(statement);
+			_scopes.pop_back();
+		}
+
+		auto fold_function(FunctionDeclaration& function_decl) -> void
+		{
+			_scopes.emplace_back();
+			for (auto& arg : function_decl.args)
+				scope().declared.insert(arg);
+			scope().declared.insert("this");
+			scan(function_decl.body.get());
+			fold_statement(function_decl.body);
+			_scopes.pop_back();
+		}
+
+		/* Folds a branch that may not run, constants it declares are forgotten after it */
+		auto fold_branch(PStatement statement) -> PStatement
+		{
+			auto constants = scope().constants;
+			statement = fold_statement(statement);
+			scope().constants = std::move(constants);
+			return statement;
+		}
+
+		auto fold_statement(PStatement statement) -> PStatement
+		{
+			using SType = Statement::Type;
+			if (not statement)
+				return statement;
+
+			switch (statement->type)
+			{
+			case SType::VarAssignmentStatement:
+			{
+				auto& assignment = as<VarAssignment>(statement);
+				assignment.right = fold_expression(assignment.right);
+				const auto name = assignment.target;
+				if (scope().propagates and is_literal(assignment.right.get()) and not scope().reassigned.contains(name)
+					and not _globals.contains(name) and not lib::reserved::is_reserved(name))
+					scope().constants[name] = assignment.right;
+				return statement;
+			}
+			case SType::BlockStatement:
+				for (auto& child : as<BlockStatement>(statement).body)
+					child = fold_statement(child);
+				return statement;
+			case SType::IfStatement:
+			{
+				auto& if_statement = as<IfStatement>(statement);
+				if_statement.test = fold_expression(if_statement.test);
+				if (const auto truth = truth_of(if_statement.test.get()))
+				{
+					auto taken = *truth ? if_statement.consequent : if_statement.alternative;
+					auto skipped = *truth ? if_statement.alternative : if_statement.consequent;
+					if (not declares(skipped.get()))
+					{
+						_folded++;
+						if (not taken)
+							return make_node<BlockStatement>(_arena);
+						return fold_branch(taken);
+					}
+				}
+				if_statement.consequent = fold_branch(if_statement.consequent);
+				if_statement.alternative = fold_branch(if_statement.alternative);
+				return statement;
+			}
+			case SType::WhileLoop:
+			{
+				auto& loop = as<WhileLoop>(statement);
+				loop.expr = fold_expression(loop.expr);
+				if (truth_of(loop.expr.get()) == false and not declares(loop.body.get()))
+				{
+					_folded++;
+					return make_node<BlockStatement>(_arena);
+				}
+				fold_branch(loop.body); /* Folded in place, the compilers tell loops apart by their body */
+				return statement;
+			}
+			case SType::ForLoop:
+			{
+				auto& loop = as<ForLoop>(statement);
+				loop.target = fold_expression(loop.target);
+				fold_branch(loop.body);
+				return statement;
+			}
+			case SType::ReturnExpression:
+			{
+				auto& return_expr = as<ReturnExpression>(statement);
+				return_expr.expr = fold_expression(return_expr.expr);
+				return statement;
+			}
+			case SType::ClassDeclaration:
+			{
+				auto& class_stmt = as<ClassDeclaration>(statement);
+				fold_scope(class_stmt.members, { "this" }, false);
+				return statement;
+			}
+			case SType::ImportStatement:
+			case SType::BreakStatement:
+			case SType::ContinueStatement:
+				return statement;
+			default:
+				return fold_expression(PExpression(static_cast<Expression*>(statement.get())));
+			}
+		}
+
+		auto fold_expression(PExpression expr) -> PExpression
+		{
+			using SType = Statement::Type;
+			using TType = Token::Type;
+			if (not expr)
+				return expr;
+
+			switch (expr->type)
+			{
+			case SType::IdentifierExpression:
+			{
+				auto& constants = scope().constants;
+				if (auto constant = constants.find(as<Identifier>(expr).name); constant != constants.end())
+				{
+					_folded++;
+					return copy_literal(constant->second.get());
+				}
+				return expr;
+			}
+			case SType::BinaryExpression:
+			{
+				auto& binop = as<BinaryOperation>(expr);
+				binop.left = fold_expression(binop.left);
+				binop.right = fold_expression(binop.right);
+
+				const auto lhs = number_of(binop.left.get()), rhs = number_of(binop.right.get());
+				if (lhs and rhs)
+				{
+					auto result = std::optional<Number>{};
+					switch (binop.op.type)
+					{
+					case TType::OperatorPlus: result = *lhs + *rhs; break;
+					case TType::OperatorMinus: result = *lhs - *rhs; break;
+					case TType::OperatorMultiply: result = *lhs * *rhs; break;
+					case TType::OperatorDivide: result = *lhs / *rhs; break;
+					default: break;
+					}
+					if (result)
+					{
+						_folded++;
+						return make_node<NumericLiteral>(_arena, *result);
+					}
+				}
+
+				const auto lhs_string = string_of(binop.left.get()), rhs_string = string_of(binop.right.get());
+				if (lhs_string and rhs_string and binop.op.type == TType::OperatorPlus)
+				{
+					_folded++;
+					return concatenate(*lhs_string, *rhs_string);
+				}
+				return expr;
+			}
+			case SType::UnaryOperation:
+			{
+				auto& unary_expr = as<UnaryOperation>(expr);
+				unary_expr.target = fold_expression(unary_expr.target);
+				if (auto number = number_of(unary_expr.target.get()))
+				{
+					if (unary_expr.op.type == TType::OperatorMinus or unary_expr.op.type == TType::OperatorPlus)
+					{
+						_folded++;
+						return make_node<NumericLiteral>(_arena, unary_expr.op.type == TType::OperatorMinus ? -*number : *number);
+					}
+				}
+				return expr;
+			}
+			case SType::AssignmentStatement:
+			case SType::AssignmentExpression:
+			{
+				auto& assignment = as<AssignmentExpression>(expr);
+				if (assignment.target->type != SType::IdentifierExpression)
+					fold_expression(assignment.target);
+				assignment.right = fold_expression(assignment.right);
+				return expr;
+			}
+			case SType::CallExpression:
+			{
+				auto& call_expr = as<CallExpression>(expr);
+				call_expr.target = fold_expression(call_expr.target);
+				for (auto& arg : call_expr.args)
+					arg = fold_expression(arg);
+				return expr;
+			}
+			case SType::ArrayExpression:
+				for (auto& element : as<ArrayExpression>(expr).container)
+					element = fold_expression(element);
+				return expr;
+			case SType::AccessorExpression:
+			{
+				auto& access_expr = as<AccessorExpression>(expr);
+				access_expr.target = fold_expression(access_expr.target);
+				access_expr.query = fold_expression(access_expr.query);
+				return expr;
+			}
+			case SType::MemberExpression:
+			{
+				auto& member_expr = as<MemberExpression>(expr);
+				member_expr.target = fold_expression(member_expr.target); /* The query is the name of the member */
+				return expr;
+			}
+			case SType::FunctionDeclarationExpression:
+				fold_function(as<FunctionDeclaration>(expr));
+				return expr;
+			default:
+				return expr;
+			}
+		}
+
+		template<typename _Type>
+		static auto as(auto node) -> _Type&
+		{
+			return *static_cast<_Type*>(node.get());
+		}
+	public:
+		explicit ConstantFolder(Arena& arena)
+			: _arena(arena)
+		{}
+
+		/* @return Amount of expressions and branches folded */
+		auto fold(NodeList<PStatement>& body) -> size_t
+		{
+			/* Names the top level declares become globals of the compilers, see ImplCompiler::register_global */
+			_scopes.emplace_back();
+			for (auto& statement : body)
+				scan(statement.get());
+			_globals = std::move(scope().named);
+			_scopes.pop_back();
+
+			fold_scope(body, {}, true);
+			return _folded;
+		}
+	};
+
+	/* @return Amount of expressions and branches folded in body, see ConstantFolder */
+	inline auto fold_constants(Arena& arena, NodeList<PStatement>& body) -> size_t
+	{
+		return ConstantFolder(arena).fold(body);
+	}
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "ByteCode.h"
+#include "Peephole.h"
+
+#include <vector>
+#include <optional>
+
+namespace le
+{
+	/* A run of instructions that is only entered at its first and only left at its last */
+	struct BasicBlock
+	{
+		size_t begin{};
+		size_t end{}; /* One past the last instruction */
+		std::vector<size_t> successors{}; /* Indices of the blocks control can go to next */
+		bool reachable{};
+	};
+
+	/*
+	* The basic blocks of a function's bytecode, for both backends.
+	* Blocks start at the first instruction, at every jump target and after every jump or return.
+	* The last instruction, the Halt ending every function, is a block of its own.
+	*/
+	class ControlFlowGraph
+	{
+		std::vector<BasicBlock> _blocks{};
+		std::vector<size_t> _block_of{}; /* Block of every instruction */
+	public:
+		/* @return Whether control never goes on to the next instruction after op */
+		static auto ends_control(OpCode op) -> bool
+		{
+			return op == OpCode::Jump or peephole::ends_function(op);
+		}
+
+		explicit ControlFlowGraph(const ByteCode& code)
+		{
+			const auto size = code.size();
+			auto leaders = std::vector<bool>(size + 1ull);
+			leaders[0] = true;
+			if (size > 0ull)
+				leaders[size - 1ull] = true;
+			for (auto index{ 0ull }; index < size; index++)
+			{
+				const auto& instruction = code[index];
+				if (peephole::is_jump(instruction.op))
+				{
+					const auto target = static_cast<i64>(index) + peephole::delta_of(instruction);
+					if (target >= 0 and target <= static_cast<i64>(size))
+						leaders[target] = true;
+				}
+				if (peephole::is_jump(instruction.op) or ends_control(instruction.op))
+					leaders[index + 1ull] = true;
+			}
+
+			_block_of.resize(size);
+			for (auto index{ 0ull }; index < size; index++)
+			{
+				if (leaders[index])
+					_blocks.push_back(BasicBlock{ .begin = index });
+				_block_of[index] = _blocks.size() - 1ull;
+				_blocks.back().end = index + 1ull;
+			}
+
+			for (auto& block : _blocks)
+			{
+				const auto last = block.end - 1ull;
+				const auto& instruction = code[last];
+				if (peephole::is_jump(instruction.op))
+				{
+					const auto target = static_cast<i64>(last) + peephole::delta_of(instruction);
+					if (target >= 0 and target < static_cast<i64>(size))
+						block.successors.push_back(_block_of[target]);
+				}
+				if (not ends_control(instruction.op) and block.end < size)
+					block.successors.push_back(_block_of[block.end]);
+			}
+		}
+
+		/* Marks the blocks control can reach from the first one, the last block is always kept so code keeps ending with its Halt */
+		auto mark_reachable() -> void
+		{
+			if (_blocks.empty())
+				return;
+			auto pending = std::vector<size_t>{ 0ull, _blocks.size() - 1ull };
+			while (not pending.empty())
+			{
+				auto& block = _blocks[pending.back()];
+				pending.pop_back();
+				if (block.reachable)
+					continue;
+				block.reachable = true;
+				for (auto successor : block.successors)
+					if (not _blocks[successor].reachable)
+						pending.push_back(successor);
+			}
+		}
+
+		auto blocks() const -> const std::vector<BasicBlock>& { return _blocks; }
+		auto block_of(size_t instruction) const -> size_t { return _block_of[instruction]; }
+	};
+
+	namespace dead_code
+	{
+		/* @return Truth of a constant pushed by instruction, nullopt if it is only known at runtime. Follows to_native_bool */
+		inline auto truth_of(const Instruction& instruction) -> std::optional<bool>
+		{
+			if (instruction.op == OpCode::PushReal)
+				return instruction.operand.real != 0.0;
+			if (instruction.op == OpCode::PushNull)
+				return false;
+			return std::nullopt;
+		}
+
+		/* @return Whether the relation of a fused jump holds for two constants, see VirtualMachine::relation */
+		inline auto relation(OpCode jump, Number lhs, Number rhs) -> std::optional<bool>
+		{
+			switch (jump)
+			{
+			case OpCode::JumpIfNotGT: return lhs > rhs;
+			case OpCode::JumpIfNotGET: return lhs >= rhs;
+			case OpCode::JumpIfNotLT: return lhs < rhs;
+			case OpCode::JumpIfNotLET: return lhs <= rhs;
+			case OpCode::JumpIfNotEQ: return lhs == rhs;
+			case OpCode::JumpIfNotNEQ: return lhs != rhs;
+			default: return std::nullopt;
+			}
+		}
+
+		/*
+		* Collapses conditional jumps on constants pushed right before them, into nothing when the branch falls through or into a Jump when it is taken.
+		* The first instruction of a collapsed sequence is the one left or the one a jump to it moves on to, so jumps to it stay valid.
+		* @return Amount of instructions marked removed
+		*/
+		inline auto collapse_constant_branches(ByteCode& code, std::vector<bool>& removed) -> size_t
+		{
+			const auto targets = peephole::jump_targets(code);
+			auto marked = 0ull;
+			auto collapse = [&](size_t first, size_t length, bool taken)
+			{
+				const auto jump = first + length - 1ull;
+				if (taken)
+				{ /* The jump's delta is relative to itself, the Jump replacing the sequence sits at first */
+					const auto delta = peephole::delta_of(code[jump]) + static_cast<i64>(length - 1ull);
+					code[first] = Instruction(OpCode::Jump, delta);
+					first++;
+					length--;
+				}
+				for (auto index{ first }; index < first + length; index++)
+					removed[index] = true;
+				marked += length;
+			};
+
+			for (auto index{ 0ull }; index + 1ull < code.size(); index++)
+			{
+				const auto next = code[index + 1ull].op;
+				if ((next == OpCode::JumpIfFalse or next == OpCode::JumpIfTrue) and not targets[index + 1ull])
+				{
+					if (const auto truth = truth_of(code[index]))
+					{
+						collapse(index, 2ull, *truth == (next == OpCode::JumpIfTrue));
+						index++;
+					}
+				}
+				else if (index + 2ull < code.size() and code[index].op == OpCode::PushReal and next == OpCode::PushReal
+					and not targets[index + 1ull] and not targets[index + 2ull])
+				{
+					if (const auto holds = relation(code[index + 2ull].op, code[index].operand.real, code[index + 1ull].operand.real))
+					{
+						collapse(index, 3ull, not *holds);
+						index += 2ull;
+					}
+				}
+			}
+			return marked;
+		}
+	}
+
+	/*
+	* Removes the instructions control can never reach, like code after return, break or continue and the branch a constant test never takes.
+	* Constant tests are collapsed first, then whatever the ControlFlowGraph can't reach from the first instruction is dropped.
+	* Every jump is retargeted the same way optimize_peephole does it. Runs before fuse_superinstructions.
+	* @return Amount of instructions removed
+	*/
+	inline auto eliminate_dead_code(ByteCode& code) -> u64
+	{
+		const auto size = code.size();
+		auto removed = std::vector<bool>(code.size());
+		if (dead_code::collapse_constant_branches(code, removed) > 0ull)
+			peephole::compact(code, removed);
+
+		auto graph = ControlFlowGraph(code);
+		graph.mark_reachable();
+		removed.assign(code.size(), false);
+		auto unreachable = false;
+		for (const auto& block : graph.blocks())
+		{
+			if (block.reachable)
+				continue;
+			unreachable = true;
+			for (auto index{ block.begin }; index < block.end; index++)
+				removed[index] = true;
+		}
+		if (unreachable)
+			peephole::compact(code, removed);
+		return size - code.size();
+	}
+}
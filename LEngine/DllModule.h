@@ -19,7 +19,7 @@ namespace le
             type = Type::Module;
         }
 
-        using Map = std::unordered_map<hash_t, std::shared_ptr<ImportedFunction>>;
+        using Map = std::unordered_map<hash_t, Ref<ImportedFunction>>;
 
         HMODULE handle{};
         String mod_name{};
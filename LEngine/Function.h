@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "Builtin.h"
+#include "Collector.h"
 #include "String.h"
 #include "ByteCode.h"
 
@@ -44,6 +45,17 @@ namespace le
 
 		auto make_string() -> String override { return "Function"; }
 
+		auto trace(Tracer& tracer) -> void override
+		{
+			for (const auto& [name, value] : static_vars)
+				tracer.mark(value);
+		}
+
+		auto clear_references() -> void override
+		{
+			static_vars.clear();
+		}
+
 		struct BlockStatement* body{ nullptr };
 		std::vector<String> args{};
 		std::unordered_map<StringView, LeObject> static_vars{};
@@ -66,7 +78,7 @@ namespace le
 
 		auto access_assign(LeObject index, LeObject new_val) -> LeObject override
 		{
-			get_static_var(index) = new_val;
+			get_static_var(index) = MemoryManager::promote(new_val);
 			return new_val;
 		}
 	};
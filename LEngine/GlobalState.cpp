@@ -1,5 +1,26 @@
 #include "GlobalState.h"
 #include "Builtin.h"
 
-le::MemoryManager* le::global::mem = nullptr;
-le::LeObject le::global::null = nullptr; /* Define in main */
+LE_GLOBAL_STATE le::MemoryManager* le::global::mem = nullptr;
+LE_GLOBAL_STATE le::LeObject le::global::null = le::LeObject::null();
+
+#if LE_TRACING_GC
+/* The collector takes over the reference of the first Value, it already holds one for every other */
+auto le::Value::pin(RuntimeValue* object) -> void
+{
+    _bits = reinterpret_cast<u64>(object) | tag_object;
+    if (object->tracked)
+    {
+        release_object(object);
+        return;
+    }
+    object->tracked = true;
+    global::mem->collector().track(object);
+}
+#endif
+
+auto le::possible_cycle(RuntimeValue* object) -> void
+{
+    if (global::mem)
+        global::mem->cycles().buffer(object);
+}
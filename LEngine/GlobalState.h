@@ -3,10 +3,37 @@
 #include "MemoryManager.h"
 #include "Builtin.h"
 
+/* With LE_CONCURRENT_MEMORY every thread has its own global state, see ThreadMemory */
+#if LE_CONCURRENT_MEMORY
+#define LE_GLOBAL_STATE thread_local
+#else
+#define LE_GLOBAL_STATE
+#endif
+
 /* Objects that are better held in a global namespace */
 namespace le::global
 {
 	/* Better to place it here than give every object its own pointer to it */
-	extern MemoryManager* mem;
-	extern LeObject null;
+	extern LE_GLOBAL_STATE MemoryManager* mem;
+	extern LE_GLOBAL_STATE LeObject null;
+
+#if LE_CONCURRENT_MEMORY
+	/*
+	* Gives the thread it is made on a MemoryManager of its own till it is destroyed, mem is set back to what it was then.
+	* Objects made on the thread can be handed to other threads through MemoryManager::hand_over, whichever thread frees them hands their memory back to this manager.
+	* It has to outlive every object it handed over, so a host keeps it alive till the threads it handed objects to let go of them.
+	*/
+	class ThreadMemory
+	{
+		MemoryManager _mem{};
+		MemoryManager* _previous{};
+	public:
+		ThreadMemory() : _previous(std::exchange(mem, &_mem)) {}
+		ThreadMemory(const ThreadMemory&) = delete;
+		auto operator=(const ThreadMemory&) = delete;
+		~ThreadMemory() { mem = _previous; }
+
+		auto memory() -> MemoryManager& { return _mem; }
+	};
+#endif
 }
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "Statements.h"
+#include "ByteCode.h"
+#include "TypeInference.h"
+
+#include <unordered_set>
+#include <optional>
+
+namespace le
+{
+	namespace inlining
+	{
+		/* Collects the names assigned or declared anywhere below statement, nested functions and classes included */
+		inline auto collect_assigned(const Statement* statement, std::unordered_set<Symbol>& assigned) -> void
+		{
+			using SType = Statement::Type;
+			if (not statement)
+				return;
+
+			auto collect = [&assigned](const auto& statements)
+			{
+				for (const auto& child : statements)
+					collect_assigned(child.get(), assigned);
+			};
+
+			switch (statement->type)
+			{
+			case SType::AssignmentStatement:
+			case SType::AssignmentExpression:
+			{
+				auto& assignment = *static_cast<const AssignmentExpression*>(statement);
+				if (assignment.target->type == SType::IdentifierExpression)
+					assigned.insert(static_cast<const Identifier*>(assignment.target.get())->name);
+				else
+					collect_assigned(assignment.target.get(), assigned);
+				collect_assigned(assignment.right.get(), assigned);
+				break;
+			}
+			case SType::VarAssignmentStatement:
+			{
+				auto& var_assignment = *static_cast<const VarAssignment*>(statement);
+				assigned.insert(var_assignment.target);
+				collect_assigned(var_assignment.right.get(), assigned);
+				break;
+			}
+			case SType::ImportStatement:
+			{
+				auto& import = *static_cast<const ImportStatement*>(statement);
+				assigned.insert(import.target);
+				assigned.insert(import.alias);
+				break;
+			}
+			case SType::FunctionDeclarationExpression:
+				collect_assigned(static_cast<const FunctionDeclaration*>(statement)->body.get(), assigned);
+				break;
+			case SType::ClassDeclaration:
+				collect(static_cast<const ClassDeclaration*>(statement)->members);
+				break;
+			case SType::BlockStatement:
+				collect(static_cast<const BlockStatement*>(statement)->body);
+				break;
+			case SType::ForLoop:
+			{
+				auto& loop = *static_cast<const ForLoop*>(statement);
+				assigned.insert(loop.var);
+				collect_assigned(loop.target.get(), assigned);
+				collect_assigned(loop.body.get(), assigned);
+				break;
+			}
+			case SType::WhileLoop:
+			{
+				auto& loop = *static_cast<const WhileLoop*>(statement);
+				collect_assigned(loop.expr.get(), assigned);
+				collect_assigned(loop.body.get(), assigned);
+				break;
+			}
+			case SType::IfStatement:
+			{
+				auto& if_statement = *static_cast<const IfStatement*>(statement);
+				collect_assigned(if_statement.test.get(), assigned);
+				collect_assigned(if_statement.consequent.get(), assigned);
+				collect_assigned(if_statement.alternative.get(), assigned);
+				break;
+			}
+			case SType::ReturnExpression:
+				collect_assigned(static_cast<const ReturnExpression*>(statement)->expr.get(), assigned);
+				break;
+			case SType::CallExpression:
+			{
+				auto& call_expr = *static_cast<const CallExpression*>(statement);
+				collect_assigned(call_expr.target.get(), assigned);
+				collect(call_expr.args);
+				break;
+			}
+			case SType::ArrayExpression:
+				collect(static_cast<const ArrayExpression*>(statement)->container);
+				break;
+			case SType::AccessorExpression:
+			case SType::MemberExpression:
+			{
+				auto& access_expr = *static_cast<const AccessorExpression*>(statement);
+				collect_assigned(access_expr.target.get(), assigned);
+				collect_assigned(access_expr.query.get(), assigned);
+				break;
+			}
+			case SType::BinaryExpression:
+			{
+				auto& binop = *static_cast<const BinaryOperation*>(statement);
+				collect_assigned(binop.left.get(), assigned);
+				collect_assigned(binop.right.get(), assigned);
+				break;
+			}
+			case SType::UnaryOperation:
+				collect_assigned(static_cast<const UnaryOperation*>(statement)->target.get(), assigned);
+				break;
+			default:
+				break;
+			}
+		}
+
+		/*
+		* Finds the operand stack height before every instruction, relative to the height the function starts at.
+		* @return The heights, -1 for the instructions never reached. Nullopt if paths meet at different heights,
+		* a for loop starts on values left behind or code holds an opcode the type inference doesn't know
+		*/
+		inline auto stack_heights(const ByteCode& code) -> std::optional<std::vector<i64>>
+		{
+			const auto size = static_cast<i64>(code.size());
+			auto heights = std::vector<i64>(code.size(), i64{ -1 });
+			auto pending = std::vector<i64>{};
+			auto consistent = true;
+			auto flow = [&](i64 target, const TypeState& state)
+			{
+				const auto height = static_cast<i64>(state.stack.size());
+				if (target < 0 or target >= size)
+					consistent = false;
+				else if (heights[target] == -1)
+				{
+					heights[target] = height;
+					pending.push_back(target);
+				}
+				else if (heights[target] != height)
+					consistent = false;
+			};
+
+			const auto locals = std::vector<StaticType>(type_inference::local_slots(code));
+			if (size > 0)
+				flow(0, TypeState{ .locals = locals });
+			while (consistent and not pending.empty())
+			{
+				const auto index = pending.back();
+				pending.pop_back();
+				if (code[index].op == OpCode::GetIter and heights[index] != 1) /* ForLoop drops everything above the height at GetIter */
+					return std::nullopt;
+
+				auto state = TypeState{ .locals = locals, .stack = std::vector<StaticType>(heights[index]) };
+				const auto next = type_inference::step(code, index, state, flow);
+				if (next == type_inference::Step::Unknown)
+					return std::nullopt;
+				if (next == type_inference::Step::Next)
+					flow(index + 1, state);
+			}
+			if (not consistent)
+				return std::nullopt;
+			return heights;
+		}
+
+		/*
+		* Finds the locals code may load before it stores them, the first argc hold the arguments and are always stored.
+		* A called function starts with null in them, an inlined body starts with whatever the slots it shares held last.
+		* @param code: Code stack_heights accepted
+		* @return The slots in order
+		*/
+		inline auto unassigned_reads(const ByteCode& code, size_t argc) -> std::vector<size_t>
+		{
+			const auto slots = type_inference::local_slots(code);
+			auto entry = std::vector<bool>(slots, false);
+			std::fill_n(entry.begin(), std::min(argc, slots), true);
+
+			/* Slots stored on every path to an instruction, empty for the instructions not reached yet */
+			auto assigned = std::vector<std::vector<bool>>(code.size());
+			auto pending = std::vector<i64>{};
+			auto flow_assigned = [&](i64 target, const std::vector<bool>& state)
+			{
+				auto& known = assigned[target];
+				if (known.empty())
+					known = state;
+				else
+				{
+					auto changed = false;
+					for (auto slot{ 0ull }; slot < slots; slot++)
+					{
+						if (known[slot] and not state[slot])
+						{
+							known[slot] = false;
+							changed = true;
+						}
+					}
+					if (not changed)
+						return;
+				}
+				pending.push_back(target);
+			};
+
+			auto unassigned = std::vector<bool>(slots, false);
+			if (not code.empty())
+				flow_assigned(0, entry);
+			while (not pending.empty())
+			{
+				const auto index = pending.back();
+				pending.pop_back();
+
+				auto state = assigned[index];
+				const auto& instruction = code[index];
+				if (instruction.op == OpCode::Load and not state[instruction.operand.uinteger])
+					unassigned[instruction.operand.uinteger] = true;
+				else if (instruction.op == OpCode::Store)
+					state[instruction.operand.uinteger] = true;
+				else if (instruction.op == OpCode::GetIter)
+					std::fill_n(state.begin() + instruction.operand.uinteger, 3, true);
+
+				/* Only the control flow of step is used, the stack is left out */
+				auto types = TypeState{ .locals = std::vector<StaticType>(slots) };
+				const auto next = type_inference::step(code, index, types, [&](i64 target, const TypeState&) { flow_assigned(target, state); });
+				if (next == type_inference::Step::Next)
+					flow_assigned(index + 1, state);
+			}
+
+			auto reads = std::vector<size_t>{};
+			for (auto slot{ 0ull }; slot < slots; slot++)
+				if (unassigned[slot])
+					reads.push_back(slot);
+			return reads;
+		}
+	}
+
+	/*
+	* @return The names of the functions declared by top level statements of a program that nothing assigns to or declares again.
+	* A function declared in a block may never be declared, one assigned to may not be the function by the time it is called.
+	*/
+	inline auto inlinable_names(const NodeList<PStatement>& body) -> std::unordered_set<Symbol>
+	{
+		auto assigned = std::unordered_set<Symbol>{};
+		for (const auto& statement : body)
+			inlining::collect_assigned(statement.get(), assigned);
+
+		auto names = std::unordered_set<Symbol>{};
+		for (const auto& statement : body)
+		{
+			if (statement->type != Statement::Type::FunctionDeclarationExpression)
+				continue;
+			const auto& name = static_cast<const FunctionDeclaration*>(statement.get())->name;
+			if (not name.empty() and not assigned.contains(name))
+				names.insert(name);
+		}
+		return names;
+	}
+
+	/*
+	* Makes the body calls to a function are replaced with, out of the function's code after optimize_bytecode.
+	* Returns become jumps to the end of the body, the value a Call would leave behind is on top of the stack there:
+	*	Null stored in the locals read before they are stored; Body; Noop or the Jump of a Halt returning a value; PushNull for Return and a Halt without a value
+	* @param global: Global the function is stored in, a function loading itself is recursive
+	* @param argc: Arguments of the function, they are stored in its first locals
+	* @return The body, nullopt if the function is larger than budget, recursive, or leaves more than its return value on the stack
+	*/
+	inline auto inlinable_body(const ByteCode& code, size_t global, size_t argc, u64 budget) -> std::optional<ByteCode>
+	{
+		if (code.empty() or code.size() - 1ull > budget or code.back().op != OpCode::Halt)
+			return std::nullopt;
+		if (std::ranges::any_of(code, [global](const Instruction& i) { return i.op == OpCode::LoadGlobal and i.operand.uinteger == global; }))
+			return std::nullopt;
+		const auto heights = inlining::stack_heights(code);
+		if (not heights)
+			return std::nullopt;
+
+		const auto size = static_cast<i64>(code.size());
+		const auto end = size + 1; /* The body is followed by the PushNull */
+		auto body = ByteCode{};
+		body.reserve(code.size() + 1ull);
+		for (const auto slot : inlining::unassigned_reads(code, argc))
+		{
+			body.push_back(Instruction(OpCode::PushNull));
+			body.push_back(Instruction(OpCode::Store, slot));
+		}
+		for (auto index = i64{}; index < size; index++)
+		{
+			const auto height = (*heights)[index];
+			switch (code[index].op)
+			{
+			case OpCode::ReturnExpr:
+				if (height != -1 and height != 1)
+					return std::nullopt;
+				body.push_back(Instruction(OpCode::Jump, end - index));
+				break;
+			case OpCode::Return:
+				if (height > 0)
+					return std::nullopt;
+				body.push_back(Instruction(OpCode::Jump, end - 1 - index));
+				break;
+			case OpCode::Halt: /* Returns the operand on top if there is one, see VirtualMachine::leave */
+				if (height > 1)
+					return std::nullopt;
+				body.push_back(height == 1 ? Instruction(OpCode::Jump, end - index) : Instruction(OpCode::Noop));
+				break;
+			default:
+				body.push_back(code[index]);
+			}
+		}
+		body.push_back(Instruction(OpCode::PushNull));
+		return body;
+	}
+
+	/*
+	* Emits the body of function in place of a call to it, the arguments are on top of the stack and are stored in the function's first locals.
+	* The locals of the function move to the caller's slots from base, the caller reserves function.locals of them.
+	*/
+	inline auto inline_function(ByteCode& code, const InlineFunction& function, size_t base) -> void
+	{
+		for (auto arg{ function.argc }; arg-- > 0ull; )
+			code.push_back(Instruction(OpCode::Store, base + arg));
+
+		for (auto instruction : function.code)
+		{
+			switch (instruction.op)
+			{
+			case OpCode::Load: case OpCode::Store: case OpCode::GetIter:
+				instruction.operand.uinteger += base;
+				break;
+			case OpCode::ForLoop:
+				instruction.operand.loop.state += static_cast<u32>(base);
+				break;
+			default:
+				break;
+			}
+			code.push_back(instruction);
+		}
+	}
+}
@@ -87,7 +87,7 @@ namespace le
 			return lval->apply_operation(op, rval);
 		}
 
-		auto call_builtin_function(Function& func, std::vector<PExpression>& args) -> LeObject
+		auto call_builtin_function(Function& func, NodeList<PExpression>& args) -> LeObject
 		{
 			/* hook up args */
 			auto& block = *func.body;
@@ -98,7 +98,7 @@ namespace le
 		}
 
 		/* Evaluate and assign a list of arguments */
-		auto init_var_list(std::vector<PExpression>& args, const std::vector<String>& arg_names) -> void
+		auto init_var_list(NodeList<PExpression>& args, const std::vector<String>& arg_names) -> void
 		{
 			const auto expected_args = arg_names.size();
 			const auto provided_args = args.size();
@@ -334,7 +334,7 @@ namespace le
 				arr.data.reserve(expr->container.size());
 				for (auto& ex : expr->container)
 				{
-					arr.data.emplace_back(evaluate(ex.get()));
+					arr.data.emplace_back(MemoryManager::promote(evaluate(ex.get())));
 				} 
 				break;
 			}
@@ -37,21 +37,50 @@ namespace le
 			return "Iterator";
 		}
 
-		auto member_access(LeObject self, const String& member) -> LeObject override
+		auto trace(Tracer& tracer) -> void override
 		{
-			using This = std::remove_reference_t<decltype(*this)>;
+			tracer.mark(owner);
+		}
+
+		auto clear_references() -> void override
+		{
+			owner = LeObject{};
+		}
 
-			if (member == "next")
+		using This = Iterator<_Owner, _Function>;
+		static inline const auto layout = next_layout_id();
+
+		static auto methods() -> std::span<const BuiltinMethod<This>>
+		{
+			static const BuiltinMethod<This> table[] =
 			{
-				return 
-					global::mem->emplace<MemberFunction<This>>(self, [](This& iter, std::span<LeObject>&, class VirtualMachine&)
+				{ "next", [](This& iter, std::span<LeObject>&, class VirtualMachine&) -> LeObject
 					{
 						return iter.function_next(*static_cast<_Owner*>(iter.owner.get()));
-					});
-			}
+					}
+				},
+			};
+			return table;
+		}
 
+		auto member_access(LeObject self, const String& member) -> LeObject override
+		{
+			if (auto slot = member_slot(member); slot != no_slot)
+				return member_at(self, slot);
 			throw(ferr::invalid_member(member));
-			return LeObject{};
+		}
+
+		auto member_layout() const -> u64 override { return layout; }
+		auto member_slot(const String& member) -> u32 override { return find_method(methods(), member); }
+
+		auto member_at(LeObject self, u32 slot) -> LeObject override
+		{
+			return global::mem->emplace_temporary<MemberFunction<This>>(self, methods()[slot].function);
+		}
+
+		auto call_member(LeObject self, u32 slot, std::span<LeObject>& args, class VirtualMachine& vm) -> LeObject override
+		{
+			return methods()[slot].function(*this, args, vm);
 		}
 
 		auto call(std::span<LeObject>&, class VirtualMachine&) -> LeObject override
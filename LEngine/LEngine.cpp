@@ -3,6 +3,7 @@
 #include "Interpreter.h"
 #include "Repl.h"
 #include "unit_tests.h"
+#include "benchmarks.h"
 #include "Runner.h"
 
 #include "Compiler.h"
@@ -96,6 +97,7 @@ end
 )";
 
     //le::unit_test::start();
+    //le::benchmark::start();
     
     le::print_bytecode(source, "__main__");
     auto result = le::run_with_vm(source, "__main__");
@@ -107,12 +109,10 @@ int main(int argc, char** argv)
 {
     auto global_memory_manager = le::MemoryManager();
     le::global::mem = &global_memory_manager;
-    le::global::null = global_memory_manager.emplace<le::NullValue>();
     
     // tree_interpreter_main(argc, argv);
     compiler_main(argc, argv);
 
-    le::global::null.reset();
     return 0;
 }
 
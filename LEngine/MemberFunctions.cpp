@@ -7,6 +7,11 @@ auto le::BuiltinMemberFunction::call(std::span<LeObject>& args, VirtualMachine&
 	return vm.run(_function, args, _this);
 }
 
+auto le::BuiltinMemberFunction::promote() const -> LeObject
+{
+	return global::mem->emplace<BuiltinMemberFunction>(*this);
+}
+
 auto le::BuiltinMemberFunction::type_name() -> String
 {
 	return std::format("{}::{}", _this->type_name(), _function.name);
@@ -3,6 +3,8 @@
 #include <concepts>
 
 #include "Builtin.h"
+#include "Collector.h"
+#include "GlobalState.h"
 
 namespace le
 {
@@ -26,11 +28,44 @@ namespace le
         {
             return "MemberFunction";
         }
+
+        auto trace(Tracer& tracer) -> void override
+        {
+            tracer.mark(_this);
+        }
+
+        auto clear_references() -> void override
+        {
+            _this = LeObject{};
+        }
+
+        auto promote() const -> LeObject override
+        {
+            return global::mem->emplace<MemberFunction>(*this);
+        }
     private:
         LeObject _this{};
         Function _function{};
     };
 
+    /* Entry of the method table of a builtin type, the index of the entry is the slot of the method */
+    template<typename _This>
+    struct BuiltinMethod
+    {
+        StringView name{};
+        typename MemberFunction<_This>::Function function{};
+    };
+
+    /* @return Slot of the method called name, RuntimeValue::no_slot if there is none */
+    template<typename _This>
+    inline auto find_method(std::span<const BuiltinMethod<_This>> methods, const String& name) -> u32
+    {
+        for (auto slot{ 0u }; slot < methods.size(); slot++)
+            if (methods[slot].name == name)
+                return slot;
+        return RuntimeValue::no_slot;
+    }
+
     struct BuiltinMemberFunction
         : RuntimeValue
     {
@@ -44,7 +79,22 @@ namespace le
         auto call(std::span<LeObject>& args, class VirtualMachine& vm) -> LeObject override;
 
         auto type_name() -> String override;
+
+        auto trace(Tracer& tracer) -> void override
+        {
+            tracer.mark(_this);
+        }
+
+        auto clear_references() -> void override
+        {
+            _this = LeObject{};
+        }
+
+        auto promote() const -> LeObject override;
     private:
+        /* Both machines enter _function without going through call */
+        friend class VirtualMachine;
+        friend class RegisterVirtualMachine;
         LeObject _this{};
         const struct Frame& _function;
     };
@@ -0,0 +1,35 @@
+#include "MemoryManager.h"
+#include "GlobalState.h"
+
+#include <memory>
+
+/*
+* Objects are destroyed through their virtual destructor, the block is then handed back to the pool or nursery chunk it came from.
+* Frees are counted as the block is freed, so an object the cycle collector buffered is counted once release_memory frees it.
+*/
+auto le::destroy(RuntimeValue* object) -> void
+{
+    const auto type = object->type;
+    const auto buffered = object->buffered;
+    std::destroy_at(object);
+    if (buffered)
+    { /* The cycle collector still points at it, a dead object with no references takes its place till the collector frees it */
+        auto dead = ::new (object) RuntimeValue();
+        dead->type = type;
+        dead->buffered = true;
+        return;
+    }
+    MemoryManager::free_object_memory(object, type);
+}
+
+auto le::release_memory(RuntimeValue* object) -> void
+{
+    const auto type = object->type;
+    std::destroy_at(object);
+    MemoryManager::free_object_memory(object, type);
+}
+
+auto le::MemoryManager::current() -> MemoryManager*
+{
+    return global::mem;
+}
@@ -1,34 +1,140 @@
 #pragma once
 
+#include "Collector.h"
+
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <array>
 #include <concepts>
 #include <algorithm>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <atomic>
 
 namespace le
 {
+	/* What a MemoryManager holds at one moment, see MemoryManager::stats */
+	struct MemoryStats
+	{
+		struct Counts
+		{
+			size_t allocations{};
+			size_t frees{};
+
+			auto live() const -> size_t { return allocations - frees; }
+		};
+
+		struct SizeClass
+		{
+			size_t block_size{};
+			size_t pools{};
+			size_t empty_pools{}; /* Kept around as spares, see MemoryManager::spare_pools */
+			Counts blocks{};
+		};
+
+		static constexpr auto type_count = static_cast<size_t>(RuntimeValue::Type::Custom) + 1ull;
+
+		std::vector<SizeClass> size_classes{}; /* Only those that have pools */
+		std::array<Counts, type_count> objects{}; /* Indexed by RuntimeValue::Type */
+		Counts nursery{}; /* Objects made by emplace_temporary, counted in objects as well */
+		size_t nursery_chunks{};
+		size_t released_pools{}; /* Pools and nursery chunks given back to the system so far */
+		Counts large{}; /* Allocations bigger than a block */
+		size_t large_bytes{};
+		size_t bytes{}; /* Of the blocks and large allocations in use, objects in the nursery only count towards reserved_bytes */
+		size_t peak_bytes{};
+		size_t reserved_bytes{}; /* Of every pool, nursery chunk and large allocation */
+		Collector::Stats collector{};
+		CycleCollector::Stats cycles{};
+		double seconds{}; /* Since the manager was made, the counts over it are the rates */
+
+		auto live_objects() const -> size_t
+		{
+			auto live = 0ull;
+			for (const auto& counts : objects)
+				live += counts.live();
+			return live;
+		}
+
+		auto of(RuntimeValue::Type type) const -> const Counts& { return objects[static_cast<size_t>(type)]; }
+	};
+
 	/*
+	* Hands out objects from pools of equally sized blocks, one list of pools per size class.
+	* Every pool is allocated on its own and aligned to its size, its first bytes point back to the pool
+	* so the pool of any block is found from the block's address.
+	* Allocating and freeing is constant time no matter how many pools there are:
+	*	Every size class keeps a list of the pools that still have a free block, allocating takes from the first one
+	*	A pool that fills up leaves that list and joins it again once one of its blocks is freed
+	*	A pool that empties goes to the back of that list, a few of them are kept as spares and any more are released right away
+	* The spares keep a program that allocates and frees around a pool boundary from making and releasing the same pool over and over,
+	* trim releases them as well and compact empties nearly empty pools by moving the contents of objects out of them.
+	*
+	* Objects that usually die right away can be bump allocated from the nursery instead, see emplace_temporary.
+	* The contents of objects (array elements, characters of strings...) are allocated through the manager as well, see Allocator.
+	* Everything is counted as it is made and freed, see stats.
+	* With LE_TRACING_GC set the objects referenced by Values are owned by the collector of the manager, see Collector.
+	* Otherwise objects are reference counted and the garbage cycles among them are found by the cycle collector of the manager, see CycleCollector.
+	*
+	* A manager is not synchronized, it belongs to a single thread. With LE_CONCURRENT_MEMORY set every thread has a manager of its own (see global::ThreadMemory)
+	* and memory may be freed by another thread than the one that made it: the freeing thread pushes it to the remote frees of the manager that made it,
+	* which takes them back the next time it allocates. See RemoteFrees.
+	*
 	* Known Issues:
-	* * FATAL: When vector holding pools reallocates, all existing objects in the wild will point to invalid pools.
-	* * FATAL: Need a way to enforce destructing all existing objects before killing this. (Allocating pools on heap)
+	* * Pools, nursery chunks and large allocations that are still in use when the manager is destroyed are left behind, they are freed by their last user.
+	*	With LE_CONCURRENT_MEMORY that user has to be a single thread, a manager should outlive the objects it handed to other threads.
+	* * Reference counts are not atomic even with LE_CONCURRENT_MEMORY, objects are handed over to another thread (see hand_over) and not shared between threads.
 	*/
 	class MemoryManager
 	{
 	public:
 		template<typename _T>
-		using Pointer = std::shared_ptr<_T>;
-		inline static constexpr auto pool_memory_size = 4096ull; /* 4 kb */
+		using Pointer = Ref<_T>;
+		inline static constexpr auto concurrent = static_cast<bool>(LE_CONCURRENT_MEMORY);
+		inline static constexpr auto pool_memory_size = 16384ull; /* 16 kb, also the alignment of a pool and a nursery chunk */
+		/* Pools and nursery chunks start with a pointer back to themselves, padded so the blocks after it stay aligned */
+		inline static constexpr auto region_header_size = alignof(std::max_align_t);
+		/* Set in the header of a nursery chunk, pools are aligned so the bit is free */
+		inline static constexpr auto nursery_tag = std::uintptr_t{ 1 };
+		inline static constexpr auto size_class_step = 8ull;
+		inline static constexpr auto max_block_size = 1024ull;
+		inline static constexpr auto size_class_count = max_block_size / size_class_step;
+		/* Empty pools kept per size class and spare chunks kept by the nursery, emptier ones are released */
+		inline static constexpr auto spare_pools = 2ull;
+		inline static constexpr auto spare_chunks = 2ull;
 	protected:
+		struct Pool;
+
+		/* Counters shared by the pools, nursery and large object space of a manager */
+		struct Telemetry final
+		{
+			MemoryManager* owner{};
+			std::array<MemoryStats::Counts, MemoryStats::type_count> objects{};
+			MemoryStats::Counts nursery{};
+			size_t bytes{};
+			size_t peak_bytes{};
+			size_t released_pools{};
+
+			auto add_bytes(size_t size) -> void
+			{
+				bytes += size;
+				peak_bytes = std::max(peak_bytes, bytes);
+			}
+		};
+
 		struct RawMemory final
 		{
 			size_t size{};
 			std::byte* data{};
 			RawMemory() = default;
+			/* @param size_: Amount of bytes, data is aligned to it */
 			explicit RawMemory(size_t size_)
 				: size(size_)
-				, data((std::byte*)malloc(size_))
+				, data(static_cast<std::byte*>(::operator new(size_, std::align_val_t{ size_ })))
 			{}
 			RawMemory(const RawMemory&) = delete;
 			auto operator=(const RawMemory&) = delete;
@@ -39,43 +145,144 @@ namespace le
 				other.data = nullptr;
 				other.size = 0ull;
 			}
-			~RawMemory() { delete data; }
+			~RawMemory()
+			{
+				if (data)
+					::operator delete(data, std::align_val_t{ size });
+			}
+		};
+
+		/* The pools of one block size */
+		struct SizeClass final
+		{
+			Pool* pools{}; /* Every pool, linked through Pool::next and Pool::previous */
+			Pool* available{}; /* Pools with a free block, linked through Pool::next_available and Pool::previous_available. Empty ones are at the back */
+			Pool* last_available{};
+			size_t pool_count{};
+			size_t empty_pools{};
+			MemoryStats::Counts blocks{};
+			Telemetry* telemetry{};
+
+			auto link(Pool* pool) -> void
+			{
+				pool->next = pools;
+				if (pools)
+					pools->previous = pool;
+				pools = pool;
+				pool_count++;
+				empty_pools++;
+			}
+
+			/* Links pool as the first available pool, allocations take from it next */
+			auto push_available(Pool* pool) -> void
+			{
+				pool->previous_available = nullptr;
+				pool->next_available = available;
+				(available ? available->previous_available : last_available) = pool;
+				available = pool;
+				pool->is_available = true;
+			}
+
+			/* Links pool as the last available pool, allocations only take from it once the others are full */
+			auto append_available(Pool* pool) -> void
+			{
+				pool->next_available = nullptr;
+				pool->previous_available = last_available;
+				(last_available ? last_available->next_available : available) = pool;
+				last_available = pool;
+				pool->is_available = true;
+			}
+
+			auto unlink_available(Pool* pool) -> void
+			{
+				(pool->previous_available ? pool->previous_available->next_available : available) = pool->next_available;
+				(pool->next_available ? pool->next_available->previous_available : last_available) = pool->previous_available;
+				pool->next_available = pool->previous_available = nullptr;
+				pool->is_available = false;
+			}
+
+			/* Deletes an empty pool that is not available */
+			auto release(Pool* pool) -> void
+			{
+				(pool->previous ? pool->previous->next : pools) = pool->next;
+				if (pool->next)
+					pool->next->previous = pool->previous;
+				pool_count--;
+				empty_pools--;
+				telemetry->released_pools++;
+				delete pool;
+			}
+
+			/* Called by Pool::free once the last block of pool is freed, keeps up to spare_pools empty pools */
+			auto emptied(Pool* pool) -> void
+			{
+				if (pool->is_available)
+					unlink_available(pool);
+				if (++empty_pools > spare_pools)
+					release(pool);
+				else if (not pool->evacuating)
+					append_available(pool);
+			}
+
+			/* @return Amount of empty pools released */
+			auto release_empty() -> size_t
+			{
+				auto released = 0ull;
+				for (auto pool = pools; pool; )
+				{
+					auto next = pool->next;
+					if (pool->empty())
+					{
+						if (pool->is_available)
+							unlink_available(pool);
+						release(pool);
+						released++;
+					}
+					pool = next;
+				}
+				return released;
+			}
 		};
 
 		struct Pool final
 		{
 			using MemBlock = std::byte*;
 
-			explicit Pool(size_t object_size)
+			static constexpr auto header_size = region_header_size;
+
+			Pool(size_t object_size, SizeClass& size_class_)
 				: memory(pool_memory_size)
 				, block_size(object_size)
-				, max_size(pool_memory_size / object_size)
+				, max_size((pool_memory_size - header_size) / object_size)
+				, size_class(&size_class_)
 			{
 				init();
 			}
 			Pool(const Pool&) = delete;
-			Pool(Pool&& other) noexcept
-				: memory(std::move(other.memory))
-				, block_size(other.block_size)
-				, next_free_block(other.next_free_block)
-				, max_size(other.max_size)
-				, current_size(other.current_size)
-			{}
+			Pool(Pool&&) = delete;
 
-			size_t block_size{};
 			RawMemory memory{};
+			size_t block_size{};
 			MemBlock next_free_block{ nullptr };
 			size_t max_size{};
 			size_t current_size{};
+			SizeClass* size_class{}; /* Nullptr once the manager is gone */
+			Pool* next{};
+			Pool* previous{};
+			Pool* next_available{};
+			Pool* previous_available{};
+			bool is_available{}; /* Linked in SizeClass::available */
+			bool evacuating{}; /* Kept out of SizeClass::available while compact moves contents out of it */
 
-			/* DO NOT USE AS ITERATOR */ auto _begin() const -> std::byte* { return memory.data; }
-			/* DO NOT USE AS ITERATOR */ auto _end() const -> std::byte* { return memory.data + memory.size; }
+			/* DO NOT USE AS ITERATOR */ auto _begin() const -> std::byte* { return memory.data + header_size; }
+			/* DO NOT USE AS ITERATOR */ auto _end() const -> std::byte* { return _begin() + max_size * block_size; }
 			/* @return Nullptr if obj does not belong to this pool */
 			auto owns(void* obj) const -> bool
 			{
 				return (obj >= _begin() and obj < _end());
 			}
 
+
 			/* Doesn't check if it own's the object */
 			auto _free_block_no_check(void* obj) -> void
 			{
@@ -87,125 +294,685 @@ namespace le
 				current_size--;
 			}
 
+			/* Frees obj and makes the pool available to its size class again, a pool left behind by its manager is deleted along with its last block */
+			static auto free(Pool* pool, void* obj) -> void
+			{
+				pool->_free_block_no_check(obj);
+
+				auto size_class = pool->size_class;
+				if (not size_class)
+				{
+					if (pool->empty())
+						delete pool;
+					return;
+				}
+
+				size_class->blocks.frees++;
+				size_class->telemetry->bytes -= pool->block_size;
+				if (pool->empty())
+					size_class->emptied(pool);
+				else if (not pool->is_available and not pool->evacuating)
+					size_class->push_available(pool);
+			}
+
 			auto full() -> bool { return current_size >= max_size; }
 			auto empty() -> bool { return current_size == 0ull; }
 
 			auto init() -> void
 			{
 				memset(memory.data, 0, memory.size);
-				next_free_block = memory.data;
+				*reinterpret_cast<Pool**>(memory.data) = this;
+				next_free_block = _begin();
 				/*							 Avoid writing out of bounds address to end;                    */
-				for (auto itr = memory.data; itr < memory.data + memory.size - block_size; itr += block_size)
+				for (auto itr = _begin(); itr < _end() - block_size; itr += block_size)
 				{
 					auto block = (MemBlock)itr;
 					*(MemBlock*)block = (MemBlock)(itr + block_size);
 				}
 			}
 
-			template<typename _Type, typename ... _Args> auto emplace(_Args&&... args) -> _Type*
+			/* @return A free block, the pool may not be full */
+			auto take() -> MemBlock
 			{
-				if (full()) throw(std::exception("Tried to emplace an object in full pool"));
-				constexpr auto size = sizeof(_Type);
-				if (size > block_size) throw(std::exception("Tried to allocate object greater than max object size"));
+				if (full()) throw(std::exception("Tried to take a block from a full pool"));
 				auto* block = next_free_block;
 				next_free_block = *(MemBlock*)block; /* Extract the pointer held by the memory block by casting it to a pointer to pointer */
-				::new (block) _Type(std::forward<_Args>(args)...);
 				current_size++;
-				return (_Type*)block;
+				return block;
 			}
 		};
 
+		struct LargeObjectSpace;
+
+		/* Header in front of every large allocation */
+		struct LargeBlock final
+		{
+			LargeObjectSpace* space{}; /* Nullptr once the manager is gone */
+			LargeBlock* previous{};
+			LargeBlock* next{};
+			size_t size{}; /* Bytes after the header */
+		};
+		static_assert(sizeof(LargeBlock) % alignof(std::max_align_t) == 0, "Large allocations have to stay aligned after the header");
+
 		/*
-		* To be provided to a shared_ptr so that it can remove the data within a pool
+		* Allocations bigger than max_block_size, each made on its own with a header in front.
+		* The headers link every large allocation of the manager together, so they are accounted for like the pools.
 		*/
-		template<typename _T> struct Deleter final
+		struct LargeObjectSpace final
 		{
-			Pool* owner{};
+			LargeBlock* blocks{};
+			size_t bytes{};
+			MemoryStats::Counts counts{};
+			Telemetry* telemetry{};
 
-			explicit Deleter(Pool& pool) : owner(&pool) {}
+			LargeObjectSpace() = default;
+			LargeObjectSpace(const LargeObjectSpace&) = delete;
+			auto operator=(const LargeObjectSpace&) = delete;
+
+			~LargeObjectSpace()
+			{ /* Left behind, freed by their owners */
+				for (auto block = blocks; block; block = block->next)
+					block->space = nullptr;
+			}
+
+			auto allocate(size_t size) -> void*
+			{
+				auto block = ::new (::operator new(sizeof(LargeBlock) + size)) LargeBlock{ .space = this, .next = blocks, .size = size };
+				if (blocks)
+					blocks->previous = block;
+				blocks = block;
+				bytes += size;
+				counts.allocations++;
+				telemetry->add_bytes(size);
+				return block + 1;
+			}
 
-			auto operator()(_T* obj) -> void
+			/* Frees memory handed out by allocate */
+			static auto free(void* memory) -> void
 			{
-				if constexpr (not std::is_trivially_destructible<_T>::value)
+				auto block = static_cast<LargeBlock*>(memory) - 1;
+				if (auto space = block->space)
 				{
-					std::destroy_at<_T>(obj);
+					(block->previous ? block->previous->next : space->blocks) = block->next;
+					if (block->next)
+						block->next->previous = block->previous;
+					space->bytes -= block->size;
+					space->counts.frees++;
+					space->telemetry->bytes -= block->size;
 				}
-				/* If obj does not belong to owner we got bigger problems */
-				owner->_free_block_no_check(obj);
+				::operator delete(block);
+			}
+		};
+
+		struct Nursery;
+
+		/*
+		* Bump allocated memory of the nursery, objects are freed by counting them down.
+		* Once every object died the chunk starts over at its beginning, so temporaries that die before the next one is made keep reusing the same bytes.
+		*/
+		struct NurseryChunk final
+		{
+			explicit NurseryChunk(Nursery& nursery_)
+				: memory(pool_memory_size)
+				, top(begin())
+				, nursery(&nursery_)
+			{
+				*reinterpret_cast<std::uintptr_t*>(memory.data) = reinterpret_cast<std::uintptr_t>(this) | nursery_tag;
+			}
+			NurseryChunk(const NurseryChunk&) = delete;
+			NurseryChunk(NurseryChunk&&) = delete;
+
+			RawMemory memory{};
+			std::byte* top{}; /* Next object goes here */
+			size_t live{}; /* Objects made in the chunk that are not freed yet */
+			Nursery* nursery{}; /* Nullptr once the manager is gone */
+			bool retired{}; /* The nursery moved on to another chunk, this one waits for its survivors to die */
+
+			auto begin() const -> std::byte* { return memory.data + region_header_size; }
+			auto fits(size_t size) const -> bool { return top + size <= memory.data + memory.size; }
+
+			/* A retired chunk is handed back to the nursery with its last object, or deleted if the manager is gone */
+			static auto free(NurseryChunk* chunk) -> void
+			{
+				if (--chunk->live != 0)
+					return;
+				chunk->top = chunk->begin();
+				if (not chunk->retired)
+					return;
+
+				if (chunk->nursery)
+					chunk->nursery->spare_chunk(chunk);
+				else
+					delete chunk;
 			}
 		};
+
+		/*
+		* Objects are never moved out of the nursery as Values point at them directly, containers store a copy instead (see promote).
+		* A chunk that fills up while objects in it are still alive is retired, those survivors keep it till the last of them dies.
+		*/
+		struct Nursery final
+		{
+			NurseryChunk* current{};
+			std::vector<NurseryChunk*> chunks{}; /* Every chunk, retired ones included */
+			std::vector<NurseryChunk*> spare{}; /* Retired chunks whose objects all died, up to spare_chunks */
+			Telemetry* telemetry{};
+
+			Nursery() = default;
+			Nursery(const Nursery&) = delete;
+			auto operator=(const Nursery&) = delete;
+
+			~Nursery()
+			{
+				for (auto chunk : chunks)
+				{
+					if (chunk->live == 0)
+						delete chunk;
+					else
+					{ /* Deleted by its last object */
+						chunk->nursery = nullptr;
+						chunk->retired = true;
+					}
+				}
+			}
+
+			/* Keeps chunk for reuse, or releases it if there are enough spares already */
+			auto spare_chunk(NurseryChunk* chunk) -> void
+			{
+				if (spare.size() < spare_chunks)
+				{
+					spare.push_back(chunk);
+					return;
+				}
+				release(chunk);
+			}
+
+			auto release(NurseryChunk* chunk) -> void
+			{
+				std::erase(chunks, chunk);
+				telemetry->released_pools++;
+				delete chunk;
+			}
+
+			/* @return Amount of spare chunks released */
+			auto release_spare() -> size_t
+			{
+				const auto released = spare.size();
+				for (auto chunk : spare)
+					release(chunk);
+				spare.clear();
+				return released;
+			}
+
+			/* @return A chunk with room for size bytes */
+			auto chunk_for(size_t size) -> NurseryChunk*
+			{
+				if (current and current->fits(size))
+					return current;
+
+				if (current)
+					current->retired = true;
+				if (spare.empty())
+				{
+					chunks.push_back(new NurseryChunk(*this));
+					current = chunks.back();
+				}
+				else
+				{
+					current = spare.back();
+					spare.pop_back();
+					current->retired = false;
+				}
+				return current;
+			}
+		};
+
+		/*
+		* Memory freed by other threads than the one owning the manager, a lock free stack the owner empties the next time it allocates.
+		* Entries are linked through the freed memory itself, the low bits of an entry tell what kind of memory it is.
+		* Freed objects keep their type next to the link so the owner can count them.
+		*/
+		struct RemoteFrees final
+		{
+			enum Tag : std::uintptr_t { block = 0, object = 1, large = 2, mask = 3 };
+
+			std::atomic<std::uintptr_t> head{};
+
+			/* Called by any thread, memory has to be aligned to at least 4 bytes */
+			auto push(void* memory, Tag tag, RuntimeValue::Type type = {}) -> void
+			{
+				auto entry = reinterpret_cast<std::uintptr_t*>(memory);
+				if (tag == object)
+					entry[1] = static_cast<std::uintptr_t>(type);
+				auto next = head.load(std::memory_order_relaxed);
+				do entry[0] = next;
+				while (not head.compare_exchange_weak(next, reinterpret_cast<std::uintptr_t>(memory) | tag, std::memory_order_release, std::memory_order_relaxed));
+			}
+
+			auto pending() const -> bool { return head.load(std::memory_order_relaxed) != 0; }
+
+			/* @return Every entry pushed so far, called by the owner only */
+			auto take() -> std::uintptr_t { return head.exchange(0, std::memory_order_acquire); }
+		};
+		static_assert(sizeof(RuntimeValue) >= 2 * sizeof(std::uintptr_t), "Freed objects keep their type after the link");
+
 	protected:
-		std::vector<Pool> _pools{};
+		std::array<SizeClass, size_class_count> _size_classes{};
+		Collector _collector{};
+		CycleCollector _cycles{};
+		Nursery _nursery{};
+		LargeObjectSpace _large_objects{};
+		Telemetry _telemetry{};
+		RemoteFrees _remote{};
+		std::chrono::steady_clock::time_point _made{ std::chrono::steady_clock::now() };
+
+		/* Counts an object made by emplace or emplace_temporary, frees are counted by le::destroy */
+		template<typename _Type>
+		auto count_object(Ref<_Type> object) -> Ref<_Type>
+		{
+			_telemetry.objects[static_cast<size_t>(object->type)].allocations++;
+			return object;
+		}
+
 		constexpr static auto smallest_object_size = 8;
 
-		auto get_pool_of_size(size_t object_size) -> Pool*
+		/* @return Index of the size class holding objects of object_size bytes */
+		constexpr static auto size_class_of(size_t object_size) -> size_t
+		{
+			return (std::max<size_t>(object_size, smallest_object_size) + size_class_step - 1ull) / size_class_step - 1ull;
+		}
+
+		constexpr static auto align_to_nearest_multiple(size_t size) -> size_t
+		{
+			return (size_class_of(size) + 1ull) * size_class_step;
+		}
+
+		/* @return A pool of size class index with a free block */
+		auto get_pool_of_size(size_t index) -> Pool*
+		{
+			auto& size_class = _size_classes[index];
+			if (not size_class.available)
+				make_pool(index);
+			return size_class.available;
+		}
+
+		/* @return A free block of size class index */
+		auto take_block(size_t index) -> std::byte*
 		{
-			for (auto& p : _pools)
+			take_remote_frees();
+			auto& size_class = _size_classes[index];
+			auto pool = get_pool_of_size(index);
+			if (pool->empty())
+				size_class.empty_pools--;
+			auto block = pool->take();
+			size_class.blocks.allocations++;
+			_telemetry.add_bytes(pool->block_size);
+			if (pool->full())
+				size_class.unlink_available(pool);
+			return block;
+		}
+
+		/* Frees what other threads handed back, see RemoteFrees */
+		auto take_remote_frees() -> void
+		{
+			if constexpr (concurrent)
 			{
-				if (not p.full() and p.block_size == object_size)
-					return &p;
+				if (not _remote.pending())
+					return;
+				for (auto entry = _remote.take(); entry; )
+				{
+					const auto memory = reinterpret_cast<std::uintptr_t*>(entry & ~RemoteFrees::mask);
+					const auto tag = entry & RemoteFrees::mask;
+					entry = memory[0];
+					if (tag == RemoteFrees::large)
+						LargeObjectSpace::free(memory);
+					else
+					{
+						if (tag == RemoteFrees::object)
+							count_free(memory, static_cast<RuntimeValue::Type>(memory[1]));
+						free_local(memory);
+					}
+				}
 			}
-			return nullptr;
 		}
 
-		constexpr static auto align_to_nearest_multiple(size_t size) -> size_t
+		/* Frees a block made by a manager of this thread, which of a pool or the nursery is told by its address */
+		static auto free_local(void* block) -> void
+		{
+			const auto header = region_header(block);
+			if (header & nursery_tag)
+				NurseryChunk::free(reinterpret_cast<NurseryChunk*>(header & ~nursery_tag));
+			else
+				Pool::free(reinterpret_cast<Pool*>(header), block);
+		}
+
+		/* @return The manager that has to free memory made through telemetry when it is not the one of this thread, see RemoteFrees */
+		static auto remote_owner(Telemetry* telemetry) -> MemoryManager*
 		{
-			auto arr = std::array<size_t, 8>{};
-			std::generate(arr.begin(), arr.end(), [i = 0ull]() mutable { return (i++) * 8 + 8; });
-			for (const auto a : arr)
+			if constexpr (concurrent)
 			{
-				if (size <= a) return a;
+				if (telemetry and telemetry->owner != current())
+					return telemetry->owner;
 			}
-			return size;
+			return nullptr;
 		}
 
-		auto make_pool(size_t object_size) -> Pool&
+		auto make_pool(size_t index) -> Pool*
 		{
-			return _pools.emplace_back(object_size);
+			auto& size_class = _size_classes[index];
+			auto pool = new Pool((index + 1ull) * size_class_step, size_class);
+			size_class.link(pool);
+			size_class.push_available(pool);
+			return pool;
 		}
 	public:
 		MemoryManager()
 		{
-			_pools.reserve(32); /* Should keep us well till i fix this issue */
+			_telemetry.owner = this;
+			for (auto& size_class : _size_classes)
+				size_class.telemetry = &_telemetry;
+			_nursery.telemetry = &_telemetry;
+			_large_objects.telemetry = &_telemetry;
+		}
+		MemoryManager(const MemoryManager&) = delete;
+		auto operator=(const MemoryManager&) = delete;
+
+		~MemoryManager()
+		{
+			take_remote_frees();
+			_collector.release_all(); /* Its objects may live in the pools below */
+			_cycles.forget_all();
+			for (auto& size_class : _size_classes)
+			{
+				for (auto pool = size_class.pools; pool; )
+				{
+					auto next = pool->next;
+					if (pool->empty())
+						delete pool;
+					else
+						pool->size_class = nullptr; /* Still in use, deleted by its last object */
+					pool = next;
+				}
+			}
+		}
+
+		auto collector() -> Collector& { return _collector; }
+		auto cycles() -> CycleCollector& { return _cycles; }
+
+		/*
+		* Has to be called by the thread handing values to another thread, before that thread uses them.
+		* The objects the values reach stop being candidates of the cycle collector of this manager, see CycleCollector::hand_over.
+		*/
+		auto hand_over(std::span<const LeObject> values) -> void
+		{
+			if constexpr (CycleCollector::enabled)
+			{
+				auto roots = std::vector<RuntimeValue*>{};
+				for (const auto& value : values)
+					if (value.is_object())
+						roots.push_back(value.object());
+				_cycles.hand_over(roots);
+			}
+		}
+
+		/* @return The header of the pool or nursery chunk holding block, see region_header_size */
+		static auto region_header(void* block) -> std::uintptr_t
+		{
+			const auto memory = reinterpret_cast<std::uintptr_t>(block) & ~(pool_memory_size - 1ull);
+			return *reinterpret_cast<std::uintptr_t*>(memory);
+		}
+
+		/* @return The manager of this thread, global::mem. Defined in MemoryManager.cpp */
+		static auto current() -> MemoryManager*;
+
+		/* Frees a block made by a pool or the nursery without destroying what it holds, a block made on another thread is handed back to its manager */
+		static auto free_memory(void* block) -> void
+		{
+			if (auto owner = remote_owner(telemetry_of(block)))
+				owner->_remote.push(block, RemoteFrees::block);
+			else
+				free_local(block);
+		}
+
+		/* Counts and frees the block of an object that is destroyed already, called by le::destroy and le::release_memory */
+		static auto free_object_memory(void* block, RuntimeValue::Type type) -> void
+		{
+			if (auto owner = remote_owner(telemetry_of(block)))
+				owner->_remote.push(block, RemoteFrees::object, type);
+			else
+			{
+				count_free(block, type);
+				free_local(block);
+			}
+		}
+
+		/* @return The counters of the manager that made block, nullptr if the manager is gone */
+		static auto telemetry_of(void* block) -> Telemetry*
+		{
+			const auto header = region_header(block);
+			if (header & nursery_tag)
+			{
+				const auto nursery = reinterpret_cast<NurseryChunk*>(header & ~nursery_tag)->nursery;
+				return nursery ? nursery->telemetry : nullptr;
+			}
+			const auto size_class = reinterpret_cast<Pool*>(header)->size_class;
+			return size_class ? size_class->telemetry : nullptr;
+		}
+
+		/* Counts the object of type that was held by block as freed */
+		static auto count_free(void* block, RuntimeValue::Type type) -> void
+		{
+			if (auto telemetry = telemetry_of(block))
+			{
+				telemetry->objects[static_cast<size_t>(type)].frees++;
+				if (region_header(block) & nursery_tag)
+					telemetry->nursery.frees++;
+			}
+		}
+
+		/* @return Everything counted so far along with what the manager holds now */
+		auto stats() -> MemoryStats
+		{
+			take_remote_frees();
+			auto stats = MemoryStats{};
+			auto pools = 0ull;
+			for (auto index{ 0ull }; index < _size_classes.size(); index++)
+			{
+				const auto& size_class = _size_classes[index];
+				if (size_class.pool_count == 0)
+					continue;
+				stats.size_classes.push_back(MemoryStats::SizeClass{
+					.block_size = (index + 1ull) * size_class_step, .pools = size_class.pool_count, .empty_pools = size_class.empty_pools, .blocks = size_class.blocks });
+				pools += size_class.pool_count;
+			}
+
+			stats.objects = _telemetry.objects;
+			stats.nursery = _telemetry.nursery;
+			stats.nursery_chunks = _nursery.chunks.size();
+			stats.released_pools = _telemetry.released_pools;
+			stats.large = _large_objects.counts;
+			stats.large_bytes = _large_objects.bytes;
+			stats.bytes = _telemetry.bytes;
+			stats.peak_bytes = _telemetry.peak_bytes;
+			stats.reserved_bytes = (pools + stats.nursery_chunks) * pool_memory_size + stats.large_bytes;
+			stats.collector = _collector.stats();
+			stats.cycles = _cycles.stats();
+			stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _made).count();
+			return stats;
+		}
+
+		/* @return Bytes given back to the system, every empty pool and spare nursery chunk is released */
+		auto trim() -> size_t
+		{
+			take_remote_frees();
+			auto released = _nursery.release_spare();
+			for (auto& size_class : _size_classes)
+				released += size_class.release_empty();
+			return released * pool_memory_size;
+		}
+
+		/*
+		* Empties pools that are at most max_occupancy full by moving the contents of objects out of them, then trims.
+		* Objects themselves never move as Values point at them directly, only contents allocated through Allocator can (see RuntimeValue::relocate).
+		* The objects are found through the collector so without LE_TRACING_GC this only trims.
+		* Contents are moved through global::mem so it has to be called on that manager, and only where no native code holds on to contents. VirtualMachine::safepoint compacts after every collection.
+		* @return Bytes given back to the system, not counting the pools made for the moved contents
+		*/
+		auto compact(double max_occupancy = 0.25) -> size_t
+		{
+			const auto released = _telemetry.released_pools; /* Pools emptied while moving are released right away */
+			if constexpr (Collector::enabled)
+			{
+				auto evacuating = false;
+				for (auto& size_class : _size_classes)
+				{
+					if (size_class.pool_count - size_class.empty_pools < 2ull)
+						continue; /* Nothing to merge with */
+					for (auto pool = size_class.pools; pool; pool = pool->next)
+					{
+						if (pool->empty() or pool->current_size > max_occupancy * pool->max_size)
+							continue;
+						if (pool->is_available)
+							size_class.unlink_available(pool);
+						pool->evacuating = true;
+						evacuating = true;
+					}
+				}
+
+				if (evacuating)
+				{
+					_collector.for_each([](RuntimeValue* object) { object->relocate(); });
+					for (auto& size_class : _size_classes)
+					{
+						for (auto pool = size_class.pools; pool; pool = pool->next)
+						{
+							if (not pool->evacuating)
+								continue;
+							pool->evacuating = false;
+							if (pool->empty())
+								size_class.append_available(pool);
+							else if (not pool->full())
+								size_class.push_available(pool);
+						}
+					}
+				}
+			}
+			trim();
+			return (_telemetry.released_pools - released) * pool_memory_size;
+		}
+
+		/* @return Whether memory of size bytes is in a pool compact is moving contents out of */
+		static auto evacuating(const void* memory, size_t size) -> bool
+		{
+			if (size > max_block_size)
+				return false;
+			const auto header = region_header(const_cast<void*>(memory));
+			return not (header & nursery_tag) and reinterpret_cast<Pool*>(header)->evacuating;
 		}
 
+		/* @return The pool holding object, it has to be made by a pool */
 		auto find_pool(void* object) -> Pool*
 		{
-			for (auto& pool : _pools)
-				if (pool.owns(object))
-					return &pool;
-			return nullptr;
+			return reinterpret_cast<Pool*>(region_header(object));
 		}
 
+		/* @return The object made in a pool, it is destroyed along with the last Ref or Value referencing it. See le::destroy */
 		template<typename _Type, typename... _Args>
-		auto emplace(_Args&&... args) -> auto
+		auto emplace(_Args&&... args) -> Ref<_Type>
 		{
-			constexpr auto size = align_to_nearest_multiple(sizeof(_Type));
-			auto pool = get_pool_of_size(size);
+			static_assert(std::derived_from<_Type, RuntimeValue>, "Only objects count their references");
+			static_assert(sizeof(_Type) <= max_block_size, "Type is too large for the pools");
+			static_assert(alignof(_Type) <= size_class_step, "Type needs a stronger alignment than blocks have");
+			auto block = take_block(size_class_of(sizeof(_Type)));
+
+			try
+			{
+				return count_object(Ref<_Type>(::new (block) _Type(std::forward<_Args>(args)...)));
+			}
+			catch (...)
+			{
+				free_memory(block);
+				throw;
+			}
+		}
 
-			if ((not pool) or (pool->full()))
+		/*
+		* Memory for the contents of objects, see Allocator.
+		* Up to max_block_size bytes are taken from the pools, anything bigger from the large object space.
+		*/
+		auto allocate(size_t size) -> void*
+		{
+			if (size > max_block_size)
 			{
-				pool = &make_pool(size);
+				take_remote_frees();
+				return _large_objects.allocate(size);
 			}
+			return take_block(size_class_of(size));
+		}
 
-			auto ptr = pool->emplace<_Type>(std::forward<_Args>(args)...);
-			return std::shared_ptr<_Type>(ptr, Deleter<_Type>(*pool));
+		/* @param size: The size memory was allocated with, it tells where the memory came from */
+		static auto deallocate(void* memory, size_t size) -> void
+		{
+			if (size > max_block_size)
+			{
+				const auto space = (static_cast<LargeBlock*>(memory) - 1)->space;
+				if (auto owner = remote_owner(space ? space->telemetry : nullptr))
+					owner->_remote.push(memory, RemoteFrees::large);
+				else
+					LargeObjectSpace::free(memory);
+			}
+			else
+				free_memory(memory);
+		}
+
+		auto large_objects() const -> const LargeObjectSpace& { return _large_objects; }
+
+		/*
+		* Same as emplace but bump allocated from the nursery, for objects that are expected to die within a few instructions
+		* like bound members and the characters of a string. Objects that do survive hold on to their chunk, so the types made here
+		* are immutable and override RuntimeValue::promote, containers keep a copy of them instead. See promote
+		*/
+		template<typename _Type, typename... _Args>
+		auto emplace_temporary(_Args&&... args) -> Ref<_Type>
+		{
+			static_assert(std::derived_from<_Type, RuntimeValue>, "Only objects count their references");
+			static_assert(sizeof(_Type) <= max_block_size, "Type is too large for the nursery");
+			static_assert(alignof(_Type) <= size_class_step, "Type needs a stronger alignment than the nursery has");
+			constexpr auto size = align_to_nearest_multiple(sizeof(_Type));
+			take_remote_frees();
+			auto chunk = _nursery.chunk_for(size);
+
+			auto ptr = ::new (chunk->top) _Type(std::forward<_Args>(args)...);
+			chunk->top += size;
+			chunk->live++;
+			_telemetry.nursery.allocations++;
+			return count_object(Ref<_Type>(ptr));
+		}
+
+		/*
+		* @return value, or a copy made by emplace if its object lives in the nursery.
+		* Arrays, members and static variables store values through it, they may keep any number of them while a variable only keeps the last one.
+		* A single survivor would otherwise keep its whole chunk alive.
+		*/
+		static auto promote(const LeObject& value) -> LeObject
+		{
+			if (value.is_object() and (region_header(value.object()) & nursery_tag))
+				return value->promote();
+			return value;
 		}
 
 		auto free_block(auto block) -> void
 			requires std::is_pointer<decltype(block)>::value
 	{
 		if (not block) return;
-		if (auto pool = find_pool((void*)block))
-			pool->_free_block_no_check((void*)block);
+		free_memory((void*)block);
 	}
 
-		/* Tries to find the object in its pools to free it */
+		/* Frees the block of the object without destroying it */
 		auto free_object(auto object) -> void
 		requires std::is_pointer<decltype(object)>::value
 	{
-		if (auto pool = find_pool((void*)object))
-			pool->_free_block_no_check((void*)object);
+		free_memory((void*)object);
 	}
 
 		auto highlight_free_spots(const Pool& p, std::ostream& out) const -> void
@@ -222,8 +989,8 @@ namespace le
 	{
 		out << '[';
 		auto step = p.block_size;
-		auto end = p.memory.data + p.memory.size;
-		for (auto mem = p.memory.data; mem != end; mem += step)
+		auto end = p._end();
+		for (auto mem = p._begin(); mem != end; mem += step)
 		{
 			auto block = *(Pool::MemBlock*)mem;
 			/*
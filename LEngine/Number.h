@@ -36,24 +36,20 @@ namespace le
 		{
 			auto lval = number;
 			auto rval = Number{};
-			auto result = global::mem->emplace<NumberValue>();
 
-			switch (other->type)
-			{
-				case Type::NumericLiteral:
-					rval = static_cast<const NumberValue*>(other.get())->number; break;
-				case Type::Boolean:
-					rval = static_cast<Number>(static_cast<const Boolean*>(other.get())->val); break;
-				default:
-					throw(ferr::invalid_operation(op, to_string(type), to_string(other->type)));
-			}
+			if (other.is_number())
+				rval = other.as_number();
+			else if (other.is_bool())
+				rval = static_cast<Number>(other.as_bool());
+			else
+				throw(ferr::invalid_operation(op, to_string(type), to_string(other.type())));
 
 			switch (op)
 			{
-			case Token::Type::OperatorPlus:		result->number = lval + rval; break;
-			case Token::Type::OperatorMinus:	result->number = lval - rval; break;
-			case Token::Type::OperatorDivide:	result->number = lval / rval; break;
-			case Token::Type::OperatorMultiply: result->number = lval * rval; break;
+			case Token::Type::OperatorPlus:		return make_number_val(lval + rval);
+			case Token::Type::OperatorMinus:	return make_number_val(lval - rval);
+			case Token::Type::OperatorDivide:	return make_number_val(lval / rval);
+			case Token::Type::OperatorMultiply: return make_number_val(lval * rval);
 			case Token::Type::OperatorGET:  return Boolean::make_bool(lval >= rval);
 			case Token::Type::OperatorGT:	return Boolean::make_bool(lval >  rval);
 			case Token::Type::OperatorLET:	return Boolean::make_bool(lval <= rval);
@@ -61,30 +57,29 @@ namespace le
 			case Token::Type::OperatorEq:	return Boolean::make_bool(lval == rval);
 			case Token::Type::OperatorNEq:	return Boolean::make_bool(lval != rval);
 			default:
-				throw(ferr::invalid_operation(op, to_string(type), to_string(other->type))); break;
+				throw(ferr::invalid_operation(op, to_string(type), to_string(other.type()))); break;
 			}
 
-			return result;
+			return LeObject{};
 		}
 
 		auto apply_operation(Token::Type op) -> LeObject override
 		{
-			auto result = global::mem->emplace<NumberValue>();
-
 			switch (op)
 			{
-			case Token::Type::OperatorPlus:		result->number = +number; break;
-			case Token::Type::OperatorMinus:	result->number = -number; break;
+			case Token::Type::OperatorPlus:		return make_number_val(+number);
+			case Token::Type::OperatorMinus:	return make_number_val(-number);
 			default:
 				throw(ferr::invalid_operation(op, to_string(type))); break;
 			}
 
-			return result;
+			return LeObject{};
 		}
 
+		/* Numbers are immediates, this never allocates */
 		inline static auto make_number_val(Number n) -> LeObject
 		{
-			return global::mem->emplace<NumberValue>(n);
+			return LeObject::from_number(n);
 		}
 	
 		auto to_native_bool() const -> bool override
@@ -93,12 +88,12 @@ namespace le
 		}
 	};
 
-	inline auto to_numeric_index(const RuntimeValue& val) -> u64
+	inline auto to_numeric_index(const LeObject& val) -> u64
 	{
-		if (val.type != RuntimeValue::Type::NumericLiteral)
-			throw(ferr::make_exception(std::format("Cannot create numeric index from {}", to_string(val.type))));
+		if (not val.is_number())
+			throw(ferr::make_exception(std::format("Cannot create numeric index from {}", to_string(val.type()))));
 
-		auto index = static_cast<const NumberValue*>(&val)->number;
+		auto index = val.as_number();
 		const auto is_integer = floor(index) == index; /* floor(50.5) == 50 so 50.5 == 50 is false */
 		if (not is_integer)
 		{
@@ -12,10 +12,12 @@
 
 namespace le
 {	
+	/* The nodes are made by arena, they are all released at once along with the AST */
 	struct AST
 	{
 		String error{};
-		std::vector<PStatement> body{};
+		std::unique_ptr<Arena> arena{ std::make_unique<Arena>() }; /* Behind a pointer so it stays put when the AST is moved */
+		NodeList<PStatement> body{ *arena };
 	};
 
 	class Parser
@@ -26,9 +28,9 @@ namespace le
 		String _error_state{};
 
 		/* Expects AT LEAST ONE argument */
-		auto parse_comma_list(Token::Type delim = Token::Type::Comma) -> std::vector<PExpression>
+		auto parse_comma_list(Token::Type delim = Token::Type::Comma) -> NodeList<PExpression>
 		{
-			auto container = std::vector<PExpression>{};
+			auto container = NodeList<PExpression>(*_ast.arena);
 
 			auto elem = parse_assignment_expr();
 			container.emplace_back(std::move(elem));
@@ -44,7 +46,7 @@ namespace le
 
 		auto parse_array() -> PExpression
 		{
-			auto expr = std::make_unique<ArrayExpression>();
+			auto expr = make_node<ArrayExpression>(*_ast.arena);
 
 			if (_lexer->current().type != Token::Type::CloseSquareBracket)
 			{
@@ -71,7 +73,7 @@ namespace le
 				{
 				case Token::Type::OpenParen:
 				{
-					auto call_expr = std::make_unique<CallExpression>();
+					auto call_expr = make_node<CallExpression>(*_ast.arena);
 					call_expr->target = std::move(target);
 					/* Make sure it isnt a function with no args */
 					if (/* Skip open paren */_lexer->advance().type != Token::Type::CloseParen)
@@ -92,7 +94,7 @@ namespace le
 					{
 						_lexer->advance(); /* Skip dot */
 						expect(Token::Type::Identifier);
-						target = make_member_expression(target, _lexer->eat() /* Skip identifier */);
+						target = make_member_expression(*_ast.arena, target, _lexer->eat() /* Skip identifier */);
 					}
 
 					// target = parse_accessor_group_expr(std::move(target));
@@ -103,7 +105,7 @@ namespace le
 				{
 					_lexer->advance(); /* Skip open square bracket */
 					auto query = parse_assignment_expr();
-					target = make_accessor_expression(target, query);
+					target = make_accessor_expression(*_ast.arena, target, query);
 					if (_lexer->current().type == Token::Type::CloseSquareBracket)
 					{
 						_lexer->advance(); /* Skip close square bracket */
@@ -134,7 +136,7 @@ namespace le
 			{
 				auto op = _lexer->eat();
 				auto right = parse_accessors_expr();
-				left = make_binary_operation(left, right, op);
+				left = make_binary_operation(*_ast.arena, left, right, op);
 			}
 
 			return left;
@@ -152,7 +154,7 @@ namespace le
 			{
 				auto op = _lexer->eat();
 				auto right = parse_multiplicative_expr();
-				left = make_binary_operation(left, right, op);
+				left = make_binary_operation(*_ast.arena, left, right, op);
 			}
 
 			return left;
@@ -170,7 +172,7 @@ namespace le
 			{
 				auto op = _lexer->eat();
 				auto right = parse_relational_expr();
-				left = make_binary_operation(left, right, op);
+				left = make_binary_operation(*_ast.arena, left, right, op);
 			}
 
 			return left;
@@ -188,7 +190,7 @@ namespace le
 			{
 				auto op = _lexer->eat();
 				auto right = parse_relational_expr();
-				left = make_binary_operation(left, right, op);
+				left = make_binary_operation(*_ast.arena, left, right, op);
 			}
 
 			return left;
@@ -207,9 +209,9 @@ namespace le
 				auto op = _lexer->eat().type;
 				auto right = parse_assignment_expr();
 				if (op == Token::Type::OperatorWalrus)
-					left = make_assignment<AssignmentExpression>(left, right);
+					left = make_assignment<AssignmentExpression>(*_ast.arena, left, right);
 				else
-					left = make_assignment<AssignmentStatement>(left, right);
+					left = make_assignment<AssignmentStatement>(*_ast.arena, left, right);
 			}
 
 			return left;
@@ -236,9 +238,9 @@ namespace le
 			throw(ferr::unexpected_expression(String(to_string(type)), String(to_string(got->type))));
 		}
 
-		auto parse_function_args() -> std::vector<Symbol>
+		auto parse_function_args() -> NodeList<Symbol>
 		{
-			auto args = std::vector<Symbol>{};
+			auto args = NodeList<Symbol>(*_ast.arena);
 			expect(Token::Type::OpenParen);
 			_lexer->advance(); /* Skip open paren */
 			/* We are here: 'arg1, arg2)' */
@@ -258,7 +260,7 @@ namespace le
 		}
 
 		/* Basic block statement parse that uses keyword end and skips it */
-		auto parse_block_statement() -> std::unique_ptr<BlockStatement>
+		auto parse_block_statement() -> Node<BlockStatement>
 		{
 			auto block = parse_block_statement(Token::Type::KeywordEnd);
 			expect(Token::Type::KeywordEnd); _lexer->advance(); /* Skip keyword end */
@@ -266,11 +268,11 @@ namespace le
 		}
 
 		/* Not skipping end delim requires type(delims) == Token::Type */
-		auto parse_block_statement(auto... delims) -> std::unique_ptr<BlockStatement>
+		auto parse_block_statement(auto... delims) -> Node<BlockStatement>
 		{
 			static_assert(sizeof...(delims) > 0);
 
-			auto block = std::make_unique<BlockStatement>();
+			auto block = make_node<BlockStatement>(*_ast.arena);
 			
 			while ((... and (_lexer->current().type != delims)))
 			{
@@ -286,7 +288,7 @@ namespace le
 		/* fn name(arg1, arg2) || fn(arg1, arg2) */
 		auto parse_function_declaration() -> PExpression
 		{
-			auto fn = std::make_unique<FunctionDeclaration>();
+			auto fn = make_node<FunctionDeclaration>(*_ast.arena);
 			/* Case: fn name(arg1, arg2) */
 			if (_lexer->current().type == Token::Type::Identifier)
 			{
@@ -310,13 +312,13 @@ namespace le
 			{
 			case Token::Type::KeywordNull:
 				_lexer->advance(); /* Skip Null keyword */
-				return std::make_unique<NullLiteral>();
+				return make_node<NullLiteral>(*_ast.arena);
 			case Token::Type::Identifier:
-				return make_identifier(_lexer->eat());
+				return make_identifier(*_ast.arena, _lexer->eat());
 			case Token::Type::StringLiteral:
-				return make_string_literal(_lexer->eat());
+				return make_string_literal(*_ast.arena, _lexer->eat());
 			case Token::Type::NumericLiteral:
-				return make_numeric_literal(_lexer->eat(), _error_state);
+				return make_numeric_literal(*_ast.arena, _lexer->eat(), _error_state);
 			case Token::Type::KeywordFn:
 			{
 				_lexer->eat(); /* Skip keyword */
@@ -351,7 +353,7 @@ namespace le
 				{
 					auto op = _lexer->eat();
 					auto target = parse_primary_expr();
-					return make_unary_operation(target, op);
+					return make_unary_operation(*_ast.arena, target, op);
 				}
 
 				throw(ferr::unexpected_token(_lexer->current()));
@@ -361,7 +363,7 @@ namespace le
 
 		auto parse_assignment_statement() -> PStatement
 		{
-			auto assignment = std::make_unique<VarAssignment>();
+			auto assignment = make_node<VarAssignment>(*_ast.arena);
 			auto target = _lexer->eat();
 			
 			if (target.type != Token::Type::Identifier)
@@ -390,7 +392,7 @@ namespace le
 		*/
 		auto parse_if_statement() -> PStatement
 		{
-			auto if_stmt = std::make_unique<IfStatement>();
+			auto if_stmt = make_node<IfStatement>(*_ast.arena);
 			if_stmt->test = parse_assignment_expr();
 			expect(Token::Type::Colon); _lexer->advance();
 			if_stmt->consequent = parse_block_statement(Token::Type::KeywordEnd, Token::Type::KeywordElif, Token::Type::KeywordElse);
@@ -423,7 +425,7 @@ namespace le
 		*/
 		auto parse_while_loop() -> PStatement
 		{
-			auto while_loop = std::make_unique<WhileLoop>();
+			auto while_loop = make_node<WhileLoop>(*_ast.arena);
 			while_loop->expr = parse_assignment_expr();
 			expect(Token::Type::Colon); _lexer->advance();
 
@@ -436,7 +438,7 @@ namespace le
 
 		auto parse_for_loop() -> PStatement
 		{
-			auto loop = std::make_unique<ForLoop>();
+			auto loop = make_node<ForLoop>(*_ast.arena);
 			expect(Token::Type::Identifier);
 			loop->var = _lexer->eat().raw;
 			expect(Token::Type::OperatorIn);
@@ -450,7 +452,7 @@ namespace le
 
 		auto parse_class_declaration() -> PStatement
 		{
-			auto class_stmt = std::make_unique<ClassDeclaration>();
+			auto class_stmt = make_node<ClassDeclaration>(*_ast.arena);
 			class_stmt->name = eat(Token::Type::Identifier).raw;
 			eat(Token::Type::Colon);
 			while (
@@ -486,19 +488,19 @@ namespace le
 				return parse_assignment_statement();
 			case Token::Type::KeywordContinue:
 				_lexer->advance(); /* Skip keyword */
-				return std::make_unique<ContinueStatement>();
+				return make_node<ContinueStatement>(*_ast.arena);
 			case Token::Type::KeywordBreak:
 				_lexer->advance(); /* Skip keyword */
-				return std::make_unique<BreakStatement>();
+				return make_node<BreakStatement>(*_ast.arena);
 			case Token::Type::KeywordReturn:
 				_lexer->advance(); /* Skip keyword */
 				if (_lexer->current().type == Token::Type::KeywordEnd) /* No expr */
-					return std::make_unique<ReturnExpression>();
-				return std::make_unique<ReturnExpression>(parse_assignment_expr());
+					return make_node<ReturnExpression>(*_ast.arena);
+				return make_node<ReturnExpression>(*_ast.arena, parse_assignment_expr());
 			case Token::Type::KeywordImport: 
 			{
 				_lexer->advance(); /* Skip keyword */
-				auto import_statement = std::make_unique<ImportStatement>();
+				auto import_statement = make_node<ImportStatement>(*_ast.arena);
 				expect(Token::Type::StringLiteral);
 				import_statement->target = _lexer->eat().raw;
 				expect(Token::Type::KeywordAs);
@@ -516,6 +518,7 @@ namespace le
 		auto parse(Lexer& lexer) -> AST&&
 		{
 			_error_state.clear();
+			_ast = AST{};
 			_lexer = &lexer;
 			_lexer->advance();
 
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "ByteCode.h"
+
+#include <vector>
+
+namespace le
+{
+	namespace peephole
+	{
+		/* @return Whether op jumps by a delta relative to itself, for both backends */
+		inline auto is_jump(OpCode op) -> bool
+		{
+			switch (op)
+			{
+			case OpCode::Jump: case OpCode::JumpIfTrue: case OpCode::JumpIfFalse:
+			case OpCode::JumpIfNotGT: case OpCode::JumpIfNotGET: case OpCode::JumpIfNotLT:
+			case OpCode::JumpIfNotLET: case OpCode::JumpIfNotEQ: case OpCode::JumpIfNotNEQ:
+			case OpCode::JumpIfNotGTNum: case OpCode::JumpIfNotGETNum: case OpCode::JumpIfNotLTNum:
+			case OpCode::JumpIfNotLETNum: case OpCode::JumpIfNotEQNum: case OpCode::JumpIfNotNEQNum:
+			case OpCode::ForLoop: case OpCode::GuardNumbers:
+			case OpCode::RegJumpIfFalse: case OpCode::RegJumpIfNotGT: case OpCode::RegJumpIfNotGET:
+			case OpCode::RegJumpIfNotLT: case OpCode::RegJumpIfNotLET: case OpCode::RegJumpIfNotEQ:
+			case OpCode::RegJumpIfNotNEQ: case OpCode::RegForLoop:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/* The delta of a jump lives in another operand depending on the opcode */
+		inline auto delta_of(const Instruction& jump) -> i64
+		{
+			if (jump.op == OpCode::ForLoop)
+				return jump.operand.loop.delta;
+			if (jump.op == OpCode::GuardNumbers)
+				return jump.operand.guard.delta;
+			if (jump.op >= OpCode::RegMove)
+				return jump.operand.reg.c;
+			return jump.operand.integer;
+		}
+
+		inline auto set_delta(Instruction& jump, i64 delta) -> void
+		{
+			if (jump.op == OpCode::ForLoop)
+				jump.operand.loop.delta = static_cast<i32>(delta);
+			else if (jump.op == OpCode::GuardNumbers)
+				jump.operand.guard.delta = static_cast<i32>(delta);
+			else if (jump.op >= OpCode::RegMove)
+				jump.operand.reg.c = static_cast<i32>(delta);
+			else
+				jump.operand.integer = delta;
+		}
+
+		/* Instructions that only push a value, dropping it right away is the same as never pushing it */
+		inline auto is_pure_push(OpCode op) -> bool
+		{
+			switch (op)
+			{
+			case OpCode::PushNull: case OpCode::PushReal: case OpCode::PushGlobal:
+			case OpCode::Load: case OpCode::LoadGlobal: case OpCode::DupTos:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		inline auto ends_function(OpCode op) -> bool
+		{
+			return op == OpCode::Return or op == OpCode::ReturnExpr or op == OpCode::RegReturn or op == OpCode::Halt;
+		}
+
+		/* @return For every index, and the one past the end, whether a jump lands on it */
+		inline auto jump_targets(const ByteCode& code) -> std::vector<bool>
+		{
+			auto targets = std::vector<bool>(code.size() + 1ull);
+			for (auto index{ 0ll }; index < static_cast<i64>(code.size()); index++)
+			{
+				if (not is_jump(code[index].op))
+					continue;
+				const auto target = index + delta_of(code[index]);
+				if (target >= 0 and target <= static_cast<i64>(code.size()))
+					targets[target] = true;
+			}
+			return targets;
+		}
+
+		/*
+		* Points jumps landing on an unconditional Jump at where that one goes, and replaces a Jump to a return by the return itself.
+		* Only a Jump goes back over a Jump that goes backwards, the machines reach their safepoints at Jumps and calls (see VirtualMachine::safepoint)
+		* so a loop whose back edge became a conditional jump would never collect.
+		* @return Whether anything changed
+		*/
+		inline auto thread_jumps(ByteCode& code) -> bool
+		{
+			const auto size = static_cast<i64>(code.size());
+			auto changed = false;
+			for (auto index{ 0ll }; index < size; index++)
+			{
+				auto& jump = code[index];
+				if (not is_jump(jump.op))
+					continue;
+
+				auto target = index + delta_of(jump);
+				for (auto hops{ 0ll }; hops < size and target >= 0 and target < size and code[target].op == OpCode::Jump and target != index; hops++)
+				{
+					const auto next = target + delta_of(code[target]);
+					if (next <= index and jump.op != OpCode::Jump)
+						break;
+					target = next;
+				}
+				if (target < 0 or target > size)
+					continue;
+
+				if (jump.op == OpCode::Jump and target < size and ends_function(code[target].op))
+				{
+					jump = code[target];
+					changed = true;
+				}
+				else if (target != index + delta_of(jump))
+				{
+					set_delta(jump, target - index);
+					changed = true;
+				}
+			}
+			return changed;
+		}
+
+		/* @return For every local, how many instructions read it. The loop state of a for loop counts as read by its GetIter and ForLoop */
+		inline auto local_reads(const ByteCode& code) -> std::vector<size_t>
+		{
+			auto reads = std::vector<size_t>{};
+			auto read = [&reads](size_t first, size_t count)
+			{
+				if (reads.size() < first + count)
+					reads.resize(first + count);
+				for (auto slot{ first }; slot < first + count; slot++)
+					reads[slot]++;
+			};
+			for (const auto& instruction : code)
+			{
+				if (instruction.op == OpCode::Load)
+					read(instruction.operand.uinteger, 1ull);
+				else if (instruction.op == OpCode::GetIter)
+					read(instruction.operand.uinteger, 3ull);
+				else if (instruction.op == OpCode::ForLoop)
+					read(instruction.operand.loop.state, 3ull);
+			}
+			return reads;
+		}
+
+		/* @return Whether none of the instructions after the first of a sequence at index is jumped to */
+		inline auto entered_at_start(const std::vector<bool>& targets, size_t index, size_t length) -> bool
+		{
+			for (auto offset{ 1ull }; offset < length; offset++)
+				if (targets[index + offset])
+					return false;
+			return true;
+		}
+
+		/* Marks the instructions that do nothing, @return Amount marked */
+		inline auto mark_redundant(const ByteCode& code, std::vector<bool>& removed) -> size_t
+		{
+			const auto targets = jump_targets(code);
+			const auto reads = local_reads(code);
+			auto marked = 0ull;
+			auto mark = [&](size_t index) { removed[index] = true; marked++; };
+
+			for (auto index{ 0ull }; index < code.size(); index++)
+			{
+				const auto& instruction = code[index];
+				const auto next = index + 1ull < code.size() ? code[index + 1ull].op : OpCode::Halt;
+
+				if (instruction.op == OpCode::Noop)
+					mark(index);
+				else if (instruction.op == OpCode::Jump and instruction.operand.integer == 1)
+					mark(index);
+				else if (instruction.op == OpCode::RegMove and instruction.operand.reg.a == instruction.operand.reg.b)
+					mark(index);
+				else if (is_pure_push(instruction.op) and index + 1ull < code.size() and next == OpCode::Pop and entered_at_start(targets, index, 2))
+				{ /* PushNull; Pop */
+					mark(index);
+					mark(++index);
+				}
+				else if (instruction.op == OpCode::Store and next == OpCode::Load and code[index + 1ull].operand.uinteger == instruction.operand.uinteger
+					and reads[instruction.operand.uinteger] == 1ull and entered_at_start(targets, index, 2))
+				{ /* Store n; Load n where nothing else reads n leaves the value on the stack */
+					mark(index);
+					mark(++index);
+				}
+				else if (instruction.op == OpCode::DupTos and index + 2ull < code.size() and (next == OpCode::Store or next == OpCode::StoreGlobal)
+					and code[index + 2ull].op == OpCode::Pop and entered_at_start(targets, index, 3))
+				{ /* DupTos; StoreGlobal; Pop is StoreGlobal */
+					mark(index);
+					mark(index + 2ull);
+					index += 2ull;
+				}
+			}
+			return marked;
+		}
+
+		/* Drops the removed instructions, jumps are retargeted and a jump to a removed instruction lands on the one after it */
+		inline auto compact(ByteCode& code, const std::vector<bool>& removed) -> void
+		{
+			auto new_index = std::vector<i64>(code.size() + 1ull);
+			auto kept = 0ll;
+			for (auto index{ 0ull }; index < code.size(); index++)
+			{
+				new_index[index] = kept;
+				if (not removed[index])
+					kept++;
+			}
+			new_index[code.size()] = kept;
+
+			auto result = ByteCode{};
+			result.reserve(kept);
+			for (auto index{ 0ll }; index < static_cast<i64>(code.size()); index++)
+			{
+				if (removed[index])
+					continue;
+				auto instruction = code[index];
+				if (is_jump(instruction.op))
+				{
+					const auto target = index + delta_of(instruction);
+					if (target >= 0 and target <= static_cast<i64>(code.size()))
+						set_delta(instruction, new_index[target] - new_index[index]);
+				}
+				result.push_back(instruction);
+			}
+			code = std::move(result);
+		}
+	}
+
+	/*
+	* Cleans up what the compilers emit without looking further than a few instructions:
+	*	Noops, jumps to the next instruction and moves of a register to itself are dropped
+	*	Jumps landing on a Jump go straight to where that one goes unless that is a loop head behind a conditional jump, a Jump to a return is the return
+	*	A value pushed and popped right away is never pushed, DupTos; Store; Pop is only the Store
+	*	A value stored to a local that is only loaded right after stays on the stack
+	* Runs before fuse_superinstructions, superinstructions are not recognized as jumps.
+	* @return Amount of instructions removed
+	*/
+	inline auto optimize_peephole(ByteCode& code) -> u64
+	{
+		const auto size = code.size();
+		auto removed = std::vector<bool>{};
+		while (true)
+		{
+			const auto threaded = peephole::thread_jumps(code);
+			removed.assign(code.size(), false);
+			if (peephole::mark_redundant(code, removed) == 0ull)
+			{
+				if (not threaded)
+					break;
+				continue;
+			}
+			peephole::compact(code, removed);
+		}
+		return size - code.size();
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "common.h"
+#include "VM.h"
+
+#include <unordered_map>
+#include <algorithm>
+
+namespace le
+{
+	/*
+	* Debugger for the DebugVirtualMachine that counts how often every sequence of 2 to max_length opcodes is executed.
+	* Only instructions that follow each other in the bytecode count as a sequence, taken jumps and calls start a new one,
+	* so every reported sequence can be fused into a superinstruction (see Superinstructions.h).
+	*/
+	class OpcodeProfiler
+	{
+	public:
+		static constexpr size_t max_length = 4;
+
+		/* Opcodes packed one byte each, the first opcode in the lowest byte */
+		using Sequence = u64;
+		static_assert(opcode_count <= 0xff, "Opcodes no longer fit a byte of a sequence");
+
+		struct Entry
+		{
+			Sequence sequence{};
+			size_t length{};
+			size_t count{};
+		};
+
+		template<typename _VM>
+		auto operator()(_VM& vm) -> void
+		{
+			const auto pc = &*vm._pc;
+			if (pc != _last + 1)
+			{
+				_window = 0;
+				_length = 0;
+			}
+			_last = pc;
+			_instructions++;
+
+			_window = (_length == max_length ? _window >> 8 : _window) | static_cast<Sequence>(pc->op) << (8 * std::min(_length, max_length - 1));
+			_length = std::min(_length + 1, max_length);
+
+			/* Every sequence ending at this instruction */
+			for (size_t length{ 2 }; length <= _length; length++)
+			{
+				const auto shift = 8 * (_length - length);
+				_counts[length - 2][_window >> shift]++;
+			}
+		}
+
+		auto instructions() const -> size_t { return _instructions; }
+
+		/* @return The most executed sequences of length opcodes, most executed first */
+		auto top(size_t length, size_t n) const -> std::vector<Entry>
+		{
+			auto entries = std::vector<Entry>{};
+			for (const auto& [sequence, count] : _counts.at(length - 2))
+				entries.push_back(Entry{ .sequence = sequence, .length = length, .count = count });
+
+			std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) { return lhs.count > rhs.count; });
+			if (entries.size() > n)
+				entries.resize(n);
+			return entries;
+		}
+
+		static auto to_string(const Entry& entry) -> String
+		{
+			auto string = String();
+			for (size_t i{ 0 }; i < entry.length; i++)
+			{
+				if (i) string += "; ";
+				string += le::to_string(static_cast<OpCode>(entry.sequence >> (8 * i) & 0xff));
+			}
+			return string;
+		}
+
+		/* Prints the n most executed sequences of every length */
+		auto report(std::ostream& out, size_t n) const -> void
+		{
+			out << std::format("[PROFILE] {} instructions executed\n", _instructions);
+			for (size_t length{ 2 }; length <= max_length; length++)
+			{
+				for (const auto& entry : top(length, n))
+				{
+					out << std::format("[PROFILE] {:>5.2f}% {:>10} {}\n"
+						, 100.0 * static_cast<double>(entry.count) / static_cast<double>(std::max<size_t>(_instructions, 1ull))
+						, entry.count, to_string(entry));
+				}
+			}
+		}
+
+		auto merge(const OpcodeProfiler& other) -> void
+		{
+			_instructions += other._instructions;
+			for (size_t i{ 0 }; i < _counts.size(); i++)
+				for (const auto& [sequence, count] : other._counts[i])
+					_counts[i][sequence] += count;
+		}
+	private:
+		const Instruction* _last{};
+		Sequence _window{};
+		size_t _length{}; /* Opcodes in _window */
+		size_t _instructions{};
+		std::array<std::unordered_map<Sequence, size_t>, max_length - 1> _counts{};
+	};
+}
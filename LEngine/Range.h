@@ -16,7 +16,7 @@ namespace le
             , end(end_)
             , step(step_)
         {
-            type = Type::Custom;
+            type = Type::Range;
         }
 
         Range(Number start_, Number end_, Number step_ = 1.0)
@@ -24,7 +24,7 @@ namespace le
             , end(end_)
             , step(step_)
         {
-            type = Type::Custom;
+            type = Type::Range;
         }
 
         Number start{};
@@ -0,0 +1,699 @@
+#pragma once
+
+#include "Compiler.h"
+
+#include <optional>
+#include <limits>
+
+namespace le
+{
+	/*
+	* Register backend of the compiler, emits the Reg opcodes executed by the RegisterVirtualMachine.
+	* Every function owns a window of registers. Locals ('this', arguments and variables) keep their register for the lifetime of the function,
+	* temporaries are handed out and released like a stack while generating an expression.
+	* Expressions are generated straight into their destination and locals are read in place,
+	* so 'a = b + c' becomes a single RegAdd instead of Load, Load, Add, Store.
+	* Output is stored in the same Code and Frame objects as the stack backend so both engines can run the same scripts.
+	*/
+	class ImplRegisterCompiler
+		: public ImplCompiler
+	{
+		using Register = u16;
+		static constexpr auto max_registers = std::numeric_limits<Register>::max();
+
+		Register _next_register{}; /* First free register */
+		Register _locals_top{}; /* Registers below this are locals and are never released */
+		u64 _register_count{}; /* Registers needed by the function */
+		Register _result{}; /* Holds the value of the last expression statement, returned when falling off the end of the function */
+		std::unordered_map<Symbol, Register> _reserved{}; /* Registers of the locals declared further on, see reserve_locals */
+		std::unordered_map<u64, i32> _numbers{}; /* Number constants already stored in the globals */
+
+		auto bump(Register reg) -> void
+		{
+			_register_count = std::max<u64>(_register_count, reg + 1ull);
+		}
+
+		auto temp() -> Register
+		{
+			if (_next_register == max_registers)
+				throw(ferr::make_exception("Function uses too many registers"));
+			bump(_next_register);
+			return _next_register++;
+		}
+
+		/* Releases every temporary allocated after mark */
+		auto release(Register mark) -> void
+		{
+			_next_register = std::max(mark, _locals_top);
+		}
+
+		auto emit(OpCode op, Register a, Register b = 0, i32 c = 0) -> size_t
+		{
+			return emit_and_get_index(Instruction(op, a, b, c));
+		}
+
+		auto patch_delta(size_t index, i64 delta) -> void
+		{
+			instruction_at(index).operand.reg.c = static_cast<i32>(delta);
+		}
+
+		auto constant(size_t global_index) -> i32
+		{
+			if (global_index > static_cast<size_t>(std::numeric_limits<i32>::max()))
+				throw(ferr::make_exception("Too many globals for the register backend"));
+			return static_cast<i32>(global_index);
+		}
+
+		auto number_constant(Number number) -> i32
+		{
+			const auto value = LeObject::from_number(number);
+			if (auto itr = _numbers.find(value.raw()); itr != _numbers.end())
+				return itr->second;
+			return _numbers[value.raw()] = constant(store_global(value));
+		}
+
+		auto store_frame(Frame frame) -> i32
+		{
+			optimize_bytecode(frame.code, _context, frame);
+			return constant(store_global<CompiledFunction>(std::move(frame)));
+		}
+
+		auto is_local(Symbol name) -> bool
+		{
+			return not is_global(name) and not lib::reserved::is_reserved(name) and _vars.has(name);
+		}
+
+		static auto register_opcode(const Token& op) -> OpCode
+		{
+			switch (op.type)
+			{
+			case Token::Type::OperatorPlus: return OpCode::RegAdd;
+			case Token::Type::OperatorMinus: return OpCode::RegSub;
+			case Token::Type::OperatorMultiply: return OpCode::RegMul;
+			case Token::Type::OperatorDivide: return OpCode::RegDiv;
+			case Token::Type::OperatorEq: return OpCode::RegEQ;
+			case Token::Type::OperatorNEq: return OpCode::RegNEQ;
+			case Token::Type::OperatorLT: return OpCode::RegLT;
+			case Token::Type::OperatorLET: return OpCode::RegLET;
+			case Token::Type::OperatorGET: return OpCode::RegGET;
+			case Token::Type::OperatorGT: return OpCode::RegGT;
+			default:
+				throw(ferr::unexpected_token(op));
+			}
+		}
+
+		static auto register_jump_if_not(OpCode jump) -> OpCode
+		{
+			switch (jump)
+			{
+			case OpCode::JumpIfNotGT: return OpCode::RegJumpIfNotGT;
+			case OpCode::JumpIfNotGET: return OpCode::RegJumpIfNotGET;
+			case OpCode::JumpIfNotLT: return OpCode::RegJumpIfNotLT;
+			case OpCode::JumpIfNotLET: return OpCode::RegJumpIfNotLET;
+			case OpCode::JumpIfNotEQ: return OpCode::RegJumpIfNotEQ;
+			case OpCode::JumpIfNotNEQ: return OpCode::RegJumpIfNotNEQ;
+			default: return OpCode::RegJumpIfFalse;
+			}
+		}
+
+		/* @return The register holding the value of expr, locals are returned as is */
+		auto generate_operand(Statement* expr) -> Register
+		{
+			if (expr->type == Statement::Type::IdentifierExpression)
+			{
+				const auto& name = as<Identifier>(expr).name;
+				if (is_local(name))
+					return static_cast<Register>(get(name));
+			}
+			const auto reg = temp();
+			generate(expr, reg);
+			return reg;
+		}
+
+		/* Register version of ImplCompiler::generate_jump_if_not */
+		auto generate_jump_if_not(Statement* test) -> size_t
+		{
+			const auto mark = _next_register;
+			auto index = size_t{};
+
+			if (const auto jump = jump_if_not_for(test); jump != OpCode::JumpIfFalse)
+			{
+				auto& binop = as<BinaryOperation>(test);
+				const auto lhs = generate_operand(binop.left.get());
+				const auto rhs = generate_operand(binop.right.get());
+				index = emit(register_jump_if_not(jump), lhs, rhs);
+			}
+			else
+			{
+				index = emit(OpCode::RegJumpIfFalse, generate_operand(test), 0);
+			}
+
+			release(mark);
+			return index;
+		}
+
+		/* @return Name a dll is imported under */
+		static auto import_name(const ImportStatement& import_statement) -> Symbol
+		{
+			if (not import_statement.alias.empty())
+				return import_statement.alias;
+			return import_statement.target.substr(0, import_statement.target.size() - (sizeof(".dll") - 1));
+		}
+
+		/*
+		* Gives every local the statements declare a register before any temporary is handed out, so no local starts on a value a temporary left behind.
+		* Locals declared in a branch or loop and loop variables may be read without being stored, they are set to null on entry.
+		* Functions and classes declared in between reserve their own.
+		*/
+		auto reserve_locals(const Statement* statement, bool nested) -> void
+		{
+			using SType = Statement::Type;
+			if (not statement)
+				return;
+
+			auto reserve = [this](Symbol name, bool load_null)
+			{
+				if (_vars.has(name) or _reserved.contains(name))
+					return; /* Declared twice, declare throws once it gets there */
+				const auto reg = temp();
+				_locals_top = _next_register;
+				_reserved[name] = reg;
+				if (load_null)
+					emit(OpCode::RegLoadNull, reg, 0);
+			};
+
+			switch (statement->type)
+			{
+			case SType::VarAssignmentStatement:
+				reserve(static_cast<const VarAssignment*>(statement)->target, nested);
+				break;
+			case SType::ImportStatement:
+				if (not in_global_namespace())
+					reserve(import_name(*static_cast<const ImportStatement*>(statement)), nested);
+				break;
+			case SType::FunctionDeclarationExpression:
+			{
+				const auto& name = static_cast<const FunctionDeclaration*>(statement)->name;
+				if (not name.empty() and not is_compiling_class() and not in_global_namespace())
+					reserve(name, nested);
+				break;
+			}
+			case SType::BlockStatement:
+				for (const auto& child : static_cast<const BlockStatement*>(statement)->body)
+					reserve_locals(child.get(), nested);
+				break;
+			case SType::IfStatement:
+			{
+				auto& if_statement = *static_cast<const IfStatement*>(statement);
+				reserve_locals(if_statement.consequent.get(), true);
+				reserve_locals(if_statement.alternative.get(), true);
+				break;
+			}
+			case SType::WhileLoop:
+				reserve_locals(static_cast<const WhileLoop*>(statement)->body.get(), true);
+				break;
+			case SType::ForLoop:
+			{
+				auto& loop = *static_cast<const ForLoop*>(statement);
+				reserve(loop.var, true);
+				reserve_locals(loop.body.get(), true);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		/* Handles both AssignmentExpression and AssignmentStatement, dest is only set for expressions */
+		auto generate_assignment(Statement* statement, std::optional<Register> dest) -> void
+		{
+			using SType = Statement::Type;
+			auto& assignment = as<AssignmentExpression>(statement);
+			auto& target = assignment.target;
+			auto& rhs = assignment.right;
+			const auto mark = _next_register;
+
+			if (target->type == SType::AccessorExpression || target->type == SType::MemberExpression)
+			{
+				auto& access_expr = as<AccessorExpression>(target.get());
+				const auto value = generate_operand(rhs.get());
+				const auto query = generate_operand(access_expr.query.get());
+				const auto object = generate_operand(access_expr.target.get());
+				emit(OpCode::RegAccessAssign, object, query, value);
+				if (dest and *dest != value)
+					emit(OpCode::RegMove, *dest, value);
+			}
+			else if (target->type == SType::IdentifierExpression)
+			{
+				auto& identifier = as<Identifier>(target.get());
+				if (is_global(identifier.name))
+				{
+					auto value = Register{};
+					if (dest)
+						generate(rhs.get(), value = *dest);
+					else
+						value = generate_operand(rhs.get());
+					emit(OpCode::RegStoreGlobal, value, 0, constant(get_global(identifier.name)));
+				}
+				else
+				{
+					const auto local = static_cast<Register>(_vars.get(identifier.name));
+					generate(rhs.get(), local);
+					if (dest and *dest != local)
+						emit(OpCode::RegMove, *dest, local);
+				}
+			}
+			else
+			{
+				throw(ferr::failed_assignment(String(to_string(target->type)), String(to_string(rhs->type))));
+			}
+
+			release(mark);
+		}
+
+		/* dest receives the function, named functions without a dest are only stored under their name */
+		auto generate_function(FunctionDeclaration& function_decl, std::optional<Register> dest) -> void
+		{
+			auto compiler = ImplRegisterCompiler(_context, _depth + 1ull);
+
+			if (is_compiling_class())
+				compiler.declare("this");
+
+			for (auto& arg : function_decl.args)
+				compiler.declare(arg);
+
+			const auto is_lambda = function_decl.name.empty();
+			const auto mark = _next_register;
+
+			auto function = Register{};
+			if (dest)
+				function = *dest;
+			else if (not is_lambda and not is_compiling_class() and not in_global_namespace())
+				function = declare(function_decl.name);
+			else
+				function = temp();
+
+			const auto load_index = emit(OpCode::RegLoadConst, function, 0);
+
+			if (not is_lambda)
+			{
+				if (is_compiling_class())
+					emit(OpCode::RegMakeMember, static_cast<Register>(get("this")), function, constant(store_member_cache(function_decl.name)));
+				else if (in_global_namespace())
+					emit(OpCode::RegStoreGlobal, function, 0, constant(register_global(function_decl.name)));
+				else if (dest)
+					emit(OpCode::RegMove, declare(function_decl.name), function);
+			}
+			/* Globals are declared first incase the function body refers to itself */
+			auto frame = compiler.compile(function_decl.body->body, *_code_obj);
+			frame.argc = function_decl.args.size();
+			frame.name = is_lambda ? String("Lambda") : String(function_decl.name);
+			patch_delta(load_index, store_frame(std::move(frame)));
+
+			release(mark);
+		}
+
+		/* Generates consecutive registers for exprs, @return The first register */
+		auto generate_consecutive(NodeList<PExpression>& exprs) -> Register
+		{
+			const auto first = _next_register;
+			for (auto& expr : exprs)
+			{
+				const auto reg = temp();
+				generate(expr.get(), reg);
+				if (reg != first + (&expr - exprs.data()))
+					throw(ferr::make_exception("Declarations are not allowed within call arguments or array literals"));
+			}
+			return first;
+		}
+
+		auto generate_statement(Statement* statement) -> void
+		{
+			using SType = Statement::Type;
+
+			if (not statement) return;
+
+			switch (statement->type)
+			{
+			case SType::ClassDeclaration:
+			{
+				/* Compiled as a function that fills and returns 'this', same as the stack backend */
+				auto& class_stmt = as<ClassDeclaration>(statement);
+
+				auto compiler = ImplRegisterCompiler(_context, _depth + 1ull);
+				auto old_namespace = _context.namespace_name;
+				_context.namespace_name = class_stmt.name;
+
+				compiler.declare("this");
+				auto frame = compiler.compile(class_stmt.members, *_code_obj, true);
+				frame.name = String(class_stmt.name);
+
+				const auto mark = _next_register;
+				const auto reg = temp();
+				emit(OpCode::RegLoadConst, reg, 0, store_frame(std::move(frame)));
+				emit(OpCode::RegStoreGlobal, reg, 0, constant(register_global(class_stmt.name)));
+				release(mark);
+
+				_context.namespace_name = old_namespace;
+				break;
+			}
+			case SType::ImportStatement:
+			{
+				auto& import_statement = as<ImportStatement>(statement);
+
+				if (not import_statement.target.ends_with(".dll"))
+					throw(ferr::not_implemented());
+
+				const auto var_name = import_name(import_statement);
+				const auto mark = _next_register;
+				const auto path = temp();
+				emit(OpCode::RegLoadConst, path, 0, constant(store_string(import_statement.target)));
+				if (in_global_namespace())
+				{
+					emit(OpCode::RegImportDll, path, path);
+					emit(OpCode::RegStoreGlobal, path, 0, constant(register_global(var_name)));
+				}
+				else
+				{
+					emit(OpCode::RegImportDll, declare(var_name), path);
+				}
+				release(mark);
+				break;
+			}
+			case SType::ReturnExpression:
+			{
+				auto& return_expr = as<ReturnExpression>(statement);
+				if (return_expr.expr)
+				{
+					const auto mark = _next_register;
+					emit(OpCode::RegReturn, generate_operand(return_expr.expr.get()), 0);
+					release(mark);
+				}
+				else
+				{
+					ImplCompiler::emit(Instruction(OpCode::Return));
+				}
+				break;
+			}
+			case SType::BlockStatement:
+			{
+				for (auto& stmt : as<BlockStatement>(statement).body)
+					generate_statement(stmt.get());
+				break;
+			}
+			case SType::IfStatement:
+			{
+				auto& if_statement = as<IfStatement>(statement);
+
+				auto jump_to_next_set = generate_jump_if_not(if_statement.test.get());
+				generate_statement(if_statement.consequent.get());
+
+				if (not if_statement.alternative)
+				{
+					patch_delta(jump_to_next_set, instruction_count() - jump_to_next_set);
+				}
+				else
+				{
+					auto jump_to_end = emit_and_get_index(Instruction(OpCode::Jump));
+					auto instr_count = instruction_count();
+					patch_delta(jump_to_next_set, instr_count - jump_to_next_set);
+					generate_statement(if_statement.alternative.get());
+					instruction_at(jump_to_end).operand.integer = instruction_count() - instr_count + 1 /* account for jump instr */;
+				}
+				break;
+			}
+			case SType::ForLoop:
+			{
+				auto& loop = as<ForLoop>(statement);
+				const auto mark = _next_register;
+
+				const auto iterable = generate_operand(loop.target.get());
+				const auto state = temp(); /* The iterable or its iterator and the index into it */
+				temp();
+				emit(OpCode::RegGetIter, state, iterable);
+				const auto loop_var = declare(loop.var);
+				const auto loop_opcode_index = emit(OpCode::RegForLoop, loop_var, state);
+				generate_statement(loop.body.get());
+
+				const auto instr_count_post_loop = instruction_count();
+				ImplCompiler::emit(Instruction(OpCode::Jump, static_cast<i64>(loop_opcode_index) - instr_count_post_loop));
+				patch_delta(loop_opcode_index, instr_count_post_loop - loop_opcode_index + 1 /* jump instruction */);
+
+				release(mark);
+				break;
+			}
+			case SType::WhileLoop:
+			{
+				auto& loop_statement = as<WhileLoop>(statement);
+				auto pre_condition_instr_count = instruction_count();
+				auto pre_condition_jump_index = generate_jump_if_not(loop_statement.expr.get());
+				const auto our_loop_block = &as<BlockStatement>(loop_statement.body.get());
+
+				_loop_blocks.push(our_loop_block);
+				generate_statement(loop_statement.body.get());
+				_loop_blocks.pop();
+
+				auto post_block_instruction_count = instruction_count();
+				patch_delta(pre_condition_jump_index, post_block_instruction_count - pre_condition_jump_index + 1 /* Jump past the last jump instruction */);
+
+				while (not _escape_calls.empty() and _escape_calls.top().block == our_loop_block)
+				{
+					if (_escape_calls.top().escape_reason & BlockStatement::Break)
+						instruction_at(_escape_calls.top().index).operand.integer = post_block_instruction_count - _escape_calls.top().index + 1 /*Jump over last jump */;
+					else if (_escape_calls.top().escape_reason & BlockStatement::Continue)
+						instruction_at(_escape_calls.top().index).operand.integer = pre_condition_instr_count - _escape_calls.top().index;
+					_escape_calls.pop();
+				}
+
+				ImplCompiler::emit(Instruction(OpCode::Jump, pre_condition_instr_count - post_block_instruction_count));
+				break;
+			}
+			case SType::ContinueStatement:
+			case SType::BreakStatement:
+			{
+				/* Jumps are the same in both backends */
+				ImplCompiler::generate(statement);
+				break;
+			}
+			case SType::VarAssignmentStatement:
+			{
+				auto& assignment = as<VarAssignment>(statement);
+				const auto local = declare(assignment.target);
+				generate(assignment.right.get(), local);
+
+				if (is_compiling_class())
+					emit(OpCode::RegMakeMember, static_cast<Register>(get("this")), local, constant(store_member_cache(assignment.target)));
+				break;
+			}
+			case SType::AssignmentStatement:
+				generate_assignment(statement, std::nullopt);
+				break;
+			case SType::FunctionDeclarationExpression:
+			{
+				auto& function_decl = as<FunctionDeclaration>(statement);
+				if (function_decl.name.empty())
+					generate_function(function_decl, _result);
+				else
+					generate_function(function_decl, std::nullopt);
+				break;
+			}
+			default:
+				/* Expression statement */
+				generate(statement, _result);
+			}
+		}
+
+		/* Generates expr with its value ending up in dest */
+		auto generate(Statement* expr, Register dest) -> void
+		{
+			using SType = Statement::Type;
+
+			const auto mark = _next_register;
+			switch (expr->type)
+			{
+			case SType::AssignmentExpression:
+				generate_assignment(expr, dest);
+				break;
+			case SType::FunctionDeclarationExpression:
+				generate_function(as<FunctionDeclaration>(expr), dest);
+				break;
+			case SType::CallExpression:
+			{
+				auto& call_expr = as<CallExpression>(expr);
+				if (call_expr.target->type == SType::MemberExpression and call_expr.args.size() <= method_max_argc)
+				{ /* Method call, the receiver takes the place of the callable */
+					auto& member_expr = as<MemberExpression>(call_expr.target.get());
+					const auto receiver = temp();
+					generate(member_expr.target.get(), receiver);
+					generate_consecutive(call_expr.args);
+
+					const auto cache = store_member_cache(as<StringLiteral>(member_expr.query.get()).string);
+					if (cache > method_max_cache)
+						throw(ferr::make_exception("Too many method calls for the register backend"));
+					emit(OpCode::RegCallMethod, dest, receiver, method_operand(static_cast<u32>(cache), static_cast<u32>(call_expr.args.size())));
+					break;
+				}
+
+				const auto callee = temp();
+				generate(call_expr.target.get(), callee);
+				generate_consecutive(call_expr.args);
+				emit(OpCode::RegCall, dest, callee, static_cast<i32>(call_expr.args.size()));
+				break;
+			}
+			case SType::ArrayExpression:
+			{
+				auto& array_expr = as<ArrayExpression>(expr);
+				const auto first = generate_consecutive(array_expr.container);
+				emit(OpCode::RegMakeArray, dest, first, static_cast<i32>(array_expr.container.size()));
+				break;
+			}
+			case SType::MemberExpression:
+			{
+				auto& member_expr = as<MemberExpression>(expr);
+				const auto target = generate_operand(member_expr.target.get());
+				const auto cache = store_member_cache(as<StringLiteral>(member_expr.query.get()).string);
+				emit(OpCode::RegAccessMember, dest, target, constant(cache));
+				break;
+			}
+			case SType::AccessorExpression:
+			{
+				auto& access_expr = as<AccessorExpression>(expr);
+				const auto query = generate_operand(access_expr.query.get());
+				const auto target = generate_operand(access_expr.target.get());
+				emit(OpCode::RegAccess, dest, target, query);
+				break;
+			}
+			case SType::IdentifierExpression:
+			{
+				auto& identifier = as<Identifier>(expr);
+
+				if (is_global(identifier.name))
+				{
+					emit(OpCode::RegLoadGlobal, dest, 0, constant(get_global(identifier.name)));
+				}
+				else if (lib::reserved::is_reserved(identifier.name))
+				{
+					/* First time loading this global, so save it as global variable */
+					emit(OpCode::RegLoadConst, dest, 0, constant(store_global(lib::reserved::get(identifier.name))));
+					emit(OpCode::RegStoreGlobal, dest, 0, constant(register_global(identifier.name)));
+				}
+				else if (const auto local = static_cast<Register>(_vars.get(identifier.name)); local != dest)
+				{
+					emit(OpCode::RegMove, dest, local);
+				}
+				break;
+			}
+			case SType::UnaryOperation:
+			{
+				auto& unary_expr = as<UnaryOperation>(expr);
+				const auto target = generate_operand(unary_expr.target.get());
+				emit(OpCode::RegUnaryOp, dest, target, static_cast<i32>(std::to_underlying(unary_expr.op.type)));
+				break;
+			}
+			case SType::NumericLiteralExpression:
+				emit(OpCode::RegLoadConst, dest, 0, number_constant(as<NumericLiteral>(expr).value));
+				break;
+			case SType::StringLiteralExpression:
+				emit(OpCode::RegLoadConst, dest, 0, constant(store_string(as<StringLiteral>(expr).string)));
+				break;
+			case SType::BinaryExpression:
+			{
+				auto& binop = as<BinaryOperation>(expr);
+				const auto lhs = generate_operand(binop.left.get());
+				const auto rhs = generate_operand(binop.right.get());
+				emit(register_opcode(binop.op), dest, lhs, rhs);
+				break;
+			}
+			case SType::NullExpression:
+				emit(OpCode::RegLoadNull, dest, 0);
+				break;
+			default:
+				throw(ferr::make_exception(std::format("Statement '{}' is not supported yet by the register compiler", to_string(expr->type))));
+			}
+			release(mark);
+		}
+	public:
+		explicit ImplRegisterCompiler(CompilerContext& context, size_t depth = 0ull)
+			: ImplCompiler(context, depth)
+		{}
+
+		/* Gives name its own register for the lifetime of the function, the one reserve_locals reserved for it if there is one */
+		auto declare(Symbol name) -> Register
+		{
+			if (auto reserved = _reserved.find(name); reserved != _reserved.end())
+			{
+				_vars.count = reserved->second;
+				const auto reg = static_cast<Register>(store(name));
+				_reserved.erase(reserved);
+				return reg;
+			}
+			_vars.count = _next_register; /* VarMap hands out indices from count, make it hand out the next register */
+			const auto reg = static_cast<Register>(store(name));
+			temp();
+			_locals_top = _next_register;
+			return reg;
+		}
+
+		/*
+		* @param ast: The ast to emit bytecode for
+		* @param code_object: The code object holding global storage for the virtual machine
+		* @param in_class_namespace: True if and only if compiling in the namespace of the class declaration
+		* @return Frame holding the bytecode and register count, name and argc are left to the caller
+		*/
+		auto compile(NodeList<PStatement>& ast, Code& code_object, bool in_class_namespace = false)
+			-> Frame
+		{
+			_code_obj = &code_object;
+			_result = temp();
+			_locals_top = _next_register;
+			for (auto& statement : ast)
+				reserve_locals(statement.get(), false);
+
+			if (in_class_namespace)
+				emit(OpCode::RegNewClass, static_cast<Register>(get("this")), 0);
+
+			for (auto& statement : ast)
+				generate_statement(statement.get());
+
+			emit(OpCode::RegReturn, in_class_namespace ? static_cast<Register>(get("this")) : _result, 0);
+			ImplCompiler::emit(Instruction(OpCode::Halt));
+
+			auto frame = Frame{};
+			frame.code = std::move(_code);
+			frame.registers = _register_count;
+			return frame;
+		}
+	};
+
+	class RegisterCompiler
+	{
+		CompilerOptions _options{};
+	public:
+		RegisterCompiler() = default;
+
+		/* @param options: The passes to run, only constant_folding, dead_code and peephole apply to register bytecode */
+		explicit RegisterCompiler(CompilerOptions options)
+			: _options(options)
+		{}
+
+		/* The AST is folded in place, see ConstantFolder */
+		auto emit_bytecode(AST& ast) -> std::variant<Code, String>
+		try
+		{
+			if (_options.constant_folding)
+				fold_constants(*ast.arena, ast.body);
+			auto code = Code{};
+			auto context = CompilerContext{ .options = _options };
+			auto compiler = ImplRegisterCompiler(context, 0ull);
+			auto frame = compiler.compile(ast.body, code);
+			optimize_bytecode(frame.code, context, code);
+			code.code = std::move(frame.code);
+			code.registers = frame.registers;
+			return code;
+		}
+		catch (const std::exception& e)
+		{
+			return String(e.what());
+		}
+	};
+}
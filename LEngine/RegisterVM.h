@@ -0,0 +1,351 @@
+#pragma once
+
+#include "VM.h"
+
+namespace le
+{
+	/*
+	* Executes bytecode made by the RegisterCompiler.
+	* All functions share one register file, a call opens a window for the callee's registers.
+	* Script calls are entered in place: the callee's window starts at the arguments in the caller's window,
+	* which are the last registers the caller had in use, so nothing gets copied and nothing recurses.
+	* The callee's first registers hold 'this' (for members) and the arguments, the same order the stack backend stores them as locals.
+	* Globals, functions and classes are the same objects as used by the stack backend, so CompiledFunction::call lands in run below.
+	*/
+	class RegisterVirtualMachine
+		: public VirtualMachine
+	{
+	protected:
+		using Register = u16;
+
+		/* A call in progress, see VirtualMachine::CallFrame */
+		struct RegisterFrame
+		{
+			ProgramCounter return_pc{}; /* The RegCall of the caller */
+			size_t base{}; /* Window of the caller */
+			size_t top{};
+			Register dest{}; /* Caller's register receiving the return value */
+			bool entry{}; /* Entered from native code through run, returning from it leaves execute */
+		};
+
+		/* Reserved up front like the value stack, so spans over arguments survive nested calls */
+		static constexpr auto max_registers = 1ull << 20;
+
+		std::vector<LeObject> _registers{};
+		std::vector<RegisterFrame> _register_frames{};
+		size_t _base{}; /* First register of the current window */
+		size_t _top{}; /* One past the last register of the current window */
+
+		auto reg(Register r) -> LeObject& { return _registers[_base + r]; }
+
+		auto trace_roots(Tracer& tracer) -> void override
+		{
+			VirtualMachine::trace_roots(tracer);
+			tracer.mark(_registers);
+		}
+
+		/* Opens a window at base whose first argc registers are already filled in and jumps to the start of the function */
+		auto enter(const Frame& function, size_t base, size_t argc, Register dest, bool entry) -> void
+		{
+			const auto top = base + std::max<size_t>(function.registers, argc);
+			if (top > _registers.capacity())
+				throw(ferr::make_exception(std::format("Stack overflow, more than {} registers in use", max_registers)));
+			if (top > _registers.size())
+				_registers.resize(top);
+
+			_register_frames.push_back(RegisterFrame{ .return_pc = _pc, .base = _base, .top = _top, .dest = dest, .entry = entry });
+			_base = base;
+			_top = top;
+			_pc = function.code.cbegin();
+		}
+
+		/*
+		* Closes the current window and hands value to the caller.
+		* @return True if the frame was entered from run, value is then left in the first register of the closed window
+		*/
+		auto leave(LeObject value) -> bool
+		{
+			const auto frame = _register_frames.back();
+			_register_frames.pop_back();
+
+			for (auto i{ _base }; i < _top; i++)
+				_registers[i].reset();
+
+			if (frame.entry)
+				_registers[_base] = std::move(value);
+			_base = frame.base;
+			_top = frame.top;
+			_pc = frame.return_pc;
+			if (not frame.entry)
+				reg(frame.dest) = std::move(value);
+			return frame.entry;
+		}
+
+		/*
+		* Calls the callable in register callee with the argc registers after it as arguments, the result goes to dest.
+		* Script functions are entered in place and true is returned, execution then continues in the callee.
+		*/
+		auto call(Register dest, Register callee, size_t argc) -> bool
+		{
+			const auto& callable = reg(callee);
+			if (callable.type() == RuntimeValue::Type::Function)
+			{
+				enter(static_cast<CompiledFunction*>(callable.get())->function_frame, _base + callee + 1, argc, dest, false);
+				return true;
+			}
+			if (auto member = callable.type() == RuntimeValue::Type::Custom ? dynamic_cast<BuiltinMemberFunction*>(callable.get()) : nullptr)
+			{
+				const auto& function = member->_function; /* Lives in the globals, not in the member */
+				auto self = member->_this; /* Copied first, overwriting the callee may destroy the member */
+				reg(callee) = std::move(self);
+				enter(function, _base + callee, argc + 1ull, dest, false);
+				return true;
+			}
+
+			auto args = std::span(_registers.data() + _base + callee + 1, argc);
+			auto result = callable->call(args, *this);
+			reg(dest) = std::move(result);
+			return false;
+		}
+
+		/* Register version of VirtualMachine::call_method, the receiver sits in register receiver followed by the arguments */
+		auto call_method(Register dest, Register receiver, size_t argc, MemberCache& cache) -> bool
+		{
+			const auto& self = reg(receiver);
+			auto object = self.get();
+
+			if (object and object->type == RuntimeValue::Type::Class)
+			{
+				auto instance = static_cast<Class*>(object);
+				if (instance->shape->id == cache.layout or cache_member(object, cache))
+				{
+					const auto& member = instance->slots[cache.slot];
+					if (member.type() == RuntimeValue::Type::Method)
+					{
+						enter(static_cast<Method*>(member.get())->frame(), _base + receiver, argc + 1ull, dest, false);
+						return true;
+					}
+
+					auto callable = member; /* Copied first, overwriting the receiver may destroy the instance */
+					reg(receiver) = std::move(callable);
+					return call(dest, receiver, argc);
+				}
+			}
+			else if (object and cache_member(object, cache))
+			{
+				auto args = std::span(_registers.data() + _base + receiver + 1, argc);
+				auto result = object->call_member(self, cache.slot, args, *this);
+				reg(dest) = std::move(result);
+				return false;
+			}
+
+			auto callable = self->member_access(self, cache.name);
+			reg(receiver) = std::move(callable);
+			return call(dest, receiver, argc);
+		}
+
+		/* Runs from _pc till the frame entered from run returns */
+		auto execute() -> void
+		{
+			while (true)
+			{
+				const auto& operand = _pc->operand.reg;
+
+				switch (_pc->op)
+				{
+				case OpCode::Noop: break;
+				case OpCode::Halt:
+				case OpCode::Return:
+					if (leave(_null_val)) return;
+					break;
+				case OpCode::RegReturn:
+				{
+					auto& value = reg(operand.a);
+					if (leave(value ? value : _null_val)) return;
+					break;
+				}
+				case OpCode::Jump:
+					safepoint();
+					jump(_pc->operand.integer);
+					continue;
+				case OpCode::RegMove:
+					reg(operand.a) = reg(operand.b);
+					break;
+				case OpCode::RegLoadConst:
+					reg(operand.a) = _current_code->globals[operand.c];
+					break;
+				case OpCode::RegLoadNull:
+					reg(operand.a) = _null_val;
+					break;
+				case OpCode::RegLoadGlobal:
+					reg(operand.a) = load_global(operand.c);
+					break;
+				case OpCode::RegStoreGlobal:
+					global_storage().store(operand.c, reg(operand.a));
+					break;
+				case OpCode::RegAdd: case OpCode::RegMul:
+				case OpCode::RegDiv: case OpCode::RegSub:
+				case OpCode::RegGT: case OpCode::RegGET:
+				case OpCode::RegLT: case OpCode::RegLET:
+				case OpCode::RegEQ: case OpCode::RegNEQ:
+				{
+					const auto& lhs = reg(operand.b);
+					const auto& rhs = reg(operand.c);
+					if (lhs.is_number() and rhs.is_number())
+						reg(operand.a) = number_operation(_pc->op, lhs.as_number(), rhs.as_number());
+					else
+						reg(operand.a) = lhs->apply_operation(to_token_type(_pc->op), rhs);
+					break;
+				}
+				case OpCode::RegUnaryOp:
+					reg(operand.a) = reg(operand.b)->apply_operation(static_cast<Token::Type>(operand.c));
+					break;
+				case OpCode::RegJumpIfFalse:
+					if (not reg(operand.a).to_native_bool())
+					{
+						jump(operand.c);
+						continue;
+					}
+					break;
+#define LE_REG_JUMP_IF_NOT(name, relation) \
+				case OpCode::name: \
+				{ \
+					const auto& lhs = reg(operand.a); \
+					const auto& rhs = reg(operand.b); \
+					const auto holds = lhs.is_number() and rhs.is_number() \
+						? lhs.as_number() relation rhs.as_number() \
+						: lhs->apply_operation(to_token_type(OpCode::name), rhs).to_native_bool(); \
+					if (not holds) \
+					{ \
+						jump(operand.c); \
+						continue; \
+					} \
+					break; \
+				}
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotGT, >)
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotGET, >=)
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotLT, <)
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotLET, <=)
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotEQ, ==)
+				LE_REG_JUMP_IF_NOT(RegJumpIfNotNEQ, !=)
+#undef LE_REG_JUMP_IF_NOT
+				case OpCode::RegCall:
+					safepoint();
+					if (call(operand.a, operand.b, operand.c))
+						continue;
+					break;
+				case OpCode::RegCallMethod:
+					safepoint();
+					if (call_method(operand.a, operand.b, method_argc(operand.c), _current_code->member_caches[method_cache(operand.c)]))
+						continue;
+					break;
+				case OpCode::RegAccess:
+					reg(operand.a) = reg(operand.b)->access(reg(operand.c));
+					break;
+				case OpCode::RegAccessAssign:
+					reg(operand.a)->access_assign(reg(operand.b), reg(operand.c));
+					break;
+				case OpCode::RegAccessMember:
+				{
+					auto member = access_member(reg(operand.b), _current_code->member_caches[operand.c]);
+					reg(operand.a) = std::move(member);
+					break;
+				}
+				case OpCode::RegMakeArray:
+				{
+					auto array = global::mem->emplace<Array>(static_cast<u64>(operand.c));
+					const auto first = _registers.begin() + _base + operand.b;
+					for (auto value = first; value != first + operand.c; ++value)
+						array->data.push_back(MemoryManager::promote(*value));
+					reg(operand.a) = array;
+					break;
+				}
+				case OpCode::RegNewClass:
+					reg(operand.a) = global::mem->emplace<Class>();
+					break;
+				case OpCode::RegMakeMember:
+					make_member(reg(operand.a), reg(operand.b), _current_code->member_caches[operand.c]);
+					break;
+				case OpCode::RegGetIter:
+				{
+					auto iterable = reg(operand.b);
+					for_prepare(&reg(operand.a), std::move(iterable));
+					break;
+				}
+				case OpCode::RegForLoop:
+					if (not for_next(&reg(operand.b), reg(operand.a)))
+					{
+						jump(operand.c);
+						continue;
+					}
+					break;
+				case OpCode::RegImportDll:
+				{
+					auto dll_name = reg(operand.b)->make_string();
+					reg(operand.a) = global::mem->emplace<DllModule>(StringView(dll_name));
+					break;
+				}
+				default:
+					throw(ferr::make_exception(std::format("Unexpected Opcode '{}' encountered by the register machine", to_string(_pc->op))));
+				}
+				iterate_pc();
+			}
+		}
+	public:
+		RegisterVirtualMachine()
+		{
+			_registers.reserve(max_registers);
+		}
+
+		auto run(const Frame& frame, std::span<LeObject>& args, LeObject this_ptr = nullptr) -> LeObject override
+		{
+			const auto old_pc = _pc;
+			const auto base = _top;
+			const auto argc = args.size() + (this_ptr ? 1ull : 0ull);
+			const auto native_call = NativeCall(_native_calls);
+
+			/* args may point into the register file, which is fine as it never reallocates */
+			if (base + argc > _registers.capacity())
+				throw(ferr::make_exception(std::format("Stack overflow, more than {} registers in use", max_registers)));
+			if (base + argc > _registers.size())
+				_registers.resize(base + argc);
+
+			auto index = base;
+			if (this_ptr)
+				_registers[index++] = std::move(this_ptr);
+			for (auto& arg : args)
+				_registers[index++] = arg;
+
+			enter(frame, base, argc, 0, true);
+			execute();
+
+			auto result = std::move(_registers[base]);
+			_pc = old_pc;
+			return result;
+		}
+
+		auto run(Code& code) -> std::variant<LeObject, String>
+		{
+			_current_code = &code;
+
+			try
+			{
+				auto top_level = Frame{ .code = {}, .registers = code.registers };
+				enter(top_level, 0, 0, 0, true);
+				_pc = _current_code->code.cbegin();
+
+				execute();
+				return std::move(_registers[0]);
+			}
+			catch (const std::exception& e)
+			{
+				for (auto& value : _registers)
+					value.reset();
+				_register_frames.clear();
+				_base = 0;
+				_top = 0;
+				return String(e.what());
+			}
+		}
+	};
+}
@@ -8,6 +8,8 @@
 #include "TypeFactory.h"
 #include "Range.h"
 #include "Null.h"
+#include "Class.h"
+#include "Array.h"
 
 /*
 * These are the types and functions that are always active in the namespace
@@ -23,7 +25,7 @@ namespace le::lib::reserved
 
 		std::cout << '\n';
 
-		return mem.emplace<NullValue>();
+		return LeObject::null();
 	}
 
 	inline auto get_type(std::span<LeObject> args, MemoryManager& mem) -> LeObject
@@ -50,6 +52,75 @@ namespace le::lib::reserved
 		return make::make_string(args.front()->make_string());
 	}
 
+	/*
+	* Snapshot of the memory manager as an object, see MemoryStats.
+	* Members: live_objects, live_bytes, peak_bytes, reserved_bytes, allocations, frees, seconds, collections, released_pools, cycles_freed
+	*	objects: Live objects per type, eg. mem_stats().objects.Array
+	*	blocks: [block size, live blocks, pools] for every size class in use
+	*/
+	inline auto mem_stats(std::span<LeObject> args, MemoryManager& mem) -> LeObject
+	{
+		if (not args.empty())
+			throw(ferr::too_many_arguments(args.size(), 0, "mem_stats"));
+
+		const auto stats = mem.stats();
+		const auto number = [](size_t value) { return LeObject::from_number(static_cast<Number>(value)); };
+		const auto add = [](Class& instance, const String& member, LeObject value)
+			{
+				instance.append_member(instance.shape->transition(member), std::move(value));
+			};
+
+		auto objects = mem.emplace<Class>();
+		objects->name = "ObjectStats";
+		for (auto type{ 0ull }; type < MemoryStats::type_count; type++)
+			add(*objects, to_string(static_cast<RuntimeValue::Type>(type)), number(stats.objects[type].live()));
+
+		auto blocks = mem.emplace<Array>(static_cast<u64>(stats.size_classes.size()));
+		for (const auto& size_class : stats.size_classes)
+		{
+			auto entry = mem.emplace<Array>(3ull);
+			entry->data.push_back(number(size_class.block_size));
+			entry->data.push_back(number(size_class.blocks.live()));
+			entry->data.push_back(number(size_class.pools));
+			blocks->data.push_back(std::move(entry));
+		}
+
+		auto allocations = stats.large.allocations;
+		auto frees = stats.large.frees;
+		for (const auto& counts : stats.objects)
+		{
+			allocations += counts.allocations;
+			frees += counts.frees;
+		}
+
+		auto result = mem.emplace<Class>();
+		result->name = "MemoryStats";
+		add(*result, "live_objects", number(stats.live_objects()));
+		add(*result, "live_bytes", number(stats.bytes));
+		add(*result, "peak_bytes", number(stats.peak_bytes));
+		add(*result, "reserved_bytes", number(stats.reserved_bytes));
+		add(*result, "allocations", number(allocations));
+		add(*result, "frees", number(frees));
+		add(*result, "seconds", LeObject::from_number(stats.seconds));
+		add(*result, "collections", number(stats.collector.collections));
+		add(*result, "released_pools", number(stats.released_pools));
+		add(*result, "cycles_freed", number(stats.cycles.freed));
+		add(*result, "objects", std::move(objects));
+		add(*result, "blocks", std::move(blocks));
+		return result;
+	}
+
+	/*
+	* Contents are not compacted as the script may be called from native code holding on to them, the virtual machines compact at their safepoints instead.
+	* @return Bytes released
+	*/
+	inline auto mem_trim(std::span<LeObject> args, MemoryManager& mem) -> LeObject
+	{
+		if (not args.empty())
+			throw(ferr::too_many_arguments(args.size(), 0, "mem_trim"));
+		return LeObject::from_number(static_cast<Number>(mem.trim()));
+	}
+
 	/* Is a specific symbol reserved */
 	inline auto is_reserved(Symbol symbol) -> bool
 	{
@@ -60,6 +131,8 @@ namespace le::lib::reserved
 			/* Functions */
 		case hashing::Hasher::hash("print"):
 		case hashing::Hasher::hash("type"):
+		case hashing::Hasher::hash("mem_stats"):
+		case hashing::Hasher::hash("mem_trim"):
 			/* Types */
 		case hashing::Hasher::hash("Iterator"):
 		case hashing::Hasher::hash("String"):
@@ -86,6 +159,10 @@ namespace le::lib::reserved
 			return global::mem->emplace<ImportedFunction>(get_string, "String");
 		case hashing::Hasher::hash("Range"):
 			return global::mem->emplace<ImportedFunction>(range_constructor, "Range");
+		case hashing::Hasher::hash("mem_stats"):
+			return global::mem->emplace<ImportedFunction>(mem_stats, "mem_stats");
+		case hashing::Hasher::hash("mem_trim"):
+			return global::mem->emplace<ImportedFunction>(mem_trim, "mem_trim");
 		//case hashing::Hasher::hash("range"):
 		default:
 			throw(ferr::make_exception(std::format("Tried accessing non existent global '{}'", symbol)));
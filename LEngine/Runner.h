@@ -6,6 +6,8 @@
 #include "Interpreter.h"
 #include "Compiler.h"
 #include "VM.h"
+#include "RegisterCompiler.h"
+#include "RegisterVM.h"
 
 #include <sstream>
 #include <fstream>
@@ -89,6 +91,30 @@ namespace le
             .value_or(nullptr);
     }
 
+    inline auto compile_registers(AST ast) -> std::optional<Code>
+    {
+        auto compiler = RegisterCompiler();
+        auto code = compiler.emit_bytecode(ast);
+        if (std::holds_alternative<String>(code))
+        {
+            std::cout << "[COMPILE ERROR] " << std::get<String>(code) << '\n';
+            return std::nullopt;
+        }
+        else
+        {
+            return std::get<Code>(code);
+        }
+    }
+
+    inline auto run_with_register_vm(std::string_view source, std::string_view fname) -> LeObject
+    {
+        return
+            parse(source, fname)
+            .and_then(compile_registers)
+            .and_then(evaluate_with<RegisterVirtualMachine, Code>)
+            .value_or(nullptr);
+    }
+
     template<typename _Debugger>
     inline auto run_with_debug_vm(std::string_view source, std::string_view fname) -> LeObject
     {
@@ -109,6 +135,16 @@ namespace le
             std::cout << to_string(code.value());
     }
 
+    inline auto print_register_bytecode(std::string_view source, std::string_view fname) -> void
+    {
+        auto code =
+            parse(source, fname)
+            .and_then(compile_registers);
+
+        if (code)
+            std::cout << to_string(code.value());
+    }
+
     inline auto run_file(std::string fname) -> void
     {
         auto fstream = std::ifstream(fname);
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "generics.h"
+#include "Arena.h"
 
 #include <vector>
 #include <charconv>
@@ -9,7 +10,45 @@
 
 namespace le
 {
-	using PStatement = std::unique_ptr<struct Statement>;
+	/*
+	* Pointer to a node of an AST, the nodes are made by the Arena of their AST and live as long as it does.
+	* Copying or dropping one is free, see AST.
+	*/
+	template<typename _T>
+	class Node
+	{
+		template<typename> friend class Node;
+		_T* _ptr{};
+	public:
+		Node() = default;
+		Node(std::nullptr_t) {}
+		explicit Node(_T* ptr) : _ptr(ptr) {}
+
+		template<typename _U>
+			requires std::convertible_to<_U*, _T*>
+		Node(const Node<_U>& other) : _ptr(other._ptr) {}
+
+		auto get() const -> _T* { return _ptr; }
+		auto operator->() const -> _T* { return _ptr; }
+		auto operator*() const -> _T& { return *_ptr; }
+		explicit operator bool() const { return _ptr != nullptr; }
+	};
+
+	/* Lists of an AST are allocated by its arena as well */
+	template<typename _T>
+	using NodeList = std::vector<_T, ArenaAllocator<_T>>;
+
+	/* @return A node living as long as arena, nodes holding lists are handed the arena first */
+	template<typename _T, typename... _Args>
+	inline auto make_node(Arena& arena, _Args&&... args) -> Node<_T>
+	{
+		if constexpr (std::constructible_from<_T, Arena&, _Args...>)
+			return Node<_T>(arena.make<_T>(arena, std::forward<_Args>(args)...));
+		else
+			return Node<_T>(arena.make<_T>(std::forward<_Args>(args)...));
+	}
+
+	using PStatement = Node<struct Statement>;
 
 	struct Statement
 	{
@@ -84,7 +123,7 @@ namespace le
 #undef LE_STATEMENT_TYPE_TO_STRING_CASE
 
 	struct Expression : Statement {};
-	using PExpression = std::unique_ptr<Expression>;
+	using PExpression = Node<Expression>;
 
 	/* a := 10 */
 	struct AssignmentExpression : Expression
@@ -107,10 +146,10 @@ namespace le
 	/* class 'identifier': */
 	struct ClassDeclaration : Statement
 	{
-		ClassDeclaration() { type = Type::ClassDeclaration; }
+		explicit ClassDeclaration(Arena& arena) : members(arena) { type = Type::ClassDeclaration; }
 		
 		Symbol name{};
-		std::vector<PStatement> members{};
+		NodeList<PStatement> members;
 	};
 
 	/* import [identifier] */
@@ -168,13 +207,13 @@ namespace le
 			Return = 0b1000u
 		};
 
-		BlockStatement() { type = Type::BlockStatement; }
+		explicit BlockStatement(Arena& arena) : body(arena) { type = Type::BlockStatement; }
 
-		std::vector<PStatement> body{};
+		NodeList<PStatement> body;
 
 		/* To be initialized at the start of the scope, for example when opening function scope */
 		std::vector<String>* block_arg_names{ nullptr };
-		std::vector<PExpression>* block_args{ nullptr };
+		NodeList<PExpression>* block_args{ nullptr };
 		/* Whitelist of keywords that can interact with this block, these are set by the parser */
 		std::underlying_type_t<EscapeReason> accepted_escape_reasons{ EscapeReason::None };
 		EscapeReason was_escaped_with{ EscapeReason::None };
@@ -205,17 +244,17 @@ namespace le
 
 	struct ReturnExpression : Expression
 	{
-		explicit ReturnExpression(PExpression expr_ = nullptr) : expr(std::move(expr_)) { type = Type::ReturnExpression; }
+		explicit ReturnExpression(PExpression expr_ = nullptr) : expr(expr_) { type = Type::ReturnExpression; }
 		PExpression expr{};
 	};
 
 	struct FunctionDeclaration : Expression
 	{
-		FunctionDeclaration() { type = Type::FunctionDeclarationExpression; }
+		explicit FunctionDeclaration(Arena& arena) : args(arena) { type = Type::FunctionDeclarationExpression; }
 
 		Symbol name{}; /* Can be empty for lambda's */
-		std::vector<Symbol> args{};
-		std::unique_ptr<BlockStatement> body{};
+		NodeList<Symbol> args;
+		Node<BlockStatement> body{};
 	};
 
 	/* A function with a special identifier so we know to pass it a this pointer */
@@ -227,17 +266,17 @@ namespace le
 
 	struct CallExpression : Expression
 	{
-		CallExpression() { type = Type::CallExpression; }
+		explicit CallExpression(Arena& arena) : args(arena) { type = Type::CallExpression; }
 
 		PExpression target{}; /* Name of func */
-		std::vector<PExpression> args{};
+		NodeList<PExpression> args;
 	};
 
 	struct ArrayExpression : Expression
 	{
-		ArrayExpression() { type = Type::ArrayExpression; }
+		explicit ArrayExpression(Arena& arena) : container(arena) { type = Type::ArrayExpression; }
 
-		std::vector<PExpression> container{};
+		NodeList<PExpression> container;
 	};
 
 	struct AccessorExpression : Expression
@@ -256,11 +295,11 @@ namespace le
 		PExpression query{};
 	};
 
-	inline auto make_accessor_expression(PExpression& target, PExpression& query) -> PExpression
+	inline auto make_accessor_expression(Arena& arena, PExpression& target, PExpression& query) -> PExpression
 	{
-		auto accessor = std::make_unique<AccessorExpression>();
-		accessor->target = std::move(target);
-		accessor->query = std::move(query);
+		auto accessor = make_node<AccessorExpression>(arena);
+		accessor->target = target;
+		accessor->query = query;
 		return accessor;
 	}
 
@@ -278,22 +317,22 @@ namespace le
 		Token op{};
 	};
 
-	inline auto make_binary_operation(PExpression& left, PExpression& right, const Token& op) -> PExpression
+	inline auto make_binary_operation(Arena& arena, PExpression& left, PExpression& right, const Token& op) -> PExpression
 	{
-		auto binop = std::make_unique<BinaryOperation>();
-		binop->left = std::move(left);
-		binop->right = std::move(right);
+		auto binop = make_node<BinaryOperation>(arena);
+		binop->left = left;
+		binop->right = right;
 		binop->op = op;
 		return binop;
 	}
 
 	template<typename _Expr>
-	inline auto make_assignment(PExpression& target, PExpression& right) -> PExpression
+	inline auto make_assignment(Arena& arena, PExpression& target, PExpression& right) -> PExpression
 		requires any_of<_Expr, AssignmentExpression, AssignmentStatement>
 	{
-		auto expr = std::make_unique<_Expr>();
-		expr->target = std::move(target);
-		expr->right = std::move(right);
+		auto expr = make_node<_Expr>(arena);
+		expr->target = target;
+		expr->right = right;
 		return expr;
 	}
 
@@ -322,11 +361,11 @@ namespace le
 		Token op{};
 	};
 
-	inline auto make_unary_operation(PExpression& target, const Token& op) -> PExpression
+	inline auto make_unary_operation(Arena& arena, PExpression& target, const Token& op) -> PExpression
 	{
-		auto unary_op = std::make_unique<UnaryOperation>();
+		auto unary_op = make_node<UnaryOperation>(arena);
 		unary_op->op = op;
-		unary_op->target = std::move(target);
+		unary_op->target = target;
 		return unary_op;
 	}
 
@@ -340,28 +379,28 @@ namespace le
 		Symbol name{};
 	};
 
-	inline auto make_identifier(const Token& token) -> std::unique_ptr<Identifier>
+	inline auto make_identifier(Arena& arena, const Token& token) -> Node<Identifier>
 	{
-		return std::make_unique<Identifier>(token.raw);
+		return make_node<Identifier>(arena, token.raw);
 	}
 
-	inline auto make_string_literal(const Token& token) -> std::unique_ptr<StringLiteral>
+	inline auto make_string_literal(Arena& arena, const Token& token) -> Node<StringLiteral>
 	{
-		return std::make_unique<StringLiteral>(token.raw);
+		return make_node<StringLiteral>(arena, token.raw);
 	}
 
-	inline auto make_member_expression(PExpression& target, const Token& member) -> PExpression
+	inline auto make_member_expression(Arena& arena, PExpression& target, const Token& member) -> PExpression
 	{
-		auto accessor = std::make_unique<MemberExpression>();
-		accessor->target = std::move(target);
-		accessor->query = make_string_literal(member);
+		auto accessor = make_node<MemberExpression>(arena);
+		accessor->target = target;
+		accessor->query = make_string_literal(arena, member);
 		return accessor;
 	}
 
 	/* TODO error handling */
-	inline auto make_numeric_literal(const Token& token, String& error) -> std::unique_ptr<NumericLiteral>
+	inline auto make_numeric_literal(Arena& arena, const Token& token, String& error) -> Node<NumericLiteral>
 	{
-		auto expr = std::make_unique<NumericLiteral>();
+		auto expr = make_node<NumericLiteral>(arena);
 
 		auto [ptr, ec] = std::from_chars(token.raw.data(), token.raw.data() + token.raw.size(), expr->value);
 		if (ec == std::errc::invalid_argument)
@@ -5,9 +5,10 @@
 #include "Number.h"
 #include "Boolean.h"
 #include "Iterator.h"
+#include "Allocator.h"
 
 /*
-* Builtin string type, uses std::string for its implementation.
+* Builtin string type, uses a std::basic_string allocated through the MemoryManager for its implementation.
 * 
 * Usage:
 * "text..."
@@ -35,11 +36,21 @@ namespace le
 			type = Type::String; 
 		}
 
-		String string{};
+		ManagedString string{};
 
 		auto make_string() -> String override
 		{
-			return string;
+			return String(string);
+		}
+
+		auto promote() const -> LeObject override
+		{
+			return global::mem->emplace<StringValue>(*this);
+		}
+
+		auto relocate() -> void override
+		{
+			le::relocate(string);
 		}
 
 		auto type_name() -> String override
@@ -51,14 +62,14 @@ namespace le
 
 		auto access(LeObject index) -> LeObject override
 		{
-			auto idx = to_numeric_index(*index);
+			auto idx = to_numeric_index(index);
 			return _make_small_string(idx);
 		}
 
 		auto _make_small_string(size_t idx) -> LeObject
 		{
 			/* Return a new string object, even if it just holds one character, SBO will avoid a heap allocation anyway */
-			auto new_str = global::mem->emplace<StringValue>();
+			auto new_str = global::mem->emplace_temporary<StringValue>();
 			
 			if (bounds_check(idx))
 			{
@@ -84,7 +95,7 @@ namespace le
 			return not string.empty();
 		}
 
-		auto handle_string_op(Token::Type op, String& other) -> LeObject
+		auto handle_string_op(Token::Type op, const ManagedString& other) -> LeObject
 		{
 			switch (op)
 			{
@@ -103,7 +114,7 @@ namespace le
 
 		auto apply_operation(Token::Type op, LeObject other) -> LeObject override
 		{
-			switch (other->type)
+			switch (other.type())
 			{
 			case Type::String:
 			{
@@ -111,7 +122,7 @@ namespace le
 				return handle_string_op(op, other_string);
 			}
 			default:
-				throw(ferr::invalid_operation(op, to_string(type), to_string(other->type)));
+				throw(ferr::invalid_operation(op, to_string(type), to_string(other.type())));
 			}
 
 			return {};
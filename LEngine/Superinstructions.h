@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ByteCode.h"
+
+#include <initializer_list>
+
+namespace le
+{
+	/*
+	* The sequences below are picked from the OpcodeProfiler report over the benchmarks (see le::benchmark::profile),
+	* together they make up over a third of the instructions executed there.
+	* Run the profile again after changing what the compiler emits, it reports the sequences as they are before fusing.
+	*/
+	namespace superinstructions
+	{
+		inline auto is_arithmetic(OpCode op) -> bool
+		{
+			return (op >= OpCode::Add and op <= OpCode::Sub) or (op >= OpCode::AddNum and op <= OpCode::SubNum);
+		}
+
+		inline auto is_jump_if_not(OpCode op) -> bool
+		{
+			return (op >= OpCode::JumpIfNotGT and op <= OpCode::JumpIfNotNEQ) or (op >= OpCode::JumpIfNotGTNum and op <= OpCode::JumpIfNotNEQNum);
+		}
+
+		inline auto is_load(OpCode op) -> bool { return op == OpCode::Load; }
+		inline auto is_push_real(OpCode op) -> bool { return op == OpCode::PushReal; }
+		inline auto is_store(OpCode op) -> bool { return op == OpCode::Store; }
+
+		struct Pattern
+		{
+			OpCode fused{};
+			std::vector<bool(*)(OpCode)> sequence{};
+		};
+
+		/* Longest first, the first pattern matching at an instruction is used */
+		inline const auto patterns = std::vector<Pattern>
+		{
+			Pattern{ OpCode::LoadRealOpStore, { is_load, is_push_real, is_arithmetic, is_store } },
+			Pattern{ OpCode::LoadRealOp, { is_load, is_push_real, is_arithmetic } },
+			Pattern{ OpCode::LoadRealJumpIfNot, { is_load, is_push_real, is_jump_if_not } },
+			Pattern{ OpCode::LoadLoadOp, { is_load, is_load, is_arithmetic } },
+			Pattern{ OpCode::LoadLoad, { is_load, is_load } },
+			Pattern{ OpCode::OpStore, { is_arithmetic, is_store } },
+		};
+
+		inline auto matches(const Pattern& pattern, const ByteCode& code, size_t index) -> bool
+		{
+			if (index + pattern.sequence.size() > code.size())
+				return false;
+			for (auto i{ 0ull }; i < pattern.sequence.size(); i++)
+				if (not pattern.sequence[i](code[index + i].op))
+					return false;
+			return true;
+		}
+
+		/* @return The longest pattern matching the instructions at index, nullptr if there is none */
+		inline auto longest_match(const ByteCode& code, size_t index) -> const Pattern*
+		{
+			for (const auto& pattern : patterns)
+				if (matches(pattern, code, index))
+					return &pattern;
+			return nullptr;
+		}
+	}
+
+	/*
+	* Rewrites code to use superinstructions, the first instruction of a fused sequence gets the superinstruction's opcode.
+	* Nothing is moved, so a jump into the middle of a sequence still lands on the original instructions.
+	* A fused operator keeps its opcode in its operand, see OpStore.
+	* Only for the stack backend.
+	*/
+	inline auto fuse_superinstructions(ByteCode& code) -> void
+	{
+		for (auto index{ 0ull }; index < code.size(); )
+		{
+			const auto pattern = superinstructions::longest_match(code, index);
+			const auto next = superinstructions::longest_match(code, index + 1);
+			if (not pattern or (next and next->sequence.size() > pattern->sequence.size()))
+			{ /* Eg. Load; Load; PushReal; Add is better off as Load; LoadRealOp than LoadLoad; PushReal; Add */
+				index++;
+				continue;
+			}
+
+			if (superinstructions::is_arithmetic(code[index].op)) /* Has no operand, so it can keep the operator */
+				code[index].operand.uinteger = static_cast<u64>(code[index].op);
+			code[index].op = pattern->fused;
+			index += pattern->sequence.size();
+		}
+	}
+}
@@ -10,15 +10,15 @@ auto le::make::make_string(String string) -> LeObject
 
 auto le::make::make_number(Number number) -> LeObject
 {
-    return global::mem->emplace<NumberValue>(number);
+    return LeObject::from_number(number);
 }
 
 auto le::make::make_null() -> LeObject
 {
-    return global::null;
+    return LeObject::null();
 }
 
 auto le::make::make_bool(bool b) -> LeObject
 {
-    return global::mem->emplace<Boolean>(b);
+    return LeObject::from_bool(b);
 }
@@ -0,0 +1,362 @@
+#pragma once
+
+#include "ByteCode.h"
+#include "Peephole.h"
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+namespace le
+{
+	/*
+	* What the type inference knows of a value, a number only when every path leading to it makes a number.
+	* A number can depend on arguments being numbers, which only a GuardNumbers can check.
+	*/
+	struct StaticType
+	{
+		bool number{};
+		u32 arguments{}; /* Local slots of the arguments this is a number for, none when it always is */
+
+		static constexpr auto unknown() -> StaticType { return {}; }
+		static constexpr auto always_number() -> StaticType { return { .number = true }; }
+
+		auto operator==(const StaticType&) const -> bool = default;
+	};
+
+	/* @return What is known of a value made on either of two paths, or by an operator on both */
+	inline auto join(StaticType lhs, StaticType rhs) -> StaticType
+	{
+		if (not lhs.number or not rhs.number)
+			return StaticType::unknown();
+		return { .number = true, .arguments = lhs.arguments | rhs.arguments };
+	}
+
+	/* The types of the locals and of the operands on top of the stack before an instruction */
+	struct TypeState
+	{
+		std::vector<StaticType> locals{};
+		/*
+		* Only the top of the operand stack, whatever lies below it is Unknown.
+		* The stack compiler leaves the values of expression statements behind, so paths can meet at different stack heights,
+		* what the code still uses is always on top.
+		*/
+		std::vector<StaticType> stack{};
+
+		auto push(StaticType type) -> void { stack.push_back(type); }
+
+		auto pop() -> StaticType
+		{
+			if (stack.empty())
+				return StaticType::unknown();
+			const auto type = stack.back();
+			stack.pop_back();
+			return type;
+		}
+
+		auto pop(size_t count) -> void
+		{
+			stack.resize(stack.size() - std::min(count, stack.size()));
+		}
+
+		/* @return The type count operands below the top */
+		auto peek(size_t depth = 0ull) const -> StaticType
+		{
+			return depth < stack.size() ? stack[stack.size() - 1ull - depth] : StaticType::unknown();
+		}
+
+		/* @return Whether joining other made this any less precise */
+		auto join(const TypeState& other) -> bool
+		{
+			auto changed = false;
+			for (auto slot{ 0ull }; slot < locals.size(); slot++)
+			{
+				const auto joined = le::join(locals[slot], other.locals[slot]);
+				changed |= joined != locals[slot];
+				locals[slot] = joined;
+			}
+
+			const auto height = std::min(stack.size(), other.stack.size());
+			if (height < stack.size())
+			{
+				stack.erase(stack.begin(), stack.begin() + (stack.size() - height));
+				changed = true;
+			}
+			for (auto depth{ 0ull }; depth < height; depth++)
+			{
+				auto& type = stack[stack.size() - 1ull - depth];
+				const auto joined = le::join(type, other.peek(depth));
+				changed |= joined != type;
+				type = joined;
+			}
+			return changed;
+		}
+	};
+
+	namespace type_inference
+	{
+		inline auto is_arithmetic(OpCode op) -> bool { return op >= OpCode::Add and op <= OpCode::Sub; }
+		inline auto is_relation(OpCode op) -> bool { return op >= OpCode::GT and op <= OpCode::NEQ; }
+		inline auto is_jump_if_not(OpCode op) -> bool { return op >= OpCode::JumpIfNotGT and op <= OpCode::JumpIfNotNEQ; }
+
+		/* @return The typed opcode of an operator on two numbers, they follow the order of the operators they replace */
+		inline auto typed(OpCode op) -> OpCode
+		{
+			if (is_arithmetic(op))
+				return static_cast<OpCode>(std::to_underlying(OpCode::AddNum) + (std::to_underlying(op) - std::to_underlying(OpCode::Add)));
+			if (is_relation(op))
+				return static_cast<OpCode>(std::to_underlying(OpCode::GTNum) + (std::to_underlying(op) - std::to_underlying(OpCode::GT)));
+			return static_cast<OpCode>(std::to_underlying(OpCode::JumpIfNotGTNum) + (std::to_underlying(op) - std::to_underlying(OpCode::JumpIfNotGT)));
+		}
+
+		/* @return Amount of local slots code uses, a for loop keeps its state in three slots from the one GetIter names */
+		inline auto local_slots(const ByteCode& code) -> size_t
+		{
+			auto slots = 0ull;
+			for (const auto& instruction : code)
+			{
+				if (instruction.op == OpCode::Load or instruction.op == OpCode::Store)
+					slots = std::max<size_t>(slots, instruction.operand.uinteger + 1ull);
+				else if (instruction.op == OpCode::GetIter)
+					slots = std::max<size_t>(slots, instruction.operand.uinteger + 3ull);
+			}
+			return slots;
+		}
+
+		/* Where control goes after an instruction, besides the jumps it takes */
+		enum class Step
+		{
+			Next, /* Only to the next instruction */
+			Stop, /* Nowhere, the instruction jumped or returned */
+			Unknown, /* The inference doesn't know the instruction */
+		};
+
+		/*
+		* Moves state past the instruction at index, flow(target, state) is called for every jump it can take.
+		* @return Where control goes after the instruction besides its jumps
+		*/
+		template<typename _Flow>
+		auto step(const ByteCode& code, i64 index, TypeState& state, _Flow&& flow) -> Step
+		{
+			const auto& instruction = code[index];
+			switch (instruction.op)
+			{
+			case OpCode::Halt: case OpCode::Return: case OpCode::ReturnExpr:
+				return Step::Stop;
+			case OpCode::Noop:
+				break;
+			case OpCode::Pop: case OpCode::StoreGlobal:
+				state.pop();
+				break;
+			case OpCode::DupTos:
+				state.push(state.peek());
+				break;
+			case OpCode::PushReal:
+				state.push(StaticType::always_number());
+				break;
+			case OpCode::PushGlobal: case OpCode::PushString: case OpCode::PushNull:
+			case OpCode::PushEmptyClass: case OpCode::LoadGlobal:
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::Load:
+				state.push(state.locals[instruction.operand.uinteger]);
+				break;
+			case OpCode::Store:
+				state.locals[instruction.operand.uinteger] = state.pop();
+				break;
+			case OpCode::ImportDll: case OpCode::AccessMember:
+				state.pop();
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::MakeArray:
+				state.pop(instruction.operand.uinteger);
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::MakeMember:
+				state.pop(2ull);
+				break;
+			case OpCode::Access:
+				state.pop(2ull);
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::AccessAssign:
+				state.pop(3ull);
+				break;
+			case OpCode::Call:
+				state.pop(instruction.operand.uinteger + 1ull);
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::CallMethod:
+				state.pop(instruction.operand.method.argc + 1ull);
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::UnaryOp: /* A unary operator on a number makes a number or throws */
+				break;
+			case OpCode::GetIter:
+				state.pop();
+				std::fill_n(state.locals.begin() + instruction.operand.uinteger, 3, StaticType::unknown());
+				break;
+			case OpCode::ForLoop: /* Drops what the loop body left behind, pushes the next value unless exhausted */
+				state.stack.clear();
+				flow(index + instruction.operand.loop.delta, state);
+				state.push(StaticType::unknown());
+				break;
+			case OpCode::Jump:
+				flow(index + instruction.operand.integer, state);
+				return Step::Stop;
+			case OpCode::JumpIfTrue: case OpCode::JumpIfFalse:
+				state.pop();
+				flow(index + instruction.operand.integer, state);
+				break;
+			default:
+				if (is_arithmetic(instruction.op))
+				{
+					const auto rhs = state.pop();
+					const auto lhs = state.pop();
+					state.push(join(lhs, rhs));
+				}
+				else if (is_relation(instruction.op))
+				{
+					state.pop(2ull);
+					state.push(StaticType::unknown());
+				}
+				else if (is_jump_if_not(instruction.op))
+				{
+					state.pop(2ull);
+					flow(index + instruction.operand.integer, state);
+				}
+				else
+				{
+					return Step::Unknown;
+				}
+			}
+			return Step::Next;
+		}
+
+		/*
+		* Finds what the operators of stack bytecode see, starting with the locals of entry.
+		* Only the states at the start of the blocks (see ControlFlowGraph) are kept, the rest is found again by stepping through the block.
+		* Runs till no state changes, every join can only make a state less precise so this ends.
+		* @return For every operator the join of its two operands, unknown for other instructions. Nullopt if code holds an opcode the inference doesn't know
+		*/
+		inline auto operand_types(const ByteCode& code, const std::vector<StaticType>& entry) -> std::optional<std::vector<StaticType>>
+		{
+			const auto size = static_cast<i64>(code.size());
+			auto leaders = peephole::jump_targets(code);
+			for (auto index{ 0ull }; index < code.size(); index++)
+				if (peephole::is_jump(code[index].op))
+					leaders[index + 1ull] = true;
+
+			auto states = std::vector<std::optional<TypeState>>(code.size());
+			auto pending = std::vector<i64>{};
+			auto flow = [&](i64 target, const TypeState& state)
+			{
+				if (target < 0 or target >= size)
+					return;
+				auto& into = states[target];
+				if (not into)
+					into = state;
+				else if (not into->join(state))
+					return;
+				pending.push_back(target);
+			};
+			/* Steps through the block starting at index, @return False if it holds an opcode the inference doesn't know */
+			auto run_block = [&](i64 index, TypeState state, auto&& visit) -> bool
+			{
+				for (; index < size; index++)
+				{
+					visit(index, state);
+					const auto next = step(code, index, state, flow);
+					if (next == Step::Unknown)
+						return false;
+					if (next == Step::Stop)
+						return true;
+					if (index + 1 < size and leaders[index + 1])
+					{
+						flow(index + 1, state);
+						return true;
+					}
+				}
+				return true;
+			};
+
+			auto operands = std::vector<StaticType>(code.size());
+			if (code.empty())
+				return operands;
+			flow(0, TypeState{ .locals = entry });
+			while (not pending.empty())
+			{
+				const auto index = pending.back();
+				pending.pop_back();
+				if (not run_block(index, *states[index], [](i64, const TypeState&) {}))
+					return std::nullopt;
+			}
+
+			auto record = [&](i64 index, const TypeState& state)
+			{
+				const auto op = code[index].op;
+				if (is_arithmetic(op) or is_relation(op) or is_jump_if_not(op))
+					operands[index] = join(state.peek(0ull), state.peek(1ull));
+			};
+			for (auto index{ 0ll }; index < size; index++)
+				if (states[index])
+					run_block(index, *states[index], record);
+			return operands;
+		}
+
+		/*
+		* Gives the operators that only see numbers as long as the arguments in guarded are numbers their typed opcode.
+		* @return Amount of operators given a typed opcode
+		*/
+		inline auto type_operators(ByteCode& code, const std::vector<StaticType>& operands, u32 guarded) -> u64
+		{
+			auto typed_count = 0ull;
+			for (auto index{ 0ull }; index < code.size(); index++)
+			{
+				if (not operands[index].number or (operands[index].arguments & ~guarded) != 0u)
+					continue;
+				code[index].op = typed(code[index].op);
+				typed_count++;
+			}
+			return typed_count;
+		}
+	}
+
+	/*
+	* Flow sensitive type inference over the stack bytecode of a function, operators that only ever see two numbers get their typed opcode (AddNum, LTNum, ...).
+	* Numbers come from number literals, arithmetic and unary operators on numbers and locals holding those, anything else is unknown.
+	* Arguments can't be proven to be numbers, when operators would only see numbers if some arguments are, the function gets two copies:
+	*	GuardNumbers; copy typed for those arguments being numbers; copy typed without them
+	* The guard jumps to the second copy when one of those arguments is not a number. Both copies end with a Halt so neither runs into the other.
+	* Runs after optimize_bytecode and before fuse_superinstructions. Only for the stack backend.
+	* @param first_argument: Local slot of the first argument, 'this' comes before the arguments of methods
+	* @return Amount of operators given a typed opcode
+	*/
+	inline auto specialize_numbers(ByteCode& code, size_t first_argument = 0ull, size_t argc = 0ull) -> u64
+	{
+		using namespace type_inference;
+		auto entry = std::vector<StaticType>(std::max(local_slots(code), first_argument + argc));
+		for (auto slot{ first_argument }; slot < first_argument + argc and slot < 32ull; slot++) /* As many as GuardNumbers can check */
+			entry[slot] = StaticType{ .number = true, .arguments = 1u << slot };
+
+		const auto operands = operand_types(code, entry);
+		if (not operands)
+			return 0ull;
+		auto guarded = 0u;
+		for (const auto& type : *operands)
+			guarded |= type.number ? type.arguments : 0u;
+		if (guarded == 0u)
+			return type_operators(code, *operands, 0u);
+
+		auto typed_code = code;
+		const auto typed_count = type_operators(typed_code, *operands, guarded) + type_operators(code, *operands, 0u);
+		auto guard = Instruction(OpCode::GuardNumbers);
+		guard.operand.guard.mask = guarded;
+		guard.operand.guard.delta = static_cast<i32>(typed_code.size() + 1ull);
+
+		typed_code.insert(typed_code.begin(), guard);
+		typed_code.insert(typed_code.end(), code.begin(), code.end());
+		code = std::move(typed_code);
+		return typed_count;
+	}
+}
@@ -8,12 +8,28 @@
 #include "Array.h"
 #include "DllModule.h"
 #include "Class.h"
+#include "Range.h"
+#include "String.h"
 
 #include <variant>
 #include <stack>
 
 namespace le
 {
+	/*
+	* How the virtual machine decodes instructions.
+	* Switch: Portable, every instruction goes back through the switch at the top of the dispatch loop.
+	* Threaded: Every opcode jumps straight to the next opcode through a label table (computed goto).
+	* Without compiler support for computed goto Threaded behaves as Switch.
+	*/
+	enum class Dispatch
+	{
+		Switch,
+		Threaded,
+	};
+
+	inline constexpr auto default_dispatch = LE_THREADED_DISPATCH ? Dispatch::Threaded : Dispatch::Switch;
+
 	class VirtualMachine
 	{
 		struct VarStorage
@@ -37,35 +53,113 @@ namespace le
 		using Stack = std::vector<LeObject>;
 		using FunctionArgs = std::vector<LeObject>;
 
-		struct Scope
+		/*
+		* A function call in progress, everything is an offset into the value stack so calling allocates nothing.
+		* The stack of a call looks like: [slot: callable][locals: this, args, variables][operands: temporaries...]
+		* Plain functions start their locals right after the callable, so the arguments the caller pushed become the locals in place.
+		* Member functions overwrite the callable with 'this' and start their locals on the slot.
+		*/
+		struct CallFrame
 		{
-			ProgramCounter end{};
-			VarStorage variables{};
-			Stack stack{};
+			ProgramCounter return_pc{}; /* The Call instruction of the caller */
+			size_t slot{}; /* The stack is cut back to this index on return, the return value takes its place */
+			size_t locals{}; /* Index of local 0 */
+			size_t operands{}; /* Index of the first operand, one past the last local */
+			bool entry{}; /* Entered from native code through run, returning from it leaves the dispatch loop */
 		};
-		
-		std::vector<Scope> _scopes{};
+
+		/*
+		* Capacity of the value stack, it is reserved up front and never grows
+		* so spans over arguments stay valid while a native function calls back into the machine.
+		*/
+		static constexpr auto max_stack_size = 1ull << 20;
+
+		Stack _stack{};
+		std::vector<CallFrame> _frames{};
+		LeObject* _locals{}; /* Local 0 of the current frame, stable as the value stack never reallocates */
 		/* Reusable vector for pushing function args */
 		FunctionArgs _function_args{};
 		VarStorage _global_storage{};
 		LeObject _null_val{};
 		Code* _current_code{ nullptr };
 		ProgramCounter _pc{};
+		Dispatch _dispatch{ default_dispatch };
+		size_t _native_calls{}; /* Runs from native code in progress, see safepoint */
 
-		/* @return returns previous scope */
-		auto open_scope(ProgramCounter end) -> void
-		{ /* Internally std::stack uses a deque which should not invalidate the reference */
-			_scopes.push_back(Scope{ .end = end });
+		/* Counts a run from native code for as long as it lasts */
+		struct NativeCall
+		{
+			size_t& calls;
+			explicit NativeCall(size_t& calls_) : calls(calls_) { calls++; }
+			~NativeCall() { calls--; }
+		};
+
+		/* Marks every value the machine holds, these are the roots of a collection */
+		virtual auto trace_roots(Tracer& tracer) -> void
+		{
+			tracer.mark(_stack);
+			tracer.mark(_function_args);
+			tracer.mark(_global_storage.data);
+			tracer.mark(_null_val);
 		}
 
-		auto open_begin_scope(ProgramCounter end) -> void
+		/*
+		* Lets the collector or the cycle collector run if it wants to, see Collector and CycleCollector. Called between instructions where every value lives on the stack,
+		* at jumps and calls so every loop and recursion passes one.
+		* Native code that called into the machine may hold values of its own, so nothing is collected during a run from native code.
+		* A collection is followed by MemoryManager::compact, the pools it left nearly empty are emptied and given back.
+		*/
+		auto safepoint() -> void
 		{
-			_scopes.push_back(Scope{ .end = end });
+			if constexpr (Collector::enabled)
+			{
+				if (_native_calls == 0 and global::mem->collector().wants_collection())
+				{
+					global::mem->collector().collect([this](Tracer& tracer) { trace_roots(tracer); });
+					global::mem->compact();
+				}
+			}
+			else
+			{
+				if (_native_calls == 0 and global::mem->cycles().wants_collection())
+					global::mem->cycles().collect();
+			}
+		}
+
+		auto ensure_stack(size_t size) -> void
+		{
+			if (size > _stack.capacity())
+				throw(ferr::make_exception(std::format("Stack overflow, more than {} values on the stack", max_stack_size)));
 		}
 
-		auto close_scope() -> void
+		/* Pushes a frame whose locals start at locals and jumps to the start of the function, the caller already pushed argc locals */
+		auto enter(const Frame& function, size_t slot, size_t locals, size_t argc, bool entry) -> void
 		{
-			_scopes.pop_back();
+			const auto operands = locals + std::max<size_t>(function.locals, argc);
+			ensure_stack(operands);
+			_stack.resize(operands); /* Variables start out empty */
+			_frames.push_back(CallFrame{ .return_pc = _pc, .slot = slot, .locals = locals, .operands = operands, .entry = entry });
+			_locals = _stack.data() + locals;
+			_pc = function.code.cbegin();
+		}
+
+		/*
+		* Pops the current frame and pushes the return value in place of the callable.
+		* @param has_value: The top operand is the return value, if there is any
+		* @return True if the frame was entered from run
+		*/
+		auto leave(bool has_value) -> bool
+		{
+			const auto frame = _frames.back();
+			_frames.pop_back();
+
+			auto result = has_value and _stack.size() > frame.operands ? std::move(_stack.back()) : _null_val;
+			_stack.resize(frame.slot);
+			_stack.push_back(std::move(result));
+			_pc = frame.return_pc;
+			if (not _frames.empty())
+				_locals = _stack.data() + _frames.back().locals;
+			return frame.entry;
 		}
 
 		auto get_global(size_t index) -> LeObject
@@ -75,14 +169,13 @@ namespace le
 			return _current_code->globals.at(index);
 		}
 
-		auto storage() -> VarStorage& { return _scopes.back().variables; }
 		auto global_storage() -> VarStorage& { return _global_storage; }
-		auto scope() -> Scope& { return _scopes.back(); }
-		auto stack() -> Stack& { return _scopes.back().stack; }
+		auto stack() -> Stack& { return _stack; }
+		auto local(u64 index) -> LeObject& { return _locals[index]; }
 
 		auto load(u64 index) -> LeObject
 		{
-			return storage().load(index);
+			return local(index);
 		}
 
 		auto load_global(u64 index) -> LeObject
@@ -92,23 +185,25 @@ namespace le
 
 		auto pop() -> LeObject
 		{
-			auto old = stack().back(); stack().pop_back();
+			auto old = std::move(_stack.back()); _stack.pop_back();
 			return old;
 		}
 
 		auto tos() -> LeObject&
 		{
-			return stack().back();
+			return _stack.back();
 		}
 
 		auto pop_no_ret() -> void
 		{
-			stack().pop_back();
+			_stack.pop_back();
 		}
 		
 		auto push(LeObject object) -> void
 		{
-			stack().push_back(object);
+			if (_stack.size() == _stack.capacity())
+				ensure_stack(_stack.size() + 1);
+			_stack.push_back(std::move(object));
 		}
 		
 		/* 
@@ -125,311 +220,833 @@ namespace le
 				pop_no_ret();
 		}
 
-		auto pop(Scope& scope) -> LeObject
-		{
-			auto old = scope.stack.back(); scope.stack.pop_back();
-			return old;
-		}
-
-		auto push(LeObject object, Scope& scope) -> void
-		{
-			scope.stack.push_back(object);
-		}
-
 		auto jump(i64 delta) -> void
 		{ 
 			_pc += delta;
 		}
 
 		auto iterate_pc() -> void { _pc++; }
-		auto halt() -> void { _pc = scope().end; }
 
-#define LE_NEXT_INSTRUCTION iterate_pc(); break
-#define LE_JUMP(delta) jump(delta); break
-		auto evaluate(const Instruction& instr) -> void
+		/* Fast path for binary operators on two numbers, the result is an immediate so nothing gets allocated */
+		static auto number_operation(OpCode op, Number lhs, Number rhs) -> LeObject
 		{
-			switch (instr.op)
+			switch (op)
 			{
-			case OpCode::Halt: halt(); break;
-			case OpCode::Noop: LE_NEXT_INSTRUCTION;
-			case OpCode::ImportDll:
-			{
-				auto dll_name = pop()->make_string();
-				push(global::mem->emplace<DllModule>(StringView(dll_name)));
-				LE_NEXT_INSTRUCTION;
+			case OpCode::Add: case OpCode::RegAdd: return LeObject::from_number(lhs + rhs);
+			case OpCode::Sub: case OpCode::RegSub: return LeObject::from_number(lhs - rhs);
+			case OpCode::Mul: case OpCode::RegMul: return LeObject::from_number(lhs * rhs);
+			case OpCode::Div: case OpCode::RegDiv: return LeObject::from_number(lhs / rhs);
+			case OpCode::GT: case OpCode::RegGT: return LeObject::from_bool(lhs > rhs);
+			case OpCode::GET: case OpCode::RegGET: return LeObject::from_bool(lhs >= rhs);
+			case OpCode::LT: case OpCode::RegLT: return LeObject::from_bool(lhs < rhs);
+			case OpCode::LET: case OpCode::RegLET: return LeObject::from_bool(lhs <= rhs);
+			case OpCode::EQ: case OpCode::RegEQ: return LeObject::from_bool(lhs == rhs);
+			case OpCode::NEQ: case OpCode::RegNEQ: return LeObject::from_bool(lhs != rhs);
+			default:
+				throw(ferr::make_exception(std::format("'{}' is not a binary operator", to_string(op))));
 			}
-			case OpCode::ReturnExpr:
-			{ /* By evaluating the expr, its result should be on top */
-				halt(); break;
+		}
+
+		/* Arithmetic of superinstructions, op is Add, Mul, Div or Sub or their typed opcode as checked by fuse_superinstructions */
+		static auto arithmetic(OpCode op, Number lhs, Number rhs) -> Number
+		{
+			switch (op)
+			{
+			case OpCode::Add: case OpCode::AddNum: return lhs + rhs;
+			case OpCode::Mul: case OpCode::MulNum: return lhs * rhs;
+			case OpCode::Div: case OpCode::DivNum: return lhs / rhs;
+			default: return lhs - rhs;
 			}
-			case OpCode::Return:
-			{ /* Empty return, we clear the stack so we dont return anything */
-				scope().stack.clear();
-				halt(); break;
+		}
+
+		/* Relation of fused jump op, JumpIfNotGT to JumpIfNotNEQ or their typed opcode */
+		static auto relation(OpCode op, Number lhs, Number rhs) -> bool
+		{
+			switch (op)
+			{
+			case OpCode::JumpIfNotGT: case OpCode::JumpIfNotGTNum: return lhs > rhs;
+			case OpCode::JumpIfNotGET: case OpCode::JumpIfNotGETNum: return lhs >= rhs;
+			case OpCode::JumpIfNotLT: case OpCode::JumpIfNotLTNum: return lhs < rhs;
+			case OpCode::JumpIfNotLET: case OpCode::JumpIfNotLETNum: return lhs <= rhs;
+			case OpCode::JumpIfNotEQ: case OpCode::JumpIfNotEQNum: return lhs == rhs;
+			default: return lhs != rhs;
 			}
-			case OpCode::UnaryOp:
+		}
+
+		/* Arithmetic operator op of a superinstruction, anything but two numbers goes through apply_operation */
+		static auto arithmetic(OpCode op, const LeObject& lhs, const LeObject& rhs) -> LeObject
+		{
+			if (lhs.is_number() and rhs.is_number())
+				return LeObject::from_number(arithmetic(op, lhs.as_number(), rhs.as_number()));
+			return lhs->apply_operation(to_token_type(op), rhs);
+		}
+
+		static auto relation(OpCode op, const LeObject& lhs, const LeObject& rhs) -> bool
+		{
+			if (lhs.is_number() and rhs.is_number())
+				return relation(op, lhs.as_number(), rhs.as_number());
+			return lhs->apply_operation(to_token_type(op), rhs).to_native_bool();
+		}
+
+		/*
+		* Resolves the member named by cache once per layout of object.
+		* @return False if object does not keep its members at slots or has no such member, the caller then goes through member_access
+		*/
+		static auto cache_member(RuntimeValue* object, MemberCache& cache) -> bool
+		{
+			const auto layout = object->member_layout();
+			if (layout == 0)
+				return false;
+
+			if (layout != cache.layout)
 			{
-				push(pop()->apply_operation(static_cast<Token::Type>(instr.operand.integer)));
-				LE_NEXT_INSTRUCTION;
+				const auto slot = object->member_slot(cache.name);
+				if (slot == RuntimeValue::no_slot)
+					return false;
+				cache.layout = layout;
+				cache.slot = slot;
 			}
-			case OpCode::Call:
+			return true;
+		}
+
+		/* Implements expr.identifier through the inline cache of the instruction */
+		auto access_member(const LeObject& target, MemberCache& cache) -> LeObject
+		{
+			auto object = target.get();
+			if (object and object->type == RuntimeValue::Type::Class)
+			{ /* The hot case, no virtual calls on a hit */
+				auto instance = static_cast<Class*>(object);
+				if (instance->shape->id == cache.layout)
+					return Method::bind(target, instance->slots[cache.slot]);
+			}
+
+			if (object and cache_member(object, cache))
+				return object->member_at(target, cache.slot);
+			return target->member_access(target, cache.name);
+		}
+
+		/*
+		* Calls the callable at slot with the argc values above it as arguments.
+		* Script functions are entered in place and true is returned, the dispatch loop then continues in the callee.
+		* Anything else is called natively and replaced by its return value.
+		*/
+		auto call(size_t slot, size_t argc) -> bool
+		{
+			const auto& callable = _stack[slot];
+
+			if (callable.type() == RuntimeValue::Type::Function)
 			{
-				auto args_count = instr.operand.uinteger;// _function_args.size();
-				
-				auto& s = stack();
-				auto args_begin = s.end() - args_count;
-				auto args = std::span(args_begin, s.end());
-				
-				auto expected_index_callable = (s.size() - 1 /* Compensate for 0 index */) - args_count;
-				auto ret_val = s.at(expected_index_callable)->call(args, *this);
-				
-				/* Cleanup args from stack */
-				s.erase(args_begin - 1 /* Include callable */, s.end());
-				
-				push(ret_val);
-
-				LE_NEXT_INSTRUCTION;
+				enter(static_cast<CompiledFunction*>(callable.get())->function_frame, slot, slot + 1, argc, false);
+				return true;
 			}
-			case OpCode::Jump:
+			if (auto member = callable.type() == RuntimeValue::Type::Custom ? dynamic_cast<BuiltinMemberFunction*>(callable.get()) : nullptr)
 			{
-				LE_JUMP(instr.operand.integer);
+				const auto& function = member->_function; /* Lives in the globals, not in the member */
+				auto self = member->_this; /* Copied first, overwriting the callable may destroy the member */
+				_stack[slot] = std::move(self);
+				enter(function, slot, slot, argc + 1, false);
+				return true;
 			}
-			case OpCode::JumpIfFalse:
+
+			auto args = std::span(_stack.end() - argc, _stack.end());
+			auto ret_val = _stack[slot]->call(args, *this);
+
+			/* Drop the callable and the arguments */
+			_stack.resize(slot);
+			push(std::move(ret_val));
+			return false;
+		}
+
+		/*
+		* Implements receiver.identifier(args) with the receiver at slot and argc args above it, see call.
+		* Methods of class instances are entered with the receiver as 'this' in place and builtin methods are called on the receiver,
+		* neither makes a bound member.
+		*/
+		auto call_method(size_t slot, size_t argc, MemberCache& cache) -> bool
+		{
+			const auto& receiver = _stack[slot];
+			auto object = receiver.get();
+
+			if (object and object->type == RuntimeValue::Type::Class)
 			{
-				if (not pop()->to_native_bool())
-				{
-					LE_JUMP(instr.operand.integer);
-				}
-				else
+				auto instance = static_cast<Class*>(object);
+				if (instance->shape->id == cache.layout or cache_member(object, cache))
 				{
-					LE_NEXT_INSTRUCTION;
+					const auto& member = instance->slots[cache.slot];
+					if (member.type() == RuntimeValue::Type::Method)
+					{
+						enter(static_cast<Method*>(member.get())->frame(), slot, slot, argc + 1, false);
+						return true;
+					}
+
+					auto callable = member; /* Copied first, overwriting the receiver may destroy the instance */
+					_stack[slot] = std::move(callable);
+					return call(slot, argc);
 				}
 			}
-			case OpCode::GetIter:
+			else if (object and cache_member(object, cache))
 			{
-				auto target = pop();
-				push(target->iterator(target));
-				LE_NEXT_INSTRUCTION;
+				auto args = std::span(_stack.end() - argc, _stack.end());
+				auto ret_val = object->call_member(receiver, cache.slot, args, *this);
+
+				_stack.resize(slot);
+				push(std::move(ret_val));
+				return false;
 			}
-			case OpCode::ForLoop:
+
+			auto callable = receiver->member_access(receiver, cache.name);
+			_stack[slot] = std::move(callable);
+			return call(slot, argc);
+		}
+
+		/*
+		* Starts a for loop over iterable, the loop keeps its state in two locals or registers.
+		* Range, Array and String are iterated in place with the index kept as a number in state[1], so stepping allocates nothing.
+		* Anything else gets its iterator() called unless it is one already, the iterator is then called for every step.
+		*/
+		static auto for_prepare(LeObject* state, LeObject iterable) -> void
+		{
+			switch (iterable.type())
 			{
-				auto empty_span = std::span<LeObject>{};
+			case RuntimeValue::Type::Range: case RuntimeValue::Type::Array: case RuntimeValue::Type::String:
+				state[0] = std::move(iterable);
+				state[1] = LeObject::from_number(0.0);
+				break;
+			case RuntimeValue::Type::Iterator:
+				state[0] = std::move(iterable);
+				state[1].reset();
+				break;
+			default:
+				state[0] = iterable->iterator(iterable);
+				state[1].reset();
+				break;
+			}
+		}
 
-				/* Look for the iterator, this is a somewhat bad and naive solution but will work for now */
-				while (tos()->type != RuntimeValue::Type::Iterator)
-					pop();
+		/*
+		* Steps a for loop started by for_prepare.
+		* @return False once the loop is exhausted, the state is cleared then so the iterable is let go of
+		*/
+		auto for_next(LeObject* state, LeObject& value) -> bool
+		{
+			const auto object = state[0].get();
+			const auto index = state[1].is_number() ? state[1].as_number() : 0.0;
 
-				/* Iterators call next on their call operator */
-				auto iter_res = tos()->call(empty_span, *this);
-				if (iter_res->type != RuntimeValue::Type::Null)
+			switch (object->type)
+			{
+			case RuntimeValue::Type::Range:
+			{
+				const auto& range = *static_cast<Range*>(object);
+				const auto current = range.start + range.step * index;
+				if (current < range.end)
 				{
-					push(iter_res);
-					LE_NEXT_INSTRUCTION;
+					value = LeObject::from_number(current);
+					state[1] = LeObject::from_number(index + 1.0);
+					return true;
 				}
-				else
+				break;
+			}
+			case RuntimeValue::Type::Array:
+			{
+				const auto& data = static_cast<Array*>(object)->data;
+				if (static_cast<size_t>(index) < data.size())
 				{
-					pop(); /* Remove iterator from stack */
-					LE_JUMP(instr.operand.integer);
+					value = data[static_cast<size_t>(index)];
+					state[1] = LeObject::from_number(index + 1.0);
+					return true;
 				}
+				break;
 			}
-			case OpCode::JumpIfTrue:
+			case RuntimeValue::Type::String:
 			{
-				if (pop()->to_native_bool())
+				auto& string = *static_cast<StringValue*>(object);
+				if (static_cast<size_t>(index) < string.string.size())
 				{
-					LE_JUMP(instr.operand.integer);
+					value = string._make_small_string(static_cast<size_t>(index));
+					state[1] = LeObject::from_number(index + 1.0);
+					return true;
 				}
-				else
+				break;
+			}
+			default:
+			{ /* Iterators call next on their call operator */
+				auto empty_span = std::span<LeObject>{};
+				auto next = object->call(empty_span, *this);
+				if (not next.is_null())
 				{
-					LE_NEXT_INSTRUCTION;
+					value = std::move(next);
+					return true;
 				}
+				break;
 			}
-			case OpCode::AccessAssign:
-			{
-				auto target = pop();
-				auto query = pop();
-				auto rhs = pop();
-				target->access_assign(query, rhs);
-				LE_NEXT_INSTRUCTION;
 			}
-			case OpCode::Access:
+
+			state[0].reset();
+			state[1].reset();
+			return false;
+		}
+
+		/* Makes a member of a class instance, the transition to the new shape is cached by the instruction */
+		auto make_member(const LeObject& target, LeObject value, MemberCache& cache) -> void
+		{
+			if (target.type() != RuntimeValue::Type::Class)
+				throw(ferr::make_exception("Cannot assign a member to a non class type"));
+
+			auto instance = static_cast<Class*>(target.get());
+			if (instance->shape->id != cache.layout)
 			{
-				auto target = pop();
-				auto query = pop();
-				push(target->access(query));
-				LE_NEXT_INSTRUCTION;
+				if (instance->shape->slot(cache.name) != RuntimeValue::no_slot)
+					return; /* Already made, the first one stays */
+				cache.layout = instance->shape->id;
+				cache.transition = instance->shape->transition(cache.name);
 			}
-			case OpCode::AccessMember:
-			{
-				auto target = pop();
-				auto query = pop();
-				push(target->member_access(target, static_cast<StringValue*>(query.get())->string));
-				LE_NEXT_INSTRUCTION;
+
+			if (value.type() == RuntimeValue::Type::Function)
+			{ /* Every instance made here gets the same function, so they can share the Method */
+				if (not cache.method or static_cast<Method*>(cache.method.get())->function.raw() != value.raw())
+				{
+					cache.method = global::mem->emplace<Method>(value);
+					global::mem->collector().make_permanent(cache.method);
+				}
+				value = cache.method;
 			}
-			case OpCode::PushEmptyClass:
+			instance->append_member(cache.transition, std::move(value));
+		}
+
+		/* Called before every instruction when dispatching with _Debug set */
+		virtual auto on_step() -> void {}
+
+#if LE_HAS_COMPUTED_GOTO
+#define LE_OPCODE(name) case OpCode::name: op_##name
+#define LE_DISPATCH() \
+	if constexpr (_Mode == Dispatch::Threaded) \
+	{ \
+		if constexpr (_Debug) on_step(); \
+		goto *dispatch_table[static_cast<size_t>(_pc->op)]; \
+	} \
+	else continue
+#else
+#define LE_OPCODE(name) case OpCode::name
+#define LE_DISPATCH() continue
+#endif
+#define LE_NEXT_INSTRUCTION iterate_pc(); LE_DISPATCH()
+#define LE_JUMP(delta) jump(delta); LE_DISPATCH()
+		/*
+		* Runs instructions starting at _pc till a Halt or Return is reached.
+		* Every opcode body is written once, Dispatch::Switch decodes through the switch at the top of the loop
+		* while Dispatch::Threaded jumps straight from the end of one opcode body into the next one through a label table.
+		* NOTE: Leaving a scope through a computed goto does not run destructors,
+		* so locals that own something have to live in a nested scope that is closed before dispatching.
+		*/
+		template<Dispatch _Mode, bool _Debug>
+		auto dispatch() -> void
+		{
+#if LE_HAS_COMPUTED_GOTO
+#define LE_LABEL(name) &&op_##name
+#define LE_UNEXPECTED(name) &&op_Unexpected
+			/* Has to follow the order of the OpCode enum */
+			static void* const dispatch_table[] =
 			{
-				push(global::mem->emplace<Class>());
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::MakeMember:
+				LE_LABEL(Halt), LE_LABEL(Pop), LE_LABEL(Noop), LE_LABEL(ImportDll), LE_LABEL(DupTos),
+				LE_LABEL(PushInt), LE_LABEL(PushReal), LE_LABEL(PushGlobal), LE_LABEL(PushString), LE_LABEL(PushFunction),
+				LE_LABEL(MakeArray), LE_LABEL(PushNull), LE_LABEL(MakeMember), LE_LABEL(PushEmptyClass),
+				LE_LABEL(GetIter), LE_LABEL(ForLoop),
+				LE_LABEL(Store), LE_LABEL(StoreGlobal), LE_LABEL(Load), LE_LABEL(LoadGlobal),
+				LE_LABEL(Access), LE_LABEL(AccessAssign), LE_LABEL(AccessMember),
+				LE_LABEL(Call), LE_LABEL(CallFunction), LE_LABEL(CallMethod),
+				LE_LABEL(ReturnExpr), LE_LABEL(Return),
+				LE_LABEL(Jump), LE_LABEL(JumpIfTrue), LE_LABEL(JumpIfFalse),
+				LE_LABEL(Add), LE_LABEL(Mul), LE_LABEL(Div), LE_LABEL(Sub),
+				LE_LABEL(UnaryOp),
+				LE_LABEL(GT), LE_LABEL(GET), LE_LABEL(LT), LE_LABEL(LET), LE_LABEL(EQ), LE_LABEL(NEQ),
+				LE_LABEL(JumpIfNotGT), LE_LABEL(JumpIfNotGET), LE_LABEL(JumpIfNotLT),
+				LE_LABEL(JumpIfNotLET), LE_LABEL(JumpIfNotEQ), LE_LABEL(JumpIfNotNEQ),
+				LE_LABEL(LoadLoad), LE_LABEL(LoadLoadOp), LE_LABEL(LoadRealOp),
+				LE_LABEL(LoadRealOpStore), LE_LABEL(LoadRealJumpIfNot), LE_LABEL(OpStore),
+				LE_LABEL(AddNum), LE_LABEL(MulNum), LE_LABEL(DivNum), LE_LABEL(SubNum),
+				LE_LABEL(GTNum), LE_LABEL(GETNum), LE_LABEL(LTNum), LE_LABEL(LETNum), LE_LABEL(EQNum), LE_LABEL(NEQNum),
+				LE_LABEL(JumpIfNotGTNum), LE_LABEL(JumpIfNotGETNum), LE_LABEL(JumpIfNotLTNum),
+				LE_LABEL(JumpIfNotLETNum), LE_LABEL(JumpIfNotEQNum), LE_LABEL(JumpIfNotNEQNum),
+				LE_LABEL(GuardNumbers),
+				/* Register backend opcodes are never executed by the stack machine */
+				LE_UNEXPECTED(RegMove), LE_UNEXPECTED(RegLoadConst), LE_UNEXPECTED(RegLoadNull),
+				LE_UNEXPECTED(RegLoadGlobal), LE_UNEXPECTED(RegStoreGlobal),
+				LE_UNEXPECTED(RegAdd), LE_UNEXPECTED(RegMul), LE_UNEXPECTED(RegDiv), LE_UNEXPECTED(RegSub),
+				LE_UNEXPECTED(RegGT), LE_UNEXPECTED(RegGET), LE_UNEXPECTED(RegLT), LE_UNEXPECTED(RegLET),
+				LE_UNEXPECTED(RegEQ), LE_UNEXPECTED(RegNEQ), LE_UNEXPECTED(RegUnaryOp),
+				LE_UNEXPECTED(RegJumpIfFalse), LE_UNEXPECTED(RegJumpIfNotGT), LE_UNEXPECTED(RegJumpIfNotGET),
+				LE_UNEXPECTED(RegJumpIfNotLT), LE_UNEXPECTED(RegJumpIfNotLET), LE_UNEXPECTED(RegJumpIfNotEQ),
+				LE_UNEXPECTED(RegJumpIfNotNEQ), LE_UNEXPECTED(RegCall), LE_UNEXPECTED(RegCallMethod), LE_UNEXPECTED(RegReturn),
+				LE_UNEXPECTED(RegAccess), LE_UNEXPECTED(RegAccessAssign), LE_UNEXPECTED(RegAccessMember),
+				LE_UNEXPECTED(RegMakeArray), LE_UNEXPECTED(RegNewClass), LE_UNEXPECTED(RegMakeMember),
+				LE_UNEXPECTED(RegGetIter), LE_UNEXPECTED(RegForLoop), LE_UNEXPECTED(RegImportDll),
+			};
+			static_assert(std::size(dispatch_table) == opcode_count, "Every opcode needs an entry in the dispatch table");
+#undef LE_LABEL
+#undef LE_UNEXPECTED
+#endif
+			while (true)
 			{
-				auto target = pop();
-				auto member = pop(); /* Could maybe make the operand of the opcode hold index to member in global string array */
-				auto value = pop();
+				if constexpr (_Debug) on_step();
 
-				if (target->type != RuntimeValue::Type::Class)
-					throw(ferr::make_exception("Cannot assign a member to a non class type"));
+				switch (_pc->op)
+				{
+				LE_OPCODE(Halt):
+				{ /* Falling off the end of a function returns the last operand, like ReturnExpr */
+					if (leave(true)) return;
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Noop): LE_NEXT_INSTRUCTION;
+				LE_OPCODE(Pop):
+				{
+					pop_no_ret();
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(ImportDll):
+				{
+					{
+						auto dll_name = pop()->make_string();
+						push(global::mem->emplace<DllModule>(StringView(dll_name)));
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(ReturnExpr):
+				{ /* By evaluating the expr, its result should be on top */
+					if (leave(true)) return;
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Return):
+				{ /* Empty return, ignore the operands so we dont return anything */
+					if (leave(false)) return;
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(UnaryOp):
+				{
+					push(pop()->apply_operation(static_cast<Token::Type>(_pc->operand.integer)));
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Call):
+				{
+					safepoint();
+					if (call(_stack.size() - 1 /* Compensate for 0 index */ - _pc->operand.uinteger, _pc->operand.uinteger))
+					{
+						LE_DISPATCH();
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(CallMethod):
+				{
+					safepoint();
+					const auto& operand = _pc->operand.method;
+					if (call_method(_stack.size() - 1 - operand.argc, operand.argc, _current_code->member_caches[operand.cache]))
+					{
+						LE_DISPATCH();
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Jump):
+				{
+					safepoint();
+					LE_JUMP(_pc->operand.integer);
+				}
+				LE_OPCODE(JumpIfFalse):
+				{
+					if (not pop().to_native_bool())
+					{
+						LE_JUMP(_pc->operand.integer);
+					}
+					else
+					{
+						LE_NEXT_INSTRUCTION;
+					}
+				}
+				LE_OPCODE(GetIter):
+				{ /* The third local of the state is the operand stack height, values the body leaves behind are dropped every step */
+					{
+						auto iterable = pop();
+						for_prepare(&local(_pc->operand.uinteger), std::move(iterable));
+						local(_pc->operand.uinteger + 2) = LeObject::from_number(static_cast<Number>(_stack.size()));
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(ForLoop):
+				{
+					auto exhausted = false;
+					{
+						const auto state = &local(_pc->operand.loop.state);
+						_stack.resize(static_cast<size_t>(state[2].as_number()));
 
-				static_cast<Class*>(target.get())->make_member(target, getters::get_string_ref(member, "Assigning member to class"), value);
+						auto next = LeObject{};
+						exhausted = not for_next(state, next);
+						if (not exhausted)
+							push(std::move(next));
+					}
 
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::MakeArray:
-			{
-				const auto array_size = instr.operand.uinteger;
-				auto array = global::mem->emplace<Array>();
-				array->data.resize(array_size, nullptr);
-				/* TOS is last element, add in reverse */
-				std::for_each(array->data.rbegin(), array->data.rend(),
-					[this](LeObject& obj)
+					if (exhausted)
 					{
-						obj = pop();
-					});
-				push(array);
-				LE_NEXT_INSTRUCTION;
-			}
+						LE_JUMP(_pc->operand.loop.delta);
+					}
+					else
+					{
+						LE_NEXT_INSTRUCTION;
+					}
+				}
+				LE_OPCODE(JumpIfTrue):
+				{
+					if (pop().to_native_bool())
+					{
+						LE_JUMP(_pc->operand.integer);
+					}
+					else
+					{
+						LE_NEXT_INSTRUCTION;
+					}
+				}
+				LE_OPCODE(AccessAssign):
+				{
+					{
+						auto target = pop();
+						auto query = pop();
+						auto rhs = pop();
+						target->access_assign(query, rhs);
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Access):
+				{
+					{
+						auto target = pop();
+						auto query = pop();
+						push(target->access(query));
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(AccessMember):
+				{
+					{
+						auto member = access_member(tos(), _current_code->member_caches[_pc->operand.uinteger]);
+						tos() = std::move(member);
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(PushEmptyClass):
+				{
+					push(global::mem->emplace<Class>());
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(MakeMember):
+				{
+					{
+						auto target = pop();
+						make_member(target, pop(), _current_code->member_caches[_pc->operand.uinteger]);
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(MakeArray):
+				{
+					{
+						const auto array_size = _pc->operand.uinteger;
+						auto array = global::mem->emplace<Array>();
+						array->data.resize(array_size, nullptr);
+						/* TOS is last element, add in reverse */
+						std::for_each(array->data.rbegin(), array->data.rend(),
+							[this](LeObject& obj)
+							{
+								obj = MemoryManager::promote(pop());
+							});
+						push(array);
+					}
+					LE_NEXT_INSTRUCTION;
+				}
 /* Pushes a global from the Code's global storage aka a string literal or function bytecode */
-			case OpCode::PushGlobal:
-			{
-				push(get_global(instr.operand.uinteger));
-				LE_NEXT_INSTRUCTION;
-			}
+				LE_OPCODE(PushGlobal):
+				{
+					push(get_global(_pc->operand.uinteger));
+					LE_NEXT_INSTRUCTION;
+				}
 /* Loads a global variable from the virtual machines global memory, aka a global variable */
-			case OpCode::LoadGlobal:
-			{
-				push(load_global(instr.operand.uinteger));
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::Load:
-			{
-				push(load(instr.operand.uinteger));
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::StoreGlobal:
-			{
-				global_storage().store(instr.operand.uinteger, pop());
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::Store:
-			{
-				storage().store(instr.operand.uinteger, pop());
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::DupTos:
-			{
-				push(tos());
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::PushReal:
-			{
-				push(global::mem->emplace<NumberValue>(instr.operand.real));
-				LE_NEXT_INSTRUCTION;
-			}
-			case OpCode::PushNull:
-			{
-				push(_null_val);
-				LE_NEXT_INSTRUCTION;
-			}
-			/* Operators */
-			/* Arithmetic */
-			case OpCode::Add: case OpCode::Mul: 
-			case OpCode::Div: case OpCode::Sub:
-			/* Relational */
-			case OpCode::GT: case OpCode::GET:
-			case OpCode::EQ: case OpCode::NEQ:
-			case OpCode::LT: case OpCode::LET:
-			{ /* Lhs is second on stack so we have to call apply on second */
-				auto rhs = pop();
-				push(pop()->apply_operation(to_token_type(instr.op), rhs));
-				LE_NEXT_INSTRUCTION;
-			}
-			default:
-				throw(ferr::make_exception("Unexpected Opcode encountered"));
+				LE_OPCODE(LoadGlobal):
+				{
+					push(load_global(_pc->operand.uinteger));
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Load):
+				{
+					push(load(_pc->operand.uinteger));
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(StoreGlobal):
+				{
+					global_storage().store(_pc->operand.uinteger, pop());
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(Store):
+				{
+					local(_pc->operand.uinteger) = pop();
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(DupTos):
+				{
+					push(tos());
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(PushReal):
+				{
+					push(LeObject::from_number(_pc->operand.real));
+					LE_NEXT_INSTRUCTION;
+				}
+				LE_OPCODE(PushNull):
+				{
+					push(_null_val);
+					LE_NEXT_INSTRUCTION;
+				}
+				/* Operators */
+				/* Arithmetic */
+				LE_OPCODE(Add): LE_OPCODE(Mul):
+				LE_OPCODE(Div): LE_OPCODE(Sub):
+				/* Relational */
+				LE_OPCODE(GT): LE_OPCODE(GET):
+				LE_OPCODE(EQ): LE_OPCODE(NEQ):
+				LE_OPCODE(LT): LE_OPCODE(LET):
+				{ /* Lhs is second on stack so we have to call apply on second */
+					{
+						auto rhs = pop();
+						auto& lhs = tos();
+						if (lhs.is_number() and rhs.is_number())
+							lhs = number_operation(_pc->op, lhs.as_number(), rhs.as_number());
+						else
+							lhs = lhs->apply_operation(to_token_type(_pc->op), rhs);
+					}
+					LE_NEXT_INSTRUCTION;
+				}
+				/* Fused compare and branch, two numbers are compared inline and anything else goes through apply_operation */
+#define LE_JUMP_IF_NOT(name, relation) \
+				LE_OPCODE(name): \
+				{ \
+					auto holds = false; \
+					{ \
+						auto& s = stack(); \
+						const auto& lhs = s[s.size() - 2]; \
+						const auto& rhs = s.back(); \
+						if (lhs.is_number() and rhs.is_number()) \
+							holds = lhs.as_number() relation rhs.as_number(); \
+						else \
+							holds = lhs->apply_operation(to_token_type(OpCode::name), rhs).to_native_bool(); \
+						s.pop_back(); \
+						s.pop_back(); \
+					} \
+					if (holds) \
+					{ \
+						LE_NEXT_INSTRUCTION; \
+					} \
+					LE_JUMP(_pc->operand.integer); \
+				}
+				LE_JUMP_IF_NOT(JumpIfNotGT, >)
+				LE_JUMP_IF_NOT(JumpIfNotGET, >=)
+				LE_JUMP_IF_NOT(JumpIfNotLT, <)
+				LE_JUMP_IF_NOT(JumpIfNotLET, <=)
+				LE_JUMP_IF_NOT(JumpIfNotEQ, ==)
+				LE_JUMP_IF_NOT(JumpIfNotNEQ, !=)
+#undef LE_JUMP_IF_NOT
+				/* Typed operators, specialize_numbers proved both operands are numbers */
+#define LE_NUMBER_OPERATOR(name, operator, make) \
+				LE_OPCODE(name): \
+				{ \
+					{ \
+						auto& s = stack(); \
+						const auto rhs = s.back().as_number(); \
+						s.pop_back(); \
+						s.back() = LeObject::make(s.back().as_number() operator rhs); \
+					} \
+					LE_NEXT_INSTRUCTION; \
+				}
+				LE_NUMBER_OPERATOR(AddNum, +, from_number)
+				LE_NUMBER_OPERATOR(MulNum, *, from_number)
+				LE_NUMBER_OPERATOR(DivNum, /, from_number)
+				LE_NUMBER_OPERATOR(SubNum, -, from_number)
+				LE_NUMBER_OPERATOR(GTNum, >, from_bool)
+				LE_NUMBER_OPERATOR(GETNum, >=, from_bool)
+				LE_NUMBER_OPERATOR(LTNum, <, from_bool)
+				LE_NUMBER_OPERATOR(LETNum, <=, from_bool)
+				LE_NUMBER_OPERATOR(EQNum, ==, from_bool)
+				LE_NUMBER_OPERATOR(NEQNum, !=, from_bool)
+#undef LE_NUMBER_OPERATOR
+#define LE_JUMP_IF_NOT_NUMBER(name, relation) \
+				LE_OPCODE(name): \
+				{ \
+					auto holds = false; \
+					{ \
+						auto& s = stack(); \
+						holds = s[s.size() - 2].as_number() relation s.back().as_number(); \
+						s.pop_back(); \
+						s.pop_back(); \
+					} \
+					if (holds) \
+					{ \
+						LE_NEXT_INSTRUCTION; \
+					} \
+					LE_JUMP(_pc->operand.integer); \
+				}
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotGTNum, >)
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotGETNum, >=)
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotLTNum, <)
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotLETNum, <=)
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotEQNum, ==)
+				LE_JUMP_IF_NOT_NUMBER(JumpIfNotNEQNum, !=)
+#undef LE_JUMP_IF_NOT_NUMBER
+				/* Leads the copy of a function specialized for arguments that are numbers, the jump goes to the untyped copy */
+				LE_OPCODE(GuardNumbers):
+				{
+					auto numbers = true;
+					for (auto mask = _pc->operand.guard.mask; mask != 0u and numbers; mask &= mask - 1u)
+						numbers = local(std::countr_zero(mask)).is_number();
+					if (numbers)
+					{
+						LE_NEXT_INSTRUCTION;
+					}
+					LE_JUMP(_pc->operand.guard.delta);
+				}
+				/* Superinstructions, the instructions after _pc are the rest of the fused sequence */
+				LE_OPCODE(LoadLoad):
+				{
+					push(load(_pc[0].operand.uinteger));
+					push(load(_pc[1].operand.uinteger));
+					_pc += 2;
+					LE_DISPATCH();
+				}
+				LE_OPCODE(LoadLoadOp):
+				{
+					push(arithmetic(_pc[2].op, local(_pc[0].operand.uinteger), local(_pc[1].operand.uinteger)));
+					_pc += 3;
+					LE_DISPATCH();
+				}
+				LE_OPCODE(LoadRealOp):
+				{
+					push(arithmetic(_pc[2].op, local(_pc[0].operand.uinteger), LeObject::from_number(_pc[1].operand.real)));
+					_pc += 3;
+					LE_DISPATCH();
+				}
+				LE_OPCODE(LoadRealOpStore):
+				{
+					{
+						auto result = arithmetic(_pc[2].op, local(_pc[0].operand.uinteger), LeObject::from_number(_pc[1].operand.real));
+						local(_pc[3].operand.uinteger) = std::move(result);
+					}
+					_pc += 4;
+					LE_DISPATCH();
+				}
+				LE_OPCODE(LoadRealJumpIfNot):
+				{
+					if (relation(_pc[2].op, local(_pc[0].operand.uinteger), LeObject::from_number(_pc[1].operand.real)))
+					{
+						_pc += 3;
+						LE_DISPATCH();
+					}
+					LE_JUMP(2 + _pc[2].operand.integer); /* The delta is relative to the fused jump */
+				}
+				LE_OPCODE(OpStore):
+				{
+					{
+						auto rhs = pop();
+						auto lhs = pop();
+						local(_pc[1].operand.uinteger) = arithmetic(static_cast<OpCode>(_pc[0].operand.uinteger), lhs, rhs);
+					}
+					_pc += 2;
+					LE_DISPATCH();
+				}
+				/* Not emitted by the compiler */
+				LE_OPCODE(PushInt): LE_OPCODE(PushString):
+				LE_OPCODE(PushFunction): LE_OPCODE(CallFunction):
+				default:
+#if LE_HAS_COMPUTED_GOTO
+				op_Unexpected:
+#endif
+					throw(ferr::make_exception(std::format("Unexpected Opcode '{}' encountered", to_string(_pc->op))));
+				}
 			}
 		}
+#undef LE_OPCODE
+#undef LE_DISPATCH
 #undef LE_NEXT_INSTRUCTION
 #undef LE_JUMP
 
-		virtual auto _run(ProgramCounter pc, ProgramCounter end) -> void
+		auto dispatch(Dispatch mode) -> void
 		{
-			while (_pc != end)
-			{
-				evaluate(*_pc);
-			}
+			if (mode == Dispatch::Threaded)
+				dispatch<Dispatch::Threaded, false>();
+			else
+				dispatch<Dispatch::Switch, false>();
+		}
+
+		/* Runs the dispatch loop till the frame entered from native code returns */
+		virtual auto _run() -> void
+		{
+			dispatch(_dispatch);
 		}
 	public:
 		VirtualMachine()
 		{
 			_null_val = global::null;
+			_stack.reserve(max_stack_size);
 		}
 
-		auto run(const Frame& frame, std::span<LeObject>& args, LeObject this_ptr = nullptr) -> LeObject
+		explicit VirtualMachine(Dispatch mode)
+			: VirtualMachine()
 		{
-			auto old_pc = _pc;
-			_pc = frame.code.cbegin();
-
-			auto end = frame.code.cend();
+			_dispatch = mode;
+		}
 
-			open_scope(end);
+		auto dispatch_mode() const -> Dispatch { return _dispatch; }
+		auto set_dispatch_mode(Dispatch mode) -> void { _dispatch = mode; }
 
-			auto argc{ 0ull };
-			if (this_ptr)
-				storage().store(argc++, this_ptr);
-			for (auto & arg : args)
-			{
-				storage().store(argc++, arg);
-			}
+		virtual ~VirtualMachine() = default;
 
-			_run(_pc, end);
+		/*
+		* Runs a function from native code, called from CompiledFunction::call and BuiltinMemberFunction::call.
+		* Calls made by the script itself never come through here, the Call instruction enters them in place.
+		*/
+		virtual auto run(const Frame& frame, std::span<LeObject>& args, LeObject this_ptr = nullptr) -> LeObject
+		{
+			const auto old_pc = _pc;
+			const auto slot = _stack.size();
+			const auto argc = args.size() + (this_ptr ? 1ull : 0ull);
+			const auto native_call = NativeCall(_native_calls);
 
-			auto return_val = _null_val;
-			if (not stack().empty())
-			{
-				return_val = pop();
-			}
+			/* args may point into the value stack, which is fine as it never reallocates */
+			ensure_stack(slot + argc);
+			if (this_ptr)
+				_stack.push_back(std::move(this_ptr));
+			for (auto& arg : args)
+				_stack.push_back(arg);
 
-			close_scope();
+			enter(frame, slot, slot, argc, true);
+			_run();
 
+			auto return_val = pop();
 			_pc = old_pc;
-
 			return return_val;
 		}
 
 		auto run(Code& code) -> std::variant<LeObject, String>
 		{
 			_current_code = &code;
-			_pc = _current_code->code.cbegin();
 
 			try
 			{
-				auto end = _current_code->code.cend();
-				open_begin_scope(end);
-				
-				_run(_pc, end);
+				ensure_stack(code.locals);
+				_stack.resize(code.locals);
+				_frames.push_back(CallFrame{ .return_pc = code.code.cbegin(), .operands = code.locals, .entry = true });
+				_locals = _stack.data();
+				_pc = code.code.cbegin();
 
-				if (stack().empty())
-				{
-					close_scope();
-					return _null_val;
-				}
-				else
-				{
-					auto ret = pop();
-					close_scope();
-					return ret;
-				}
+				_run();
+
+				return pop();
 			}
 			catch (const std::exception& e)
 			{
+				_stack.clear();
+				_frames.clear();
 				return String(e.what());
 			}
 		}
@@ -444,17 +1061,23 @@ namespace le
 	protected:
 		Debugger _debugger{};
 
-		auto _run(ProgramCounter pc, ProgramCounter end) -> void override
+		auto on_step() -> void override
 		{
-			while (_pc != end)
-			{
-				_debugger(*this);
-				evaluate(*_pc);
-			}
+			_debugger(*this);
+		}
+
+		auto _run() -> void override
+		{
+			if (_dispatch == Dispatch::Threaded)
+				dispatch<Dispatch::Threaded, true>();
+			else
+				dispatch<Dispatch::Switch, true>();
 		}
 	public:
 		using VirtualMachine::VirtualMachine;
 		using VirtualMachine::run;
+
+		auto debugger() -> Debugger& { return _debugger; }
 	};
 
 	constexpr auto size__virtualmachine = sizeof(VirtualMachine);
@@ -0,0 +1,22 @@
+#include "Value.h"
+#include "Number.h"
+#include "Boolean.h"
+#include "Null.h"
+
+#include <memory>
+
+static_assert(sizeof(le::Value) == sizeof(le::u64));
+static_assert(sizeof(le::NumberValue) <= le::Value::accessor_storage_size);
+static_assert(sizeof(le::Boolean) <= le::Value::accessor_storage_size);
+static_assert(sizeof(le::NullValue) <= le::Value::accessor_storage_size);
+
+/* Materialized objects hold no Values and nothing counts a reference to them (refs stays 0), so the Accessor drops them without calling a destructor */
+auto le::Value::materialize(std::byte* storage) const -> RuntimeValue*
+{
+    if (is_number())
+        return std::construct_at(reinterpret_cast<NumberValue*>(storage), as_number());
+    if (is_bool())
+        return std::construct_at(reinterpret_cast<Boolean*>(storage), as_bool());
+    /* Empty is treated as null */
+    return std::construct_at(reinterpret_cast<NullValue*>(storage));
+}
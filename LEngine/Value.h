@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common.h"
+
+#include <bit>
+#include <utility>
+#include <memory>
+#include <cstddef>
+#include <concepts>
+
+/*
+* NaN boxed value, the type every LeObject is.
+*
+* Doubles are stored as is. Every other value hides in the payload of a quiet NaN that real arithmetic never produces:
+*	Empty, Null, False and True are small tags
+*	Heap objects (strings, arrays, classes, functions...) are a pointer with the sign bit set
+* So numbers, booleans and null never touch the memory manager.
+*
+* Heap objects count their references themselves, Values share that count with the Ref handed out by MemoryManager::emplace.
+* Copying a Value is therefore a non atomic increment, see RuntimeValue::refs.
+* With LE_TRACING_GC set the first Value hands the object to the collector instead and copying a Value touches nothing else, see Collector.h.
+*/
+
+namespace le
+{
+	struct RuntimeValue;
+	template<typename _T> class Ref;
+	struct NumberValue;
+	struct Boolean;
+	struct NullValue;
+
+	class Value
+	{
+		static constexpr auto quiet_nan = 0x7ffc'0000'0000'0000ull;
+		static constexpr auto sign_bit = 0x8000'0000'0000'0000ull;
+		static constexpr auto canonical_nan = 0x7ff8'0000'0000'0000ull;
+
+		static constexpr auto tag_empty = quiet_nan | 0ull;
+		static constexpr auto tag_null = quiet_nan | 1ull;
+		static constexpr auto tag_false = quiet_nan | 2ull;
+		static constexpr auto tag_true = quiet_nan | 3ull;
+		static constexpr auto tag_object = sign_bit | quiet_nan;
+
+		u64 _bits{ tag_empty };
+
+		constexpr explicit Value(u64 bits, int) : _bits(bits) {}
+
+		/* Defined in Builtin.h as they need RuntimeValue to be complete, both expect is_object() */
+		auto retain() const -> void;
+		auto release() const -> void;
+		/* Takes over a reference to object */
+		auto pin(RuntimeValue* object) -> void;
+
+		/* Constructs a temporary object of the immediate within storage so it can be used through the RuntimeValue interface */
+		auto materialize(std::byte* storage) const -> RuntimeValue*;
+	public:
+		/* Result of operator->, immediates are materialized into it for the duration of the expression */
+		class Accessor
+		{
+			friend class Value;
+			alignas(std::max_align_t) std::byte _storage[48];
+			RuntimeValue* _ptr{};
+
+			explicit Accessor(RuntimeValue* ptr) : _ptr(ptr) {}
+			explicit Accessor(const Value& immediate) : _ptr(immediate.materialize(_storage)) {}
+		public:
+			Accessor(const Accessor&) = delete;
+			auto operator=(const Accessor&) = delete;
+
+			auto operator->() const -> RuntimeValue* { return _ptr; }
+		};
+		static constexpr auto accessor_storage_size = sizeof(Accessor::_storage);
+
+		constexpr Value() = default;
+		constexpr Value(std::nullptr_t) {}
+
+		/* Takes over a pointer made by the memory manager, builtin immediates are unboxed */
+		template<typename _T>
+			requires std::derived_from<_T, RuntimeValue>
+		Value(Ref<_T> object)
+		{
+			if (not object) return;
+			if constexpr (std::same_as<_T, NumberValue>)
+				_bits = from_number(object->number)._bits;
+			else if constexpr (std::same_as<_T, Boolean>)
+				_bits = from_bool(object->val)._bits;
+			else if constexpr (std::same_as<_T, NullValue>)
+				_bits = tag_null;
+			else
+				pin(object.detach());
+		}
+
+		Value(const Value& other) : _bits(other._bits) { if (is_object()) retain(); }
+		Value(Value&& other) noexcept : _bits(std::exchange(other._bits, tag_empty)) {}
+
+		auto operator=(const Value& other) -> Value&
+		{
+			const auto bits = other._bits; /* other may be owned by what this releases */
+			if (other.is_object()) other.retain(); /* Retain first incase of self assignment */
+			if (is_object()) release();
+			_bits = bits;
+			return *this;
+		}
+
+		auto operator=(Value&& other) noexcept -> Value&
+		{
+			if (this != &other)
+			{
+				if (is_object()) release();
+				_bits = std::exchange(other._bits, tag_empty);
+			}
+			return *this;
+		}
+
+		constexpr ~Value() { if (is_object()) release(); }
+
+		static constexpr auto from_number(Number number) -> Value
+		{
+			if (number != number) /* Every NaN is folded into one that cannot be confused with a tag */
+				return Value(canonical_nan, 0);
+			return Value(std::bit_cast<u64>(number), 0);
+		}
+		static constexpr auto from_bool(bool boolean) -> Value { return Value(boolean ? tag_true : tag_false, 0); }
+		static constexpr auto null() -> Value { return Value(tag_null, 0); }
+
+		constexpr auto is_number() const -> bool { return (_bits & quiet_nan) != quiet_nan; }
+		constexpr auto is_bool() const -> bool { return (_bits | 1ull) == tag_true; }
+		constexpr auto is_null() const -> bool { return _bits == tag_null; }
+		constexpr auto is_object() const -> bool { return (_bits & tag_object) == tag_object; }
+
+		/* Unchecked, use the is_ functions or getters:: */
+		constexpr auto as_number() const -> Number { return std::bit_cast<Number>(_bits); }
+		constexpr auto as_bool() const -> bool { return _bits == tag_true; }
+		auto object() const -> RuntimeValue* { return reinterpret_cast<RuntimeValue*>(_bits & ~tag_object); }
+
+		/* Behaves like Ref::get, immediates have no stable address and return nullptr */
+		auto get() const -> RuntimeValue* { return is_object() ? object() : nullptr; }
+
+		/* Defined in Builtin.h, returns RuntimeValue::Type */
+		auto type() const;
+		auto to_native_bool() const -> bool;
+
+		auto operator->() const -> Accessor
+		{
+			if (is_object())
+				return Accessor(object());
+			return Accessor(*this);
+		}
+
+		/* False only for the empty value, Null is a value */
+		constexpr explicit operator bool() const { return _bits != tag_empty; }
+
+		auto reset() -> void { if (is_object()) release(); _bits = tag_empty; }
+
+		/* Identity, numbers compare by bits */
+		constexpr auto raw() const -> u64 { return _bits; }
+	};
+}
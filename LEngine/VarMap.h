@@ -21,6 +21,13 @@ namespace le
 				throw(ferr::variable_already_declared(str));
 			return map.insert({ str, count++ }).first->second;
 		}
+		/* @return Index of the first of n unnamed slots, eg. the state of a for loop */
+		auto reserve(Index n) -> Index
+		{
+			const auto first = count;
+			count += n;
+			return first;
+		}
 		auto get(const Symbol& str) -> Index
 		{
 			if (not has(str))
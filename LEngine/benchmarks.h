@@ -0,0 +1,319 @@
+#pragma once
+
+#include "common.h"
+#include "Runner.h"
+#include "VM.h"
+#include "RegisterVM.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <optional>
+#include <limits>
+
+/*
+* Small scripts that stress the virtual machine.
+* Every benchmark is compiled once and then timed with each dispatch mode so the modes can be compared on the same code.
+* The register backend compiles its own code, its instruction count is reported next to the stack backend's.
+*/
+
+#define LE_BENCHMARK(name) Benchmark{ #name,
+#define LE_BENCHMARK_END() },
+
+namespace le::benchmark
+{
+	struct Benchmark
+	{
+		StringView name{};
+		StringView source{};
+	};
+
+	static inline auto _benchmarks = std::vector<Benchmark>
+	{
+		LE_BENCHMARK(while_counter)
+			R"(
+	var i = 0
+	while i < 1000000:
+		i = i + 1
+	end
+	i
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(nested_while_arithmetic)
+			R"(
+	var total = 0
+	var i = 0
+	while i < 1000:
+		var j = 0
+		while j < 500:
+			total = total + i * j - j / 2
+			j = j + 1
+		end
+		i = i + 1
+	end
+	total
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(fibonacci)
+			R"(
+	fn fibo(n):
+		if n > 1:
+			return fibo(n - 1) + fibo(n - 2) end
+		return n
+	end
+	fibo(22)
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(small_functions)
+			R"(
+	fn square(x):
+		return x * x
+	end
+	fn add(a, b):
+		return a + b
+	end
+	var total = 0
+	var i = 0
+	while i < 200000:
+		total = add(total, square(i) / 1000)
+		i = i + 1
+	end
+	total
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(member_access)
+			R"(
+	class Counter:
+		var value = 0
+		var step = 1
+
+		fn add(n):
+			this.value = this.value + n * this.step
+			return this.value
+		end
+	end
+
+	var counter = Counter()
+	var i = 0
+	while i < 200000:
+		counter.add(i)
+		i = i + 1
+	end
+	counter.value
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(for_range)
+			R"(
+	var total = 0
+	for i in Range(0, 300000):
+		total = total + i
+	end
+	total
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(for_array)
+			R"(
+	var values = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]
+	var total = 0
+	for i in Range(0, 30000):
+		for value in values:
+			total = total + value
+		end
+	end
+	total
+)"
+		LE_BENCHMARK_END()
+
+		LE_BENCHMARK(allocation)
+			R"(
+	class Point:
+		var x = 0
+		var y = 0
+	end
+
+	var total = 0
+	var i = 0
+	while i < 100000:
+		var point = Point()
+		point.x = i
+		var pair = [point, [i, i + 1]]
+		total = total + pair[1][1] - pair[0].x
+		i = i + 1
+	end
+	total
+)"
+		LE_BENCHMARK_END()
+	};
+
+	/* @return Milliseconds spent running code on a vm made by make_vm, the fastest of n runs */
+	template<typename _MakeVM>
+	inline auto time_run(Code& code, _MakeVM make_vm, size_t runs) -> double
+	{
+		auto best = std::numeric_limits<double>::max();
+		for (auto i{ 0ull }; i < runs; i++)
+		{
+			auto vm = make_vm();
+			const auto begin = std::chrono::steady_clock::now();
+			auto result = vm.run(code);
+			const auto end = std::chrono::steady_clock::now();
+
+			if (std::holds_alternative<String>(result))
+				throw(ferr::make_exception(std::get<String>(result)));
+
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - begin).count());
+		}
+		return best;
+	}
+
+	/* @return Instructions in the code including those of every function it declares */
+	inline auto instruction_count(const Code& code) -> size_t
+	{
+		auto count = code.code.size();
+		for (const auto& global : code.globals)
+			if (auto function = dynamic_cast<CompiledFunction*>(global.get()))
+				count += function->function_frame.code.size();
+		return count;
+	}
+
+	inline auto run(const Benchmark& benchmark, size_t runs) -> void
+	{
+		auto code = parse(benchmark.source, benchmark.name).and_then(compile);
+		auto register_code = parse(benchmark.source, benchmark.name).and_then(compile_registers);
+		if (not code or not register_code)
+		{
+			std::cout << "[FAILED] could not compile benchmark '" << benchmark.name << "'\n";
+			return;
+		}
+
+		try
+		{
+			global::mem->collector().reset_stats();
+			global::mem->cycles().reset_stats();
+			const auto switch_ms = time_run(code.value(), [] { return VirtualMachine(Dispatch::Switch); }, runs);
+			const auto threaded_ms = time_run(code.value(), [] { return VirtualMachine(Dispatch::Threaded); }, runs);
+			const auto register_ms = time_run(register_code.value(), [] { return RegisterVirtualMachine(); }, runs);
+			std::cout << std::format("[BENCHMARK] {:<24} switch: {:>9.2f}ms threaded: {:>9.2f}ms speedup: {:.2f}x register: {:>9.2f}ms instructions: {} -> {}\n"
+				, benchmark.name, switch_ms, threaded_ms, switch_ms / threaded_ms, register_ms
+				, instruction_count(code.value()), instruction_count(register_code.value()));
+
+			if constexpr (Collector::enabled)
+			{
+				const auto& stats = global::mem->collector().stats();
+				std::cout << std::format("[BENCHMARK] {:<24} collections: {} freed: {} pause total: {:.2f}ms max: {:.2f}ms\n"
+					, benchmark.name, stats.collections, stats.freed
+					, std::chrono::duration<double, std::milli>(stats.total_pause).count()
+					, std::chrono::duration<double, std::milli>(stats.max_pause).count());
+			}
+			else if (const auto& stats = global::mem->cycles().stats(); stats.collections > 0)
+			{
+				std::cout << std::format("[BENCHMARK] {:<24} cycle collections: {} freed: {} pause total: {:.2f}ms max: {:.2f}ms\n"
+					, benchmark.name, stats.collections, stats.freed
+					, std::chrono::duration<double, std::milli>(stats.total_pause).count()
+					, std::chrono::duration<double, std::milli>(stats.max_pause).count());
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "[FAILED] " << e.what() << " at benchmark '" << benchmark.name << "'\n";
+		}
+	}
+
+	/* @return Source of a script with functions of a few statements each, large enough that the front end shows up */
+	inline auto generated_source(size_t functions) -> String
+	{
+		auto source = String("var total = 0\n");
+		for (auto i{ 0ull }; i < functions; i++)
+		{
+			source += std::format("fn f{}(a, b):\n\tvar c = a * {} + (b - 3) / 4\n\tif c > 10:\n\t\tc = c - [a, b, {}][2]\n\tend\n\treturn c\nend\n", i, i, i);
+			source += std::format("total = total + f{}({}, 2)\n", i, i);
+		}
+		return source;
+	}
+
+	/* Times parsing, compiling and freeing the AST of a generated script, best of runs */
+	inline auto front_end(size_t functions, size_t runs) -> void
+	{
+		const auto source = generated_source(functions);
+		auto parse_ms = std::numeric_limits<double>::max();
+		auto compile_ms = std::numeric_limits<double>::max();
+		auto free_ms = std::numeric_limits<double>::max();
+		const auto since = [](auto begin) { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count(); };
+
+		for (auto run{ 0ull }; run < runs; run++)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			auto lexer = Lexer();
+			auto parser = Parser();
+			lexer.tokenize(source);
+			auto ast = std::optional<AST>(parser.parse(lexer));
+			parse_ms = std::min(parse_ms, since(begin));
+			if (not ast->error.empty())
+			{
+				std::cout << "[FAILED] " << ast->error << " at benchmark 'front_end'\n";
+				return;
+			}
+
+			begin = std::chrono::steady_clock::now();
+			auto code = Compiler().emit_bytecode(ast.value());
+			compile_ms = std::min(compile_ms, since(begin));
+
+			begin = std::chrono::steady_clock::now();
+			ast.reset();
+			free_ms = std::min(free_ms, since(begin));
+		}
+		std::cout << std::format("[BENCHMARK] {:<24} functions: {} parse: {:>9.2f}ms compile: {:>9.2f}ms free ast: {:>9.2f}ms\n"
+			, "front_end", functions, parse_ms, compile_ms, free_ms);
+	}
+
+	/* @return The profile of running code once, the code is compiled with or without superinstructions */
+	inline auto profile_run(const Benchmark& benchmark, bool superinstructions) -> OpcodeProfiler
+	{
+		auto ast = parse(benchmark.source, benchmark.name);
+		if (not ast)
+			return {};
+		auto code = Compiler({ .superinstructions = superinstructions }).emit_bytecode(ast.value());
+		if (std::holds_alternative<String>(code))
+			return {};
+
+		auto vm = DebugVirtualMachine<OpcodeProfiler>();
+		if (auto result = vm.run(std::get<Code>(code)); std::holds_alternative<String>(result))
+			std::cout << "[FAILED] " << std::get<String>(result) << " at benchmark '" << benchmark.name << "'\n";
+		return vm.debugger();
+	}
+
+	/*
+	* Runs every benchmark on a profiling vm and prints the opcode sequences executed most, n of every length.
+	* The sequences are counted without superinstructions, these are the candidates for fusing (see Superinstructions.h).
+	*/
+	inline auto profile(size_t n = 10) -> void
+	{
+		auto total = OpcodeProfiler();
+		auto fused_instructions = 0ull;
+		for (const auto& benchmark : _benchmarks)
+		{
+			total.merge(profile_run(benchmark, false));
+			fused_instructions += profile_run(benchmark, true).instructions();
+		}
+		total.report(std::cout, n);
+		std::cout << std::format("[PROFILE] {} instructions executed with superinstructions\n", fused_instructions);
+	}
+
+	inline auto start(size_t runs = 3) -> void
+	{
+		if constexpr (not LE_HAS_COMPUTED_GOTO)
+			std::cout << "[BENCHMARK] Computed goto is not supported by this compiler, threaded dispatch falls back to the switch\n";
+		std::cout << (Collector::enabled ? "[BENCHMARK] Memory: tracing collector\n" : "[BENCHMARK] Memory: reference counting\n");
+
+		for (const auto& benchmark : _benchmarks)
+			run(benchmark, runs);
+		front_end(5000, runs);
+	}
+}
+
+#undef LE_BENCHMARK
+#undef LE_BENCHMARK_END
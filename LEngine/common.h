@@ -6,6 +6,32 @@
 #define LE_TURN_ON_DEBUG_PRINTS 0
 #define LE_DEBUG_PRINT(format_str, ...) std::cout << std::format(format_str, __VA_ARGS__)
 
+/* Computed goto is a GNU extension, MSVC only gets the switch based dispatch loop */
+#if defined(__GNUC__) or defined(__clang__)
+#define LE_HAS_COMPUTED_GOTO 1
+#else
+#define LE_HAS_COMPUTED_GOTO 0
+#endif
+
+/* Define as 0 to make the virtual machine default to switch dispatch */
+#ifndef LE_THREADED_DISPATCH
+#define LE_THREADED_DISPATCH LE_HAS_COMPUTED_GOTO
+#endif
+
+/* Define as 1 to have objects referenced by values owned by the tracing collector instead of counted, see Collector.h */
+#ifndef LE_TRACING_GC
+#define LE_TRACING_GC 0
+#endif
+
+/* Define as 1 to give every thread a memory manager of its own and let objects be freed on another thread than they were made on, see MemoryManager.h */
+#ifndef LE_CONCURRENT_MEMORY
+#define LE_CONCURRENT_MEMORY 0
+#endif
+
+#if LE_TRACING_GC and LE_CONCURRENT_MEMORY
+#error "The tracing collector only knows the objects of its own thread, LE_TRACING_GC and LE_CONCURRENT_MEMORY can't be combined"
+#endif
+
 namespace le
 {
 	using Exception = std::exception;
@@ -15,6 +41,7 @@ namespace le
 	using u64 = std::uint64_t;
 	using i32 = std::int32_t;
 	using u32 = std::uint32_t;
+	using u16 = std::uint16_t;
 	using u8 = std::uint8_t;
 	using f32 = float;
 	using f64 = double;
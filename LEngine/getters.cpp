@@ -14,15 +14,15 @@ namespace le::getters
 
 auto le::getters::get_number(const LeObject& obj, const char* context) -> Number
 {
-    if (obj->type != RuntimeValue::Type::NumericLiteral)
+    if (not obj.is_number())
         throw(ferr::invalid_conversion(obj->type_name(), "Number", context));
 
-    return as<NumberValue>(obj).number;
+    return obj.as_number();
 }
 
-auto le::getters::get_string_ref(const LeObject& obj, const char* context) -> String&
+auto le::getters::get_string_ref(const LeObject& obj, const char* context) -> ManagedString&
 {
-    if (obj->type != RuntimeValue::Type::String)
+    if (obj.type() != RuntimeValue::Type::String)
         throw(ferr::invalid_conversion(obj->type_name(), "String", context));
 
     return as<StringValue>(obj).string;
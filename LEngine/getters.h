@@ -1,10 +1,11 @@
 #pragma once
 
 #include "Builtin.h"
+#include "Allocator.h"
 
 
 namespace le::getters
 {
 	auto get_number(const LeObject& obj, const char* context) -> Number;
-	auto get_string_ref(const LeObject& obj, const char* context) -> String&;
+	auto get_string_ref(const LeObject& obj, const char* context) -> ManagedString&;
 }
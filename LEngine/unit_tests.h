@@ -5,6 +5,10 @@
 #include "Lexer.h"
 #include "Interpreter.h"
 #include "Runner.h"
+#include "GlobalState.h"
+#include "Array.h"
+
+#include <thread>
 
 #define LE_UNIT_TEST_BEGIN(name, expect) \
 	inline auto unit_test_##name() -> void \
@@ -17,6 +21,7 @@
 namespace le::unit_test
 {
 	auto run(StringView source, StringView test_name, String expected) -> void;
+	auto check(const LeObject& res, StringView test_name, const String& expected, StringView backend) -> void;
 
 	LE_UNIT_TEST_BEGIN(variable_assignment, "50")
 		R"(
@@ -97,6 +102,23 @@ a
 )";
 		LE_UNIT_TEST_END();
 
+		LE_UNIT_TEST_BEGIN(compare_and_branch, "7")
+			R"(
+	var count = 0
+	var i = 0
+	while i <= 6:
+		if i > 2:
+			count = count + 1
+		end
+		if i == (2 > 1):
+			count = count + 3
+		end
+		i = i + 1
+	end
+	count
+)";
+		LE_UNIT_TEST_END();
+
 		LE_UNIT_TEST_BEGIN(nested_while_loop, "20")
 			R"(
 	var iteration = 0
@@ -136,6 +158,19 @@ a
 )";
 		LE_UNIT_TEST_END();
 
+		/* Deeper than the native stack would allow if script calls recursed through the machine */
+		LE_UNIT_TEST_BEGIN(deep_recursion, "123456")
+			R"(
+	fn depth(n):
+		if n == 0:
+			return 0 end
+		return depth(n - 1) + 1
+	end
+
+	depth(123456)
+)";
+		LE_UNIT_TEST_END();
+
 		LE_UNIT_TEST_BEGIN(return_test, "7")
 			R"(
 	fn func(n):
@@ -210,6 +245,698 @@ a
 )";
 		LE_UNIT_TEST_END();
 
+		/* One access site sees receivers with different layouts, the inline cache has to follow along */
+		LE_UNIT_TEST_BEGIN(member_access_cache, "44")
+			R"(
+	class Point:
+		var x = 1
+		var y = 2
+	end
+	class Other:
+		var y = 10
+		var x = 20
+	end
+
+	fn get_x(object):
+		return object.x
+	end
+
+	var total = 0
+	for object in [Point(), Other(), Point(), Other()]:
+		total = total + get_x(object)
+	end
+	var array = [1]
+	total + array.size() + [1, 2].size() - 1
+)";
+		LE_UNIT_TEST_END();
+
+		/* Instances made by the same class share their shape but not their slots */
+		LE_UNIT_TEST_BEGIN(class_instances, "4950")
+			R"(
+	class Point:
+		var x = 0
+		var y = 0
+	end
+
+	var points = []
+	var i = 0
+	while i < 100:
+		var point = Point()
+		point.x = i
+		points.append(point)
+		i = i + 1
+	end
+
+	var total = 0
+	for p in points:
+		total = total + p.x + p.y
+	end
+	total
+)";
+		LE_UNIT_TEST_END();
+
+		/* Methods called directly, read as a bound member and functions stored in a member later on which do not receive 'this' */
+		LE_UNIT_TEST_BEGIN(method_calls, "48")
+			R"(
+	class Counter:
+		var count = 0
+		var callback = 0
+
+		fn add(n):
+			this.count = this.count + n
+			return this
+		end
+	end
+
+	var counter = Counter()
+	counter.add(1).add(2)
+	var bound = counter.add
+	bound(3)
+	counter.callback = fn(n): n * 10 end
+
+	var values = []
+	values.append(counter.count)
+	values.append(counter.callback(4))
+	values[0] + values[1] + values.size()
+)";
+		LE_UNIT_TEST_END();
+
+		LE_UNIT_TEST_BEGIN(immediate_values, "3")
+			R"(
+	var a = 0.5 * 4
+	var b = a > 1
+	var c = [a, b, 1 == 2]
+	c[0] + c[1] + c[2]
+)";
+		LE_UNIT_TEST_END();
+
+		/* Range, Array and String are stepped in place, anything else through its iterator */
+		LE_UNIT_TEST_BEGIN(for_loops, "71")
+			R"(
+	fn count_chars(string):
+		var count = 0
+		for c in string:
+			if c == "l":
+				return count
+			end
+			count = count + 1
+		end
+		return count
+	end
+
+	var total = 0
+	for i in Range(0, 10, 2):
+		for j in [1, 2]:
+			total = total + i * j
+			j
+		end
+	end
+	for n in Iterator(Range(0, 4)):
+		total = total + n
+	end
+	total + count_chars("hello") + count_chars("abc") + count_chars("")
+)";
+		LE_UNIT_TEST_END();
+
+		/* Needs many pools of the same size, which get freed and filled again */
+		LE_UNIT_TEST_BEGIN(many_pools, "40000")
+			R"(
+	var values = []
+	for i in Range(0, 20000):
+		values.append([i])
+	end
+	values = []
+	for j in Range(0, 40000):
+		values.append([j])
+	end
+	values.size()
+)";
+		LE_UNIT_TEST_END();
+
+		/* The snapshot counts the arrays made here, peak usage never trails current usage */
+		LE_UNIT_TEST_BEGIN(mem_stats, "3")
+			R"(
+	var values = []
+	for i in Range(0, 100):
+		values.append([i])
+	end
+	var stats = mem_stats()
+	var checks = 0
+	if stats.objects.Array > 100:
+		checks = checks + 1
+	end
+	if stats.peak_bytes >= stats.live_bytes:
+		checks = checks + 1
+	end
+	if stats.allocations > stats.frees:
+		checks = checks + 1
+	end
+	checks
+)";
+		LE_UNIT_TEST_END();
+
+		/* Contents bigger than a pool block go to the large object space */
+		LE_UNIT_TEST_BEGIN(large_contents, "2199")
+			R"(
+	var values = []
+	for i in Range(0, 500):
+		values.append(i)
+	end
+	var text = ""
+	for j in Range(0, 300):
+		text = text + "abcd"
+	end
+	var count = 0
+	for c in text:
+		count = count + 1
+	end
+	values.size() + count + values[499]
+)";
+		LE_UNIT_TEST_END();
+
+		/*
+		* Pools emptied by dropping the values are given back, in tracing mode once the churn has them collected.
+		* The values outweigh the churn the tracing collector leaves uncollected, which is up to Collector::min_threshold objects.
+		*/
+		LE_UNIT_TEST_BEGIN(release_pools, "2")
+			R"(
+	var values = []
+	for i in Range(0, 20000):
+		values.append([i, "pooled contents"])
+	end
+	var peak = mem_stats().reserved_bytes
+	values = 0
+	var churn = 0
+	for j in Range(0, 40000):
+		churn = [j]
+	end
+	var released = mem_trim()
+	var checks = 0
+	if mem_stats().reserved_bytes < peak:
+		checks = checks + 1
+	end
+	if mem_stats().released_pools > 0:
+		checks = checks + 1
+	end
+	checks
+)";
+		LE_UNIT_TEST_END();
+
+		/* One row in 64 is kept, in tracing mode the pools the collections leave it in are compacted and keep its contents intact */
+		LE_UNIT_TEST_BEGIN(compact_pools, "24960001")
+			R"(
+	var kept = []
+	var next = 0
+	for i in Range(0, 40000):
+		var row = [i, i, i, i, i, i, i, i, i, i, i, i]
+		if i == next:
+			kept.append(row)
+			next = next + 64
+		end
+	end
+	var churn = 0
+	for j in Range(0, 40000):
+		churn = [j]
+	end
+	var total = 0
+	for values in kept:
+		total = total + values[0] + values[11]
+	end
+	var checks = 0
+	for entry in mem_stats().blocks:
+		if entry[0] == 96:
+			if entry[1] * 96 * 4 >= entry[2] * 16384:
+				checks = checks + 1
+			end
+		end
+	end
+	total + checks
+)";
+		LE_UNIT_TEST_END();
+
+		/* The characters are made in the nursery, the kept ones survive the chunks they were made in */
+		LE_UNIT_TEST_BEGIN(nursery_survivors, "33000")
+			R"(
+	var text = "abcdefghij"
+	var kept = []
+	var count = 0
+	for i in Range(0, 3000):
+		for c in text:
+			if c == "j":
+				kept.append(c)
+			end
+			count = count + 1
+		end
+	end
+	count + kept.size()
+)";
+		LE_UNIT_TEST_END();
+
+		/* Keeps one character in 300, stored in an array they are copied out of the nursery so reserved memory grows with what is kept */
+		LE_UNIT_TEST_BEGIN(nursery_escapes, "2000")
+			R"(
+	var text = ""
+	var n = 0
+	while n < 299:
+		text = text + "a"
+		n = n + 1
+	end
+	text = text + "z"
+
+	var kept = []
+	var before = mem_stats()
+	for i in Range(0, 2000):
+		for c in text:
+			if c == "z":
+				kept.append(c)
+			end
+		end
+	end
+	var after = mem_stats()
+	var result = kept.size()
+	if after.reserved_bytes - before.reserved_bytes > 4 * (after.live_bytes - before.live_bytes):
+		result = 0
+	end
+	result
+)";
+		LE_UNIT_TEST_END();
+
+		/* Every iteration leaves a cycle behind, which the tracing collector has to free while the last one stays reachable */
+		LE_UNIT_TEST_BEGIN(garbage_cycles, "79999")
+			R"(
+	class Node:
+		var next = 0
+		var value = 0
+	end
+
+	var last = 0
+	var total = 0
+	var i = 0
+	while i < 40000:
+		var a = Node()
+		var b = Node()
+		a.next = b
+		b.next = a
+		b.value = i
+		last = a
+		total = total + a.next.value - i + 1
+		i = i + 1
+	end
+	total + last.next.next.next.value
+)";
+		LE_UNIT_TEST_END();
+
+		/* Reference counting alone leaks the cycles and arrays holding themselves, the cycle collector frees them */
+		LE_UNIT_TEST_BEGIN(cycle_collection, "3")
+			R"(
+	class Node:
+		var next = 0
+	end
+
+	var i = 0
+	while i < 20000:
+		var a = Node()
+		var b = Node()
+		a.next = b
+		b.next = a
+		var self = [0]
+		self[0] = self
+		i = i + 1
+	end
+	var stats = mem_stats()
+	var checks = 0
+	if stats.objects.Class < 10000:
+		checks = checks + 1
+	end
+	if stats.objects.Array < 10000:
+		checks = checks + 1
+	end
+	if i == 20000:
+		checks = checks + 1
+	end
+	checks
+)";
+		LE_UNIT_TEST_END();
+
+		/* Locals mixed with number literals are fused into superinstructions by the stack compiler */
+		LE_UNIT_TEST_BEGIN(superinstructions, "67.5")
+			R"(
+	fn sum(n):
+		var total = 0
+		var i = 0
+		while i < n:
+			total = total + i * 2 - i / 2
+			i = i + 1
+		end
+		var j = n
+		while j >= 1:
+			j = j - 1
+		end
+		return total + j
+	end
+	sum(10)
+)";
+		LE_UNIT_TEST_END();
+
+		/* Constant expressions and vars that are never reassigned are folded before compiling, see ConstantFolder */
+		LE_UNIT_TEST_BEGIN(constant_folding, "4")
+			R"(
+	var seconds_per_day = 60 * 60 * 24
+	var greeting = "Hello" + ", " + "world"
+	var debug = 0
+	var mode = "release"
+	var checks = 0
+	if seconds_per_day == 86400:
+		checks = checks + 1
+	end
+	if greeting == "Hello, world":
+		checks = checks + 1
+	end
+	if debug:
+		checks = 100
+	end
+	if mode != "release":
+		checks = 100
+	end
+	while debug > 0:
+		checks = 100
+	end
+	var counter = 5
+	counter = counter - 1
+	if counter == 4:
+		checks = checks + 1
+	end
+	fn half(x):
+		var scale = -2 / 4
+		return x * -scale
+	end
+	checks + half(2)
+)";
+		LE_UNIT_TEST_END();
+
+		/* Nested branches jump to jumps, the peephole optimizer sends them straight to the end. See optimize_peephole */
+		LE_UNIT_TEST_BEGIN(jump_threading, "1634")
+			R"(
+	fn classify(n):
+		if n < 10:
+			if n < 5:
+				return 1
+			else:
+				return 2
+			end
+		elif n < 20:
+			return 3
+		else:
+			return 4
+		end
+	end
+	var total = 0
+	var evens = 0
+	var odds = 0
+	var i = 0
+	while i < 10:
+		i = i + 1
+		if i > 8:
+			break
+		end
+		if i == 3:
+			continue
+		else:
+			if classify(i) == 1:
+				evens = evens + 1
+			else:
+				odds = odds + 1
+			end
+		end
+		total = total + classify(i * 2)
+	end
+	total * 100 + evens * 10 + odds
+)";
+		LE_UNIT_TEST_END();
+
+		/* A local only loaded right after it is stored is left on the stack, unless it is read again or a branch joins at the load. See optimize_peephole */
+		LE_UNIT_TEST_BEGIN(store_load, "300")
+			R"(
+	fn scaled(n):
+		var doubled = n * 2
+		doubled
+	end
+	fn twice(n):
+		var doubled = n * 2
+		doubled + doubled
+	end
+	fn pick(n):
+		var chosen = 0
+		if n > 5:
+			chosen = n
+		end
+		chosen
+	end
+	var total = 0
+	for i in Range(0, 10):
+		total = total + scaled(i) + twice(i) + pick(i)
+	end
+	total
+)";
+		LE_UNIT_TEST_END();
+
+		/* Code after break, continue and return is never reached and constant tests always go the same way, see eliminate_dead_code */
+		LE_UNIT_TEST_BEGIN(dead_code, "15")
+			R"(
+	fn index_of(items, wanted):
+		var index = 0
+		for item in items:
+			if item == wanted:
+				return index
+				index = 1000
+			end
+			index = index + 1
+		end
+		return 0 - 1
+		index = 2000
+	end
+	fn count_until(limit):
+		var count = 0
+		var i = 0
+		while i < 10:
+			i = i + 1
+			if i == limit:
+				break
+				count = 1000
+			end
+			if i == 2:
+				continue
+				count = 2000
+			end
+			count = count + 1
+		end
+		return count
+	end
+	var total = 0
+	while 1:
+		total = total + count_until(5) + index_of([4, 5, 6], 6)
+		if total > 10:
+			break
+		end
+	end
+	total
+)";
+		LE_UNIT_TEST_END();
+
+		/* repeat is typed for numbers behind a guard, strings take the untyped copy */
+		LE_UNIT_TEST_BEGIN(type_inference, "116")
+			R"(
+	fn repeat(value, times):
+		var result = value
+		var i = 1
+		while i < times:
+			result = result + value
+			i = i + 1
+		end
+		return result
+	end
+	class Counter:
+		var count = 0
+		fn add(amount):
+			this.count = this.count + amount * 2
+			return this.count
+		end
+	end
+	var counter = Counter()
+	counter.add(3)
+	var total = repeat(2, 3) + repeat(0 - 1, 2) + counter.add(3)
+	if repeat("ab", 3) == "ababab":
+		total = total + 100
+	end
+	total
+)";
+		LE_UNIT_TEST_END();
+
+		LE_UNIT_TEST_BEGIN(inlining, "86")
+			R"(
+	fn square(x):
+		return x * x
+	end
+	fn clamp(value, low, high):
+		if value < low:
+			return low end
+		if value > high:
+			return high end
+		return value
+	end
+	fn sum(values):
+		var total = 0
+		for value in values:
+			total = total + value
+		end
+		return total
+	end
+	fn fibo(n):
+		if n > 1:
+			return fibo(n - 1) + fibo(n - 2) end
+		return n
+	end
+	var result = 0
+	var i = 0
+	while i < 5:
+		result = result + clamp(square(i), 1, 10)
+		i = i + 1
+	end
+	result + sum([1, 2, 3]) + fibo(10)
+)";
+		LE_UNIT_TEST_END();
+
+		/* A local stored on some paths only is null on the others, also once the call is inlined. The call through a local is never inlined */
+		LE_UNIT_TEST_BEGIN(inlined_locals, "44")
+			R"(
+	fn pick(x):
+		if x:
+			var r = 7
+		end
+		return r
+	end
+	var called = pick
+	var inlined_sevens = 0
+	var called_sevens = 0
+	for i in Range(0, 10):
+		if pick(i < 4):
+			inlined_sevens = inlined_sevens + 1
+		end
+		if called(i < 4):
+			called_sevens = called_sevens + 1
+		end
+	end
+	inlined_sevens * 10 + called_sevens
+)";
+		LE_UNIT_TEST_END();
+
+		/* found holds n only when it was stored, not what a temporary of the test left in its register */
+		LE_UNIT_TEST_BEGIN(branch_locals, "1")
+			R"(
+	fn find(n):
+		if n / 2 == 3:
+			var found = n
+		end
+		return found
+	end
+	var count = 0
+	for i in Range(0, 10):
+		if find(i):
+			count = count + 1
+		end
+	end
+	count
+)";
+		LE_UNIT_TEST_END();
+
+
+
+	/*
+	* The loop body ends in a branch that is never taken, the loop still has to pass the safepoint of its Jump back.
+	* The arrays it drops wait for a collection, a script can't count them as calling mem_stats is a safepoint of its own.
+	*/
+	inline auto unit_test_loop_safepoints() -> void
+	{
+		constexpr auto source = R"(
+	var i = 0
+	var k = 0
+	while i < 200000:
+		var a = [i, i, i, i]
+		i = i + 1
+		if i < 0:
+			k = 1
+		end
+	end
+	k + 1
+)";
+		auto waiting = []() { return Collector::enabled ? global::mem->collector().tracked() : global::mem->cycles().candidates(); };
+		auto bounded = [&waiting](LeObject result, size_t before)
+		{
+			return waiting() < before + 100000ull ? result : LeObject::from_number(-1.0);
+		};
+
+		auto before = waiting();
+		check(bounded(le::run_with_vm(source, "__unit_tests__"), before), "loop_safepoints", "1", "stack");
+		before = waiting();
+		check(bounded(le::run_with_register_vm(source, "__unit_tests__"), before), "loop_safepoints", "1", "register");
+	}
+
+#if LE_CONCURRENT_MEMORY
+	/*
+	* Arrays made here are handed to a thread with a manager of its own, which copies and drops them while this thread collects its own cycles.
+	* Handing them over leaves none of them buffered here, and every one is freed back to this manager once the other thread let go.
+	*/
+	inline auto unit_test_thread_hand_over() -> void
+	{
+		auto& mem = *global::mem;
+		mem.cycles().collect();
+		const auto live = mem.stats().live_objects();
+
+		auto values = std::vector<LeObject>{};
+		for (auto i{ 0ull }; i < 1000ull; i++)
+		{
+			auto inner = mem.emplace<Array>(1ull);
+			inner->data.push_back(LeObject::from_number(static_cast<Number>(i)));
+			auto outer = mem.emplace<Array>(1ull);
+			outer->data.push_back(inner);
+			values.push_back(outer); /* Both outlive their Refs, so they are buffered */
+		}
+		const auto buffered = mem.cycles().candidates();
+		mem.hand_over(values);
+		const auto left = mem.cycles().candidates();
+
+		auto sum = Number{};
+		auto worker = std::thread([&sum, values = std::move(values)]() mutable
+		{
+			auto memory = global::ThreadMemory();
+			for (auto round{ 0 }; round < 20; round++)
+			{
+				for (const auto& value : values)
+				{
+					auto inner = static_cast<Array*>(value.get())->data[0];
+					sum += static_cast<Array*>(inner.get())->data[0].as_number();
+				}
+				global::mem->cycles().collect();
+			}
+			values.clear();
+			global::mem->cycles().collect();
+		});
+
+		for (auto round{ 0 }; round < 200; round++)
+		{
+			auto garbage = mem.emplace<Array>(1ull);
+			auto cycle = LeObject(garbage);
+			garbage->data.push_back(cycle);
+			mem.cycles().collect();
+		}
+		worker.join();
+		mem.cycles().collect();
+
+		const auto handed_over = buffered >= 2000ull and left == 0ull;
+		const auto freed = mem.stats().live_objects() == live;
+		check(LeObject::from_number(handed_over and freed ? sum : -1.0), "thread_hand_over", "9990000", "threads");
+	}
+#endif
 
 	static inline auto _unit_tests = std::vector<void(*)()>
 	{
@@ -221,17 +948,47 @@ a
 		LE_REGISTER_UNIT_TEST(nested_if_statements)
 		LE_REGISTER_UNIT_TEST(while_loop)
 		LE_REGISTER_UNIT_TEST(nested_while_loop)
+		LE_REGISTER_UNIT_TEST(compare_and_branch)
 		LE_REGISTER_UNIT_TEST(scope_test)
 		LE_REGISTER_UNIT_TEST(return_test)
 		LE_REGISTER_UNIT_TEST(nested_while_break_test)
 		LE_REGISTER_UNIT_TEST(fibonacci_test)
+		LE_REGISTER_UNIT_TEST(deep_recursion)
 		LE_REGISTER_UNIT_TEST(array_member_functions)
 		LE_REGISTER_UNIT_TEST(class_creation_member_call)
 		LE_REGISTER_UNIT_TEST(access_call)
+		LE_REGISTER_UNIT_TEST(immediate_values)
+		LE_REGISTER_UNIT_TEST(member_access_cache)
+		LE_REGISTER_UNIT_TEST(class_instances)
+		LE_REGISTER_UNIT_TEST(method_calls)
+		LE_REGISTER_UNIT_TEST(for_loops)
+		LE_REGISTER_UNIT_TEST(superinstructions)
+		LE_REGISTER_UNIT_TEST(many_pools)
+		LE_REGISTER_UNIT_TEST(garbage_cycles)
+		LE_REGISTER_UNIT_TEST(nursery_survivors)
+		LE_REGISTER_UNIT_TEST(nursery_escapes)
+		LE_REGISTER_UNIT_TEST(large_contents)
+		LE_REGISTER_UNIT_TEST(mem_stats)
+		LE_REGISTER_UNIT_TEST(release_pools)
+		LE_REGISTER_UNIT_TEST(cycle_collection)
+		LE_REGISTER_UNIT_TEST(compact_pools)
+		LE_REGISTER_UNIT_TEST(constant_folding)
+		LE_REGISTER_UNIT_TEST(jump_threading)
+		LE_REGISTER_UNIT_TEST(loop_safepoints)
+		LE_REGISTER_UNIT_TEST(store_load)
+		LE_REGISTER_UNIT_TEST(dead_code)
+		LE_REGISTER_UNIT_TEST(type_inference)
+		LE_REGISTER_UNIT_TEST(inlining)
+		LE_REGISTER_UNIT_TEST(inlined_locals)
+		LE_REGISTER_UNIT_TEST(branch_locals)
+#if LE_CONCURRENT_MEMORY
+		LE_REGISTER_UNIT_TEST(thread_hand_over)
+#endif
 		//LE_REGISTER_UNIT_TEST(static_var_test)
 	};
 	
-	inline auto run(StringView source, StringView test_name, String expected) -> void
+	/* Checks the result of one backend */
+	inline auto check(const LeObject& res, StringView test_name, const String& expected, StringView backend) -> void
 	{
 		/* abc\0\0 == abc\0 */
 		const auto cmp_till_null = [](const String& a, const String& b) -> bool
@@ -243,9 +1000,6 @@ a
 			return StringView(a.data(), a_end) == StringView(b.data(), b_end);
 		};
 
-		// le::print_bytecode(source, "__unit_tests__");
-		auto res = le::run_with_vm(source, "__unit_tests__");
-		
 		if (res)
 		{
 			if (cmp_till_null(res->make_string(), expected))
@@ -262,7 +1016,15 @@ a
 			std::cout << "[FAILED] got nullptr ";
 		}
 		
-		std::cout << " at test '" << test_name << "'\n";
+		std::cout << " at test '" << test_name << "' (" << backend << ")\n";
+	}
+
+	/* Every test runs on both the stack and the register backend */
+	inline auto run(StringView source, StringView test_name, String expected) -> void
+	{
+		// le::print_bytecode(source, "__unit_tests__");
+		check(le::run_with_vm(source, "__unit_tests__"), test_name, expected, "stack");
+		check(le::run_with_register_vm(source, "__unit_tests__"), test_name, expected, "register");
 	}
 
 	inline auto start() -> void
@@ -14,5 +14,5 @@ auto le::lib::io::print(std::span<LeObject> args, MemoryManager& mem) -> LeObjec
 
 	std::cout << '\n';
 
-	return mem.emplace<NullValue>();
+	return LeObject::null();
 }